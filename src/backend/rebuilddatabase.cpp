@@ -397,7 +397,7 @@ void RebuildDatabase::downloadJobFinished(TransferJob *job)
 }
 
 
-bool RebuildDatabase::downloadInventories(const std::vector<BrickLink::Item> &invs,
+bool RebuildDatabase::downloadInventories(const std::vector<BrickLink::TextImport::ImportItem> &invs,
                                           const std::vector<bool> &processedInvs)
 {
     bool failed = false;
@@ -407,15 +407,16 @@ bool RebuildDatabase::downloadInventories(const std::vector<BrickLink::Item> &in
     QUrl url("https://www.bricklink.com/catalogDownload.asp"_l1);
 
     for (uint i = 0; i < invs.size(); ++i) {
-        const BrickLink::Item *item = &invs[i];
+        const auto &inv = invs[i];
         if (!processedInvs[i]) {
-            QSaveFile *f = BrickLink::core()->dataSaveFile(u"inventory.xml", item);
+            QSaveFile *f = BrickLink::core()->dataSaveFile(u"inventory.xml", inv.m_item.itemTypeId(),
+                                                           inv.m_id);
 
             if (!f || !f->isOpen()) {
                 if (f)
                     m_error = "failed to write "_l1 % f->fileName() % u": " % f->errorString();
                 else
-                    m_error = "could not get a file handle to write inventory for "_l1 % QLatin1String(item->id());
+                    m_error = "could not get a file handle to write inventory for "_l1 % QLatin1String(inv.m_id);
                 delete f;
                 failed = true;
                 break;
@@ -424,8 +425,8 @@ bool RebuildDatabase::downloadInventories(const std::vector<BrickLink::Item> &in
             QList<QPair<QString, QString> > items {
                 { QPair<QString, QString>("a"_l1,            "a"_l1) },
                 { QPair<QString, QString>("viewType"_l1,     "4"_l1) },
-                { QPair<QString, QString>("itemTypeInv"_l1,  QString(QLatin1Char(item->itemTypeId()))) },
-                { QPair<QString, QString>("itemNo"_l1,       QLatin1String(item->id())) },
+                { QPair<QString, QString>("itemTypeInv"_l1,  QString(QLatin1Char(inv.m_item.itemTypeId()))) },
+                { QPair<QString, QString>("itemNo"_l1,       QLatin1String(inv.m_id)) },
                 { QPair<QString, QString>("downloadType"_l1, "X"_l1) }
             };
             QUrlQuery query;
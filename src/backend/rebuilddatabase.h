@@ -17,6 +17,7 @@
 #include <QDateTime>
 
 #include "bricklink/global.h"
+#include "bricklink/textimport.h"
 #include "utility/transfer.h"
 
 
@@ -36,7 +37,8 @@ private:
     int error(const QString &);
 
     bool download();
-    bool downloadInventories(const std::vector<BrickLink::Item> &invs, const std::vector<bool> &processedInvs);
+    bool downloadInventories(const std::vector<BrickLink::TextImport::ImportItem> &invs,
+                             const std::vector<bool> &processedInvs);
 
 private:
     Transfer *m_trans;
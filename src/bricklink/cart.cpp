@@ -455,7 +455,7 @@ void Carts::startFetchLots(Cart *cart)
     url.setQuery(query);
 
     auto job = TransferJob::post(url);
-
+    job->setJobClass(TransferJob::Inventory);
     job->setUserData("cart", QVariant::fromValue(cart->sellerId()));
     m_cartJobs << job;
 
@@ -13,6 +13,9 @@
 */
 #include <cstdio>
 #include <cstdlib>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
 
 #include <QFile>
 #include <QSaveFile>
@@ -331,15 +334,16 @@ QString Core::dataPath() const
     return m_datadir;
 }
 
-QString Core::dataFileName(QStringView fileName, const Item *item, const Color *color) const
+QString Core::dataFileName(QStringView fileName, char itemTypeId, const QByteArray &itemId,
+                           const Color *color) const
 {
     // Avoid huge directories with 1000s of entries.
     // sse4.2 is only used if a seed value is supplied
     // please note: Qt6's qHash is incompatible
-    uchar hash = q5Hash(QString::fromLatin1(item->id()), 42) & 0xff;
+    uchar hash = q5Hash(QString::fromLatin1(itemId), 42) & 0xff;
 
-    QString p = m_datadir % QLatin1Char(item->itemTypeId()) % u'/' % (hash < 0x10 ? u"0" : u"")
-            % QString::number(hash, 16) % u'/' % QLatin1String(item->id()) % u'/'
+    QString p = m_datadir % QLatin1Char(itemTypeId) % u'/' % (hash < 0x10 ? u"0" : u"")
+            % QString::number(hash, 16) % u'/' % QLatin1String(itemId) % u'/'
             % (color ? QString::number(color->id()) : QString()) % (color ? u"/" : u"")
             % fileName;
 
@@ -348,14 +352,26 @@ QString Core::dataFileName(QStringView fileName, const Item *item, const Color *
 
 QFile *Core::dataReadFile(QStringView fileName, const Item *item, const Color *color) const
 {
-    auto f = new QFile(dataFileName(fileName, item, color));
+    return dataReadFile(fileName, item->itemTypeId(), item->id(), color);
+}
+
+QSaveFile *Core::dataSaveFile(QStringView fileName, const Item *item, const Color *color) const
+{
+    return dataSaveFile(fileName, item->itemTypeId(), item->id(), color);
+}
+
+QFile *Core::dataReadFile(QStringView fileName, char itemTypeId, const QByteArray &itemId,
+                          const Color *color) const
+{
+    auto f = new QFile(dataFileName(fileName, itemTypeId, itemId, color));
     f->open(QIODevice::ReadOnly);
     return f;
 }
 
-QSaveFile *Core::dataSaveFile(QStringView fileName, const Item *item, const Color *color) const
+QSaveFile *Core::dataSaveFile(QStringView fileName, char itemTypeId, const QByteArray &itemId,
+                              const Color *color) const
 {
-    auto p = dataFileName(fileName, item, color);
+    auto p = dataFileName(fileName, itemTypeId, itemId, color);
 
     if (!QDir(fileName.isEmpty() ? p : p.left(p.size() - int(fileName.size()))).mkpath("."_l1))
         return nullptr;
@@ -458,6 +474,8 @@ Core *Core::create(const QString &datadir, QString *errstring)
 
             if (errstring)
                 *errstring = tr("Data directory \'%1\' is not both read- and writable.").arg(datadir);
+        } else {
+            s_inst->m_pg_store = new PriceGuideStore(test % u"priceguides.bin", test);
         }
     }
     return s_inst;
@@ -480,6 +498,8 @@ Core::Core(const QString &datadir)
     });
     connect(m_transfer, &Transfer::overallProgress,
             this, &Core::transferProgress);
+    connect(m_transfer, &Transfer::statisticsChanged,
+            this, &Core::transferStatisticsChanged);
 
     connect(m_authenticatedTransfer, &Transfer::finished,
             this, [this](TransferJob *job) {
@@ -536,6 +556,10 @@ Core::Core(const QString &datadir)
     connect(m_authenticatedTransfer, &Transfer::started,
             this, &Core::authenticatedTransferStarted);
 
+    // the cached pictures and price guides reference items and colors of the old database
+    connect(this, &Core::beginResetDatabase, this, &Core::beginResetCaches);
+    connect(this, &Core::endResetDatabase, this, &Core::endResetCaches);
+
     m_diskloadPool.setMaxThreadCount(QThread::idealThreadCount() * 3);
     m_online = true;
 
@@ -557,6 +581,10 @@ Core::Core(const QString &datadir)
 Core::~Core()
 {
     clear();
+    m_diskloadPool.clear();
+    m_diskloadPool.waitForDone();
+    qDeleteAll(m_orphans);
+    delete m_pg_store;
     s_inst = nullptr;
 }
 
@@ -839,22 +867,18 @@ const Color *Core::colorFromName(const QString &name) const
     if (name.isEmpty())
         return nullptr;
 
-    auto it = std::find_if(colors().cbegin(), colors().cend(), [name](const auto &color) {
-        return !color.name().compare(name, Qt::CaseInsensitive);
-    });
-    if (it != colors().cend())
-        return &(*it);
+    auto it = database()->m_colorNameIndex.constFind(name.toCaseFolded());
+    if (it != database()->m_colorNameIndex.cend())
+        return &colors()[it.value()];
     return nullptr;
 }
 
 
 const Color *Core::colorFromLDrawId(int ldrawId) const
 {
-    auto it = std::find_if(colors().cbegin(), colors().cend(), [ldrawId](const auto &color) {
-        return (color.ldrawId() == ldrawId);
-    });
-    if (it != colors().cend())
-        return &(*it);
+    auto it = database()->m_colorLDrawIndex.constFind(ldrawId);
+    if (it != database()->m_colorLDrawIndex.cend())
+        return &colors()[it.value()];
     return nullptr;
 }
 
@@ -869,20 +893,14 @@ const ItemType *Core::itemType(char id) const
 
 const Item *Core::item(char tid, const QByteArray &id) const
 {
-    auto needle = std::make_pair(tid, id);
-    auto it = std::lower_bound(items().cbegin(), items().cend(), needle, Item::lessThan);
-    if ((it != items().cend()) && (it->m_itemTypeId == tid) && (it->m_id == id))
-        return &(*it);
-    return nullptr;
+    return database()->findItem(tid, id.constData(), id.size());
 }
 
 const Item *Core::item(const std::string &tids, const QByteArray &id) const
 {
     for (const char &tid : tids) {
-        auto needle = std::make_pair(tid, id);
-        auto it = std::lower_bound(items().cbegin(), items().cend(), needle, Item::lessThan);
-        if ((it != items().cend()) && (it->m_itemTypeId == tid) && (it->m_id == id))
-            return &(*it);
+        if (auto item = database()->findItem(tid, id.constData(), id.size()))
+            return item;
     }
     return nullptr;
 }
@@ -1036,9 +1054,15 @@ public:
     explicit PriceGuideLoaderJob(PriceGuide *pg)
         : QRunnable()
         , m_pg(pg)
+        , m_generation(core()->database()->generation())
     {
         pg->m_update_status = UpdateStatus::Loading;
     }
+    ~PriceGuideLoaderJob() override
+    {
+        if (m_pg) // never run, because the pool was cleared
+            m_pg->release();
+    }
 
     void run() override;
 
@@ -1051,6 +1075,7 @@ private:
     Q_DISABLE_COPY(PriceGuideLoaderJob)
 
     PriceGuide *m_pg;
+    uint m_generation;
 };
 
 void PriceGuideLoaderJob::run()
@@ -1060,8 +1085,15 @@ void PriceGuideLoaderJob::run()
         PriceGuide::Data data;
         bool valid = m_pg->loadFromDisk(fetched, data);
         auto pg = m_pg;
+        auto generation = m_generation;
+        m_pg = nullptr; // the reference is released by core()
 
         QMetaObject::invokeMethod(core(), [=]() {
+            if (generation != core()->database()->generation()) {
+                // endResetCaches() has already started a new load
+                pg->release();
+                return;
+            }
             pg->m_valid = valid;
             pg->m_update_status = UpdateStatus::Ok;
             if (valid) {
@@ -1074,12 +1106,78 @@ void PriceGuideLoaderJob::run()
 }
 
 
+class PriceGuideBatchLoaderJob : public QRunnable
+{
+public:
+    explicit PriceGuideBatchLoaderJob(const QVector<PriceGuide *> &pgs)
+        : QRunnable()
+        , m_pgs(pgs)
+        , m_generation(core()->database()->generation())
+    {
+        for (PriceGuide *pg : pgs)
+            pg->m_update_status = UpdateStatus::Loading;
+    }
+    ~PriceGuideBatchLoaderJob() override
+    {
+        for (PriceGuide *pg : qAsConst(m_pgs)) // never run, because the pool was cleared
+            pg->release();
+    }
+
+    void run() override;
+
+private:
+    Q_DISABLE_COPY(PriceGuideBatchLoaderJob)
+
+    QVector<PriceGuide *> m_pgs;
+    uint m_generation;
+};
+
+void PriceGuideBatchLoaderJob::run()
+{
+    std::vector<PriceGuideStore::Entry> entries(size_t(m_pgs.size()));
+    for (int i = 0; i < m_pgs.size(); ++i) {
+        entries[size_t(i)].item = m_pgs.at(i)->item();
+        entries[size_t(i)].color = m_pgs.at(i)->color();
+    }
+
+    if (auto *store = core()->priceGuideStore())
+        store->load(entries);
+
+    QMetaObject::invokeMethod(core(), [pgs = std::exchange(m_pgs, { }), generation = m_generation,
+                                       entries = std::move(entries)]() {
+        if (generation != core()->database()->generation()) {
+            // endResetCaches() has already started a new load
+            for (PriceGuide *pg : pgs)
+                pg->release();
+            return;
+        }
+        for (int i = 0; i < pgs.size(); ++i) {
+            PriceGuide *pg = pgs.at(i);
+            const auto &entry = entries[size_t(i)];
+
+            pg->m_valid = entry.valid;
+            pg->m_update_status = UpdateStatus::Ok;
+            if (entry.valid) {
+                pg->m_fetched = entry.fetched;
+                pg->m_data = entry.data;
+            }
+        }
+        core()->priceGuideBatchLoaded(pgs);
+    }, Qt::QueuedConnection);
+}
+
+
+quint64 Core::priceGuideKey(const Item *item, const Color *color)
+{
+    return quint64(color->id()) << 32 | quint64(item->itemTypeId()) << 24 | quint64(item->index());
+}
+
 PriceGuide *Core::priceGuide(const Item *item, const Color *color, bool highPriority)
 {
     if (!item || !color)
         return nullptr;
 
-    quint64 key = quint64(color->id()) << 32 | quint64(item->itemTypeId()) << 24 | quint64(item->index());
+    quint64 key = priceGuideKey(item, color);
     PriceGuide *pg = m_pg_cache [key];
 
     bool needToLoad = false;
@@ -1112,6 +1210,60 @@ PriceGuide *Core::priceGuide(const Item *item, const Color *color, bool highPrio
 }
 
 
+QVector<PriceGuide *> Core::priceGuides(const QVector<QPair<const Item *, const Color *>> &itemsAndColors)
+{
+    QVector<PriceGuide *> result;
+    result.reserve(itemsAndColors.size());
+    QVector<PriceGuide *> toLoad;
+
+    for (const auto &[item, color] : itemsAndColors) {
+        PriceGuide *pg = nullptr;
+
+        if (item && color) {
+            quint64 key = priceGuideKey(item, color);
+            pg = m_pg_cache [key];
+
+            if (!pg) {
+                pg = new PriceGuide(item, color);
+                if (!m_pg_cache.insert(key, pg)) {
+                    qWarning("Can not add priceguide to cache (cache max/cur: %d/%d, cost: %d)",
+                             int(m_pg_cache.maxCost()), int(m_pg_cache.totalCost()), 1);
+                    pg = nullptr;
+                } else {
+                    pg->addRef();
+                    toLoad.append(pg);
+                }
+            }
+            // inserting the next guides could otherwise trim this one from the cache
+            if (pg)
+                pg->addRef();
+        }
+        result.append(pg);
+    }
+
+    for (int i = 0; i < toLoad.size(); i += PriceGuideLoadBatchSize)
+        m_diskloadPool.start(new PriceGuideBatchLoaderJob(toLoad.mid(i, PriceGuideLoadBatchSize)));
+
+    return result;
+}
+
+void Core::priceGuideBatchLoaded(const QVector<PriceGuide *> &pgs)
+{
+    for (PriceGuide *pg : pgs) {
+        if (pg->m_updateAfterLoad
+                || updateNeeded(pg->isValid(), pg->lastUpdated(), m_pg_update_iv))  {
+            pg->m_updateAfterLoad = false;
+            updatePriceGuide(pg, false);
+        }
+    }
+    emit priceGuidesLoaded(pgs);
+
+    for (PriceGuide *pg : pgs) {
+        emit priceGuideUpdated(pg);
+        pg->release();
+    }
+}
+
 void Core::priceGuideLoaded(PriceGuide *pg)
 {
     if (pg) {
@@ -1125,9 +1277,14 @@ void Core::priceGuideLoaded(PriceGuide *pg)
      }
 }
 
+PriceGuideStore *Core::priceGuideStore() const
+{
+    return m_pg_store;
+}
+
 void Core::updatePriceGuide(PriceGuide *pg, bool highPriority)
 {
-    if (!pg || (pg->m_update_status == UpdateStatus::Updating))
+    if (!pg || !pg->item() || (pg->m_update_status == UpdateStatus::Updating))
         return;
 
     if (!m_online || !m_transfer) {
@@ -1171,6 +1328,7 @@ void Core::updatePriceGuide(PriceGuide *pg, bool highPriority)
 
     //qDebug ( "PG request started for %s", (const char *) url );
     pg->m_transferJob = TransferJob::get(url, nullptr, 2);
+    pg->m_transferJob->setJobClass(TransferJob::PriceGuide);
     pg->m_transferJob->setUserData("priceGuide", QVariant::fromValue(pg));
 
     m_transfer->retrieve(pg->m_transferJob, highPriority);
@@ -1214,9 +1372,15 @@ public:
     explicit PictureLoaderJob(Picture *pic)
         : QRunnable()
         , m_pic(pic)
+        , m_generation(core()->database()->generation())
     {
         pic->m_update_status = UpdateStatus::Loading;
     }
+    ~PictureLoaderJob() override
+    {
+        if (m_pic) // never run, because the pool was cleared
+            m_pic->release();
+    }
 
     void run() override;
 
@@ -1229,6 +1393,7 @@ private:
     Q_DISABLE_COPY(PictureLoaderJob)
 
     Picture *m_pic;
+    uint m_generation;
 };
 
 void PictureLoaderJob::run()
@@ -1238,7 +1403,15 @@ void PictureLoaderJob::run()
         QImage image;
         bool valid = m_pic->loadFromDisk(fetched, image);
         auto pic = m_pic;
+        auto generation = m_generation;
+        m_pic = nullptr; // the reference is released by core()
+
         QMetaObject::invokeMethod(core(), [=]() {
+            if (generation != core()->database()->generation()) {
+                // endResetCaches() has already started a new load
+                pic->release();
+                return;
+            }
             pic->m_valid = valid;
             pic->m_update_status = UpdateStatus::Ok;
             if (valid) {
@@ -1251,6 +1424,90 @@ void PictureLoaderJob::run()
 }
 
 
+template <typename T>
+void Core::takeReferenced(Q3Cache<quint64, T> &cache, std::vector<ResetSurvivor> &survivors)
+{
+    const auto keys = cache.keys();
+    for (const auto &key : keys) {
+        T *t = cache.object(key);
+        if (!t || !t->refCount())
+            continue;
+        // the id is a view into the old database's string pool: copy it
+        const auto id = t->item()->idView();
+        survivors.push_back({ t, t->item()->itemTypeId(), QByteArray(id.data(), id.size()),
+                              t->color() ? t->color()->id() : uint(-1) });
+        cache.take(key);
+    }
+    cache.clear(); // only unreferenced objects are left
+}
+
+template <typename T>
+void Core::restoreReferenced(Q3Cache<quint64, T> &cache, std::vector<ResetSurvivor> &survivors)
+{
+    for (const auto &s : survivors) {
+        T *t = static_cast<T *>(s.object);
+        const Item *item = this->item(s.itemTypeId, s.itemId);
+        const Color *color = (s.colorId != uint(-1)) ? this->color(s.colorId) : nullptr;
+
+        t->m_item = item;
+        t->m_color = color;
+
+        if (item && ((s.colorId == uint(-1)) || color)) {
+            int cost = 1;
+            quint64 key;
+            if constexpr (std::is_same_v<T, Picture>) {
+                cost = t->cost();
+                key = Picture::key(item, color);
+            } else {
+                key = priceGuideKey(item, color);
+            }
+
+            // insert() would delete an object that is too expensive
+            if ((cost <= cache.maxCost()) && cache.insert(key, t, cost)) {
+                if (t->m_update_status == UpdateStatus::Loading) {
+                    // the load job was dropped or its result will be ignored (see the loader jobs)
+                    t->addRef();
+                    if constexpr (std::is_same_v<T, Picture>)
+                        m_diskloadPool.start(new PictureLoaderJob(t));
+                    else
+                        m_diskloadPool.start(new PriceGuideLoaderJob(t));
+                }
+                continue;
+            }
+        }
+        t->m_item = nullptr;
+        t->m_color = nullptr;
+        t->m_update_status = UpdateStatus::UpdateFailed;
+        m_orphans.append(t);
+    }
+    survivors.clear();
+}
+
+void Core::beginResetCaches()
+{
+    m_transfer->abortAllJobs();
+    m_diskloadPool.clear();
+    m_diskloadPool.waitForDone();
+
+    // objects that are still in use by a widget or a pending job have to stay alive: they are
+    // re-keyed against the new database in endResetCaches()
+    takeReferenced(m_pg_cache, m_resetPriceGuides);
+    takeReferenced(m_pic_cache, m_resetPictures);
+
+    m_orphans.erase(std::remove_if(m_orphans.begin(), m_orphans.end(), [](Ref *r) {
+        if (r->refCount())
+            return false;
+        delete r;
+        return true;
+    }), m_orphans.end());
+}
+
+void Core::endResetCaches()
+{
+    restoreReferenced(m_pg_cache, m_resetPriceGuides);
+    restoreReferenced(m_pic_cache, m_resetPictures);
+}
+
 QSize Core::standardPictureSize() const
 {
     QSize s(80, 60);
@@ -1274,7 +1531,8 @@ Picture *Core::picture(const Item *item, const Color *color, bool highPriority)
         pic = new Picture(item, color);
         if (!m_pic_cache.insert(key, pic, pic->cost())) {
             qWarning("Can not add picture to cache (cache max/cur: %d/%d, item: %s)",
-                     int(m_pic_cache.maxCost()), int(m_pic_cache.totalCost()), item->id().constData());
+                     int(m_pic_cache.maxCost()), int(m_pic_cache.totalCost()),
+                     qPrintable(QString::fromLatin1(item->id())));
             return nullptr;
         }
         needToLoad = true;
@@ -1334,7 +1592,7 @@ QPair<int, int> Core::priceGuideCacheStats() const
 
 void Core::updatePicture(Picture *pic, bool highPriority)
 {
-    if (!pic || (pic->m_update_status == UpdateStatus::Updating))
+    if (!pic || !pic->item() || (pic->m_update_status == UpdateStatus::Updating))
         return;
 
     if (!m_online || !m_transfer) {
@@ -1368,6 +1626,7 @@ void Core::updatePicture(Picture *pic, bool highPriority)
     //qDebug() << "PIC request started for" << url;
     QSaveFile *f = pic->saveFile();
     pic->m_transferJob = TransferJob::get(url, f);
+    pic->m_transferJob->setJobClass(TransferJob::Picture);
     pic->m_transferJob->setUserData("picture", QVariant::fromValue(pic));
     m_transfer->retrieve(pic->m_transferJob, highPriority);
 }
@@ -1407,6 +1666,7 @@ void Core::pictureJobFinished(TransferJob *j, Picture *pic)
 
             QSaveFile *f = pic->saveFile();
             TransferJob *job = TransferJob::get(url, f);
+            job->setJobClass(TransferJob::Picture);
             job->setUserData("picture", QVariant::fromValue<Picture *>(pic));
             m_transfer->retrieve(job);
             pic->m_transferJob = job;
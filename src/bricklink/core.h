@@ -35,10 +35,12 @@ QT_FORWARD_DECLARE_CLASS(QSaveFile)
 
 class Transfer;
 class TransferJob;
+class Ref;
 
 namespace BrickLink {
 
 class Incomplete;
+class PriceGuideStore;
 
 
 class Core : public QObject
@@ -55,6 +57,10 @@ public:
                         const Color *color = nullptr) const;
     QSaveFile *dataSaveFile(QStringView fileName, const Item *item,
                             const Color *color = nullptr) const;
+    QFile *dataReadFile(QStringView fileName, char itemTypeId, const QByteArray &itemId,
+                        const Color *color = nullptr) const;
+    QSaveFile *dataSaveFile(QStringView fileName, char itemTypeId, const QByteArray &itemId,
+                            const Color *color = nullptr) const;
     void setCredentials(const QPair<QString, QString> &credentials);
     QString userId() const;
 
@@ -69,7 +75,7 @@ public:
     inline const std::vector<Color> &colors() const         { return database()->m_colors; }
     inline const std::vector<Category> &categories() const  { return database()->m_categories; }
     inline const std::vector<ItemType> &itemTypes() const   { return database()->m_itemTypes; }
-    inline const std::vector<Item> &items() const           { return database()->m_items; }
+    inline std::span<const Item> items() const              { return database()->m_items.span(); }
     inline const std::vector<PartColorCode> &pccs() const   { return database()->m_pccs; }
     inline const std::vector<ItemChangeLogEntry>  &itemChangelog() const  { return database()->m_itemChangelog; }
     inline const std::vector<ColorChangeLogEntry> &colorChangelog() const { return database()->m_colorChangelog; }
@@ -89,6 +95,10 @@ public:
     const PartColorCode *partColorCode(uint id);
 
     PriceGuide *priceGuide(const Item *item, const Color *color, bool highPriority = false);
+    // bulk version of priceGuide(): the result has one entry per (item, color) pair, but each
+    // price guide is only loaded once and the disk loads are done in large batches.
+    // Every non-null entry is referenced, so the caller has to release() each one of them.
+    QVector<PriceGuide *> priceGuides(const QVector<QPair<const Item *, const Color *>> &itemsAndColors);
 
     QSize standardPictureSize() const;
     Picture *picture(const Item *item, const Color *color, bool highPriority = false);
@@ -120,10 +130,12 @@ public slots:
 
 signals:
     void priceGuideUpdated(BrickLink::PriceGuide *pg);
+    void priceGuidesLoaded(const QVector<BrickLink::PriceGuide *> &pgs); // one batch of priceGuides()
     void pictureUpdated(BrickLink::Picture *pic);
     void itemImageScaleFactorChanged(qreal f);
 
     void transferProgress(int progress, int total);
+    void transferStatisticsChanged(int queued, int inFlight, int retried, int throttled);
     void authenticatedTransferOverallProgress(int progress, int total);
     void authenticatedTransferStarted(TransferJob *job);
     void authenticatedTransferProgress(TransferJob *job, int progress, int total);
@@ -148,8 +160,10 @@ private:
     friend Core *create(const QString &, QString *);
 
 private:
-    QString dataFileName(QStringView fileName, const Item *item, const Color *color) const;
+    QString dataFileName(QStringView fileName, char itemTypeId, const QByteArray &itemId,
+                         const Color *color) const;
 
+    PriceGuideStore *priceGuideStore() const;
     void updatePriceGuide(BrickLink::PriceGuide *pg, bool highPriority = false);
     void updatePicture(BrickLink::Picture *pic, bool highPriority = false);
 //    friend void PriceGuide::update(bool);
@@ -163,15 +177,33 @@ private:
 //    friend void Picture::cancelUpdate();
 
     static bool updateNeeded(bool valid, const QDateTime &last, int iv);
+    static quint64 priceGuideKey(const Item *item, const Color *color);
+    static constexpr int PriceGuideLoadBatchSize = 500;
+
+    // cached objects that are still referenced, while a new database is installed
+    struct ResetSurvivor {
+        Ref *object;
+        char itemTypeId;
+        QByteArray itemId;
+        uint colorId;           // uint(-1) for no color
+    };
+    template <typename T> static void takeReferenced(Q3Cache<quint64, T> &cache,
+                                                     std::vector<ResetSurvivor> &survivors);
+    template <typename T> void restoreReferenced(Q3Cache<quint64, T> &cache,
+                                                 std::vector<ResetSurvivor> &survivors);
+    void beginResetCaches();
+    void endResetCaches();
 
 private slots:
     void pictureJobFinished(TransferJob *j, BrickLink::Picture *pic);
     void priceGuideJobFinished(TransferJob *j, BrickLink::PriceGuide *pg);
 
     void priceGuideLoaded(BrickLink::PriceGuide *pg);
+    void priceGuideBatchLoaded(const QVector<BrickLink::PriceGuide *> &pgs);
     void pictureLoaded(BrickLink::Picture *pic);
 
     friend class PriceGuideLoaderJob;
+    friend class PriceGuideBatchLoaderJob;
     friend class PictureLoaderJob;
 
 public: // semi-public for the QML wrapper
@@ -197,11 +229,16 @@ private:
 
     int                          m_pg_update_iv = 0;
     Q3Cache<quint64, PriceGuide> m_pg_cache;
+    PriceGuideStore *            m_pg_store = nullptr;
 
     int                          m_pic_update_iv = 0;
     QThreadPool                  m_diskloadPool;
     Q3Cache<quint64, Picture>    m_pic_cache;
 
+    std::vector<ResetSurvivor>   m_resetPriceGuides;
+    std::vector<ResetSurvivor>   m_resetPictures;
+    QVector<Ref *>               m_orphans; // referenced, but their item is gone from the database
+
     qreal m_item_image_scale_factor = 1.;
 
     QString m_ldraw_datadir;
@@ -13,6 +13,10 @@
 */
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <algorithm>
+#include <iterator>
 
 #include <QFile>
 #include <QBuffer>
@@ -22,6 +26,7 @@
 #include <QDebug>
 #include <QStringBuilder>
 #include <QScopeGuard>
+#include <QtConcurrent>
 
 #if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
 #  include <qhashfunctions.h>
@@ -46,6 +51,65 @@
 namespace BrickLink {
 
 
+// The 'CDIR' chunk lists the position and size of all the other chunks, so that they can be
+// decoded in parallel. It is always the last chunk in the root chunk, which means that we can
+// find it by looking at the chunk trailers at the very end of the file.
+struct ChunkDirectoryEntry
+{
+    quint32 id;
+    quint32 version;
+    qint64 offset; // start of the chunk data, not the chunk header
+    qint64 size;
+    QString error; // only used while decoding
+};
+
+static QVector<ChunkDirectoryEntry> readChunkDirectory(const char *data, qint64 fileSize)
+{
+    // the chunk trailer is: 64 SIZE, 32 VERSION, 32 ID
+    auto readTrailer = [data, fileSize](qint64 pos, quint32 id) -> qint64 {
+        if ((pos < 0) || ((pos + 16) > fileSize))
+            return -1;
+        QDataStream ds(QByteArray::fromRawData(data + pos, 16));
+        ds.setByteOrder(QDataStream::LittleEndian);
+        qint64 size = -1;
+        quint32 version = 0, trailerId = 0;
+        ds >> size >> version >> trailerId;
+        return (trailerId == id) ? size : -1;
+    };
+
+    if (readTrailer(fileSize - 16, ChunkId('B','S','D','B')) < 0)
+        return { };
+    const qint64 size = readTrailer(fileSize - 32, ChunkId('C','D','I','R'));
+    if (size < qint64(sizeof(quint32)))
+        return { };
+    const qint64 offset = fileSize - 32 - ((size + 15) & ~15);
+    if (offset < 32)
+        return { };
+
+    QDataStream ds(QByteArray::fromRawData(data + offset, int(size)));
+    ds.setVersion(QDataStream::Qt_5_11);
+    ds.setByteOrder(QDataStream::LittleEndian);
+
+    quint32 count = 0;
+    ds >> count;
+    if (count > 1000)
+        return { };
+
+    QVector<ChunkDirectoryEntry> chunkDirectory;
+    chunkDirectory.reserve(int(count));
+    while (count-- > 0) {
+        ChunkDirectoryEntry cde;
+        ds >> cde.id >> cde.version >> cde.offset >> cde.size;
+        if ((ds.status() != QDataStream::Ok) || (cde.offset < 32) || (cde.size < 0)
+                || ((cde.offset + cde.size) > offset)) {
+            return { }; // corrupt: fall back to walking the chunk headers
+        }
+        chunkDirectory.append(cde);
+    }
+    return chunkDirectory;
+}
+
+
 Database::Database(QObject *parent)
     : QObject(parent)
     , m_transfer(new Transfer(this))
@@ -53,6 +117,12 @@ Database::Database(QObject *parent)
 
 }
 
+Database::~Database()
+{
+    // the worker thread is still reading from our item arrays
+    finishItemTextIndex();
+}
+
 bool Database::isUpdateNeeded() const
 {
     return (m_updateInterval > 0)
@@ -94,13 +164,298 @@ void Database::updateFailed()
 
 void Database::clear()
 {
+    finishItemTextIndex();
+
     m_colors.clear();
     m_itemTypes.clear();
     m_categories.clear();
-    m_items.clear();
     m_pccs.clear();
     m_itemChangelog.clear();
     m_colorChangelog.clear();
+    m_items = { };
+    m_itemIds = { };
+    m_itemNames = { };
+    m_appearsIn = { };
+    m_consistsOf = { };
+    m_knownColors = { };
+    m_mappedFile.reset();
+    m_itemIndex = { };
+    m_colorNameIndex.clear();
+    m_colorLDrawIndex.clear();
+    m_itemTextIndex.reset();
+}
+
+QByteArray Database::itemId(const Item *item) const
+{
+    return QByteArray::fromRawData(m_itemIds.span().data() + item->m_idOffset, item->m_idSize);
+}
+
+QString Database::itemName(const Item *item) const
+{
+    return QString::fromRawData(reinterpret_cast<const QChar *>(m_itemNames.span().data()
+                                                                + item->m_nameOffset), item->m_nameSize);
+}
+
+static inline quint32 itemIndexHash(char itemTypeId, const char *id, qsizetype idSize)
+{
+    // FNV-1a: the index is stored in the database file, so the hash has to be the same on all
+    // platforms and Qt versions (qHashBits() is neither)
+    quint32 h = (2166136261U ^ uchar(itemTypeId)) * 16777619U;
+    for (qsizetype i = 0; i < idSize; ++i)
+        h = (h ^ uchar(id[i])) * 16777619U;
+    return h;
+}
+
+const Item *Database::findItem(char itemTypeId, const char *id, qsizetype idSize) const
+{
+    const auto itemIndex = m_itemIndex.span();
+    if (itemIndex.empty())
+        return nullptr;
+
+    const auto items = m_items.span();
+    const char *ids = m_itemIds.span().data();
+    const quint32 mask = quint32(itemIndex.size() - 1);
+
+    for (quint32 slot = itemIndexHash(itemTypeId, id, idSize) & mask; ; slot = (slot + 1) & mask) {
+        const quint32 index = itemIndex[slot];
+        if (!index)
+            return nullptr;
+
+        const Item &item = items[index - 1];
+        if ((item.m_itemTypeId == itemTypeId) && (item.m_idSize == idSize)
+                && (std::memcmp(ids + item.m_idOffset, id, size_t(idSize)) == 0)) {
+            return &item;
+        }
+    }
+}
+
+std::vector<quint32> Database::buildItemIndex(std::span<const Item> items, std::span<const char> ids)
+{
+    // keep the load factor at or below 50% to get short probe sequences
+    size_t size = 16;
+    while (size < items.size() * 2)
+        size *= 2;
+
+    std::vector<quint32> index(size, 0);
+    const quint32 mask = quint32(size - 1);
+
+    for (size_t i = 0; i < items.size(); ++i) {
+        const Item &item = items[i];
+        quint32 slot = itemIndexHash(item.m_itemTypeId, ids.data() + item.m_idOffset, item.m_idSize) & mask;
+        while (index[slot])
+            slot = (slot + 1) & mask;
+        index[slot] = quint32(i + 1);
+    }
+    return index;
+}
+
+bool Database::isValidItemIndex(std::span<const quint32> index, size_t itemCount)
+{
+    // findItem() relies on a power of 2 size and on at least one empty slot to stop probing
+    if ((index.size() <= itemCount) || (index.size() & (index.size() - 1)))
+        return false;
+    return std::all_of(index.begin(), index.end(), [itemCount](quint32 i) { return i <= itemCount; });
+}
+
+const ItemTextIndex *Database::itemTextIndex() const
+{
+    return m_itemTextIndex.get();
+}
+
+void Database::buildItemTextIndex()
+{
+    // Case-folding all ids and names and sorting all the word suffixes takes a while, so this
+    // is done in the background: the item browser just scans all items until the index is
+    // ready. The arrays stay valid until finishItemTextIndex() is called, because everything
+    // that replaces them calls it first.
+    finishItemTextIndex();
+    m_itemTextIndex.reset();
+
+    const auto items = m_items.span();
+    const auto ids = m_itemIds.span();
+    const auto names = m_itemNames.span();
+    if (items.empty())
+        return;
+
+    m_itemTextIndexPending = true;
+    m_itemTextIndexFuture = QtConcurrent::run([items, ids, names]() {
+        return new ItemTextIndex(items, ids, names);
+    });
+
+    auto watcher = new QFutureWatcher<ItemTextIndex *>(this);
+    connect(watcher, &QFutureWatcherBase::finished,
+            this, [this, watcher, generation = m_generation]() {
+        watcher->deleteLater();
+        if (generation == m_generation)
+            finishItemTextIndex();
+    });
+    watcher->setFuture(m_itemTextIndexFuture);
+}
+
+void Database::finishItemTextIndex()
+{
+    if (!m_itemTextIndexPending)
+        return;
+    m_itemTextIndexPending = false;
+
+    try {
+        m_itemTextIndex.reset(m_itemTextIndexFuture.result()); // blocks, if still running
+    } catch (...) {
+        // e.g. out of memory: searching still works without the index, only slower
+        qWarning() << "Could not build the item text index";
+    }
+    m_itemTextIndexFuture = { };
+}
+
+ItemTextIndex::ItemTextIndex(std::span<const Item> items, std::span<const char> ids,
+                             std::span<const char16_t> names)
+{
+    QHash<QString, quint32> wordIndex;
+    std::vector<std::vector<quint32>> wordItems;
+    QString word;
+
+    auto addWord = [&](quint32 itemIndex) {
+        if (word.isEmpty())
+            return;
+        auto it = wordIndex.constFind(word);
+        if (it == wordIndex.cend()) {
+            it = wordIndex.insert(word, quint32(wordItems.size()));
+            wordItems.emplace_back();
+        }
+        auto &postings = wordItems[it.value()];
+        if (postings.empty() || (postings.back() != itemIndex))
+            postings.push_back(itemIndex);
+        word.clear();
+    };
+    auto addChar = [&](quint32 itemIndex, QChar c) {
+        if (c.isLetterOrNumber())
+            word.append(c.toCaseFolded());
+        else
+            addWord(itemIndex);
+    };
+
+    for (quint32 i = 0; i < quint32(items.size()); ++i) {
+        const Item &item = items[i];
+        for (const char c : ids.subspan(item.m_idOffset, item.m_idSize))
+            addChar(i, QLatin1Char(c));
+        addWord(i);
+        for (const char16_t c : names.subspan(item.m_nameOffset, item.m_nameSize))
+            addChar(i, QChar(c));
+        addWord(i);
+    }
+
+    // flatten everything into a few arrays, so that the lookups are cache friendly
+    m_wordOffsets.resize(wordItems.size() + 1);
+    m_postingOffsets.resize(wordItems.size() + 1);
+    for (auto it = wordIndex.cbegin(); it != wordIndex.cend(); ++it) {
+        m_wordOffsets[it.value() + 1] = quint32(it.key().size());
+        m_postingOffsets[it.value() + 1] = quint32(wordItems[it.value()].size());
+    }
+    std::partial_sum(m_wordOffsets.begin(), m_wordOffsets.end(), m_wordOffsets.begin());
+    std::partial_sum(m_postingOffsets.begin(), m_postingOffsets.end(), m_postingOffsets.begin());
+
+    m_wordChars.resize(m_wordOffsets.back());
+    m_postings.resize(m_postingOffsets.back());
+    for (auto it = wordIndex.cbegin(); it != wordIndex.cend(); ++it) {
+        std::copy(it.key().utf16(), it.key().utf16() + it.key().size(),
+                  m_wordChars.begin() + m_wordOffsets[it.value()]);
+        const auto &postings = wordItems[it.value()];
+        std::copy(postings.cbegin(), postings.cend(), m_postings.begin() + m_postingOffsets[it.value()]);
+    }
+
+    m_suffixes.reserve(m_wordChars.size());
+    for (quint32 w = 0; w < quint32(wordItems.size()); ++w) {
+        for (quint32 o = m_wordOffsets[w]; o < m_wordOffsets[w + 1]; ++o)
+            m_suffixes.push_back({ w, o });
+    }
+    std::sort(m_suffixes.begin(), m_suffixes.end(), [this](const Suffix &s1, const Suffix &s2) {
+        return suffixView(s1) < suffixView(s2);
+    });
+}
+
+QStringView ItemTextIndex::suffixView(const Suffix &s) const
+{
+    return QStringView(m_wordChars.data() + s.offset, m_wordChars.data() + m_wordOffsets[s.word + 1]);
+}
+
+bool ItemTextIndex::candidates(QStringView term, std::vector<quint32> &result) const
+{
+    // If the term matches, every run of letters and numbers in it has to be part of a single
+    // word of the item. Runs of just one character would match nearly everything.
+    QVector<QString> runs;
+    QString run;
+    for (const QChar c : term) {
+        if (c.isLetterOrNumber()) {
+            run.append(c.toCaseFolded());
+        } else {
+            if (run.size() > 1)
+                runs << run;
+            run.clear();
+        }
+    }
+    if (run.size() > 1)
+        runs << run;
+    if (runs.isEmpty())
+        return false;
+
+    std::vector<quint32> words;
+    std::vector<quint32> runResult;
+    std::vector<quint32> intersection;
+
+    for (int r = 0; r < runs.size(); ++r) {
+        const QStringView rv = runs.at(r);
+
+        // every word containing the run has a suffix starting with it: these suffixes form a
+        // consecutive range in the sorted suffix array
+        auto it = std::lower_bound(m_suffixes.cbegin(), m_suffixes.cend(), rv,
+                                   [this](const Suffix &s, QStringView v) { return suffixView(s) < v; });
+        words.clear();
+        for (; (it != m_suffixes.cend()) && suffixView(*it).startsWith(rv); ++it)
+            words.push_back(it->word);
+        std::sort(words.begin(), words.end());
+        words.erase(std::unique(words.begin(), words.end()), words.end());
+
+        runResult.clear();
+        for (const quint32 w : words) {
+            runResult.insert(runResult.end(), m_postings.cbegin() + m_postingOffsets[w],
+                             m_postings.cbegin() + m_postingOffsets[w + 1]);
+        }
+        if (words.size() > 1) {
+            std::sort(runResult.begin(), runResult.end());
+            runResult.erase(std::unique(runResult.begin(), runResult.end()), runResult.end());
+        }
+
+        if (r == 0) {
+            result.swap(runResult);
+        } else {
+            intersection.clear();
+            std::set_intersection(result.cbegin(), result.cend(), runResult.cbegin(), runResult.cend(),
+                                  std::back_inserter(intersection));
+            result.swap(intersection);
+        }
+        if (result.empty())
+            break;
+    }
+    return true;
+}
+
+void Database::buildColorIndexes(const std::vector<Color> &colors, QHash<QString, quint16> &nameIndex,
+                                 QHash<int, quint16> &ldrawIndex)
+{
+    nameIndex.clear();
+    ldrawIndex.clear();
+    nameIndex.reserve(int(colors.size()));
+    ldrawIndex.reserve(int(colors.size()));
+
+    // the first color wins on duplicates, just like a linear search would
+    for (size_t i = 0; i < colors.size(); ++i) {
+        const QString name = colors[i].name().toCaseFolded();
+        if (!nameIndex.contains(name))
+            nameIndex.insert(name, quint16(i));
+        const int ldrawId = colors[i].ldrawId();
+        if (!ldrawIndex.contains(ldrawId))
+            ldrawIndex.insert(ldrawId, quint16(i));
+    }
 }
 
 bool Database::startUpdate()
@@ -117,8 +472,13 @@ bool Database::startUpdate(bool force)
     QString remotefile = BRICKSTORE_DATABASE_URL ""_l1 % dbName % u".lzma";
     QString localfile = core()->dataPath() % dbName;
 
+    // the current database file is memory mapped and cannot be replaced on all platforms:
+    // alternate between two file names instead (see read())
+    if (m_mappedFile && (m_mappedFile->fileName() == localfile))
+        localfile = localfile % u".new";
+
     QDateTime dt;
-    if (!force && QFile::exists(localfile))
+    if (!force && m_mappedFile)
         dt = m_lastUpdated.addSecs(60 * 5);
 
     auto file = new QSaveFile(localfile);
@@ -171,10 +531,36 @@ bool Database::startUpdate(bool force)
             } else if (!file->commit()) {
                 throw Exception(tr("Could not save the database") % u": " % file->errorString());
             } else {
-                read(file->fileName());
-
-                emit updateFinished(true, { });
-                setUpdateStatus(UpdateStatus::Ok);
+                // decode the new database on a worker thread, so that the GUI stays responsive:
+                // the current data stays in use until the finished snapshot is installed
+                const QString fn = file->fileName();
+                auto watcher = new QFutureWatcher<std::shared_ptr<Snapshot>>(this);
+                connect(watcher, &QFutureWatcherBase::finished,
+                        this, [this, watcher, fn]() {
+                    watcher->deleteLater();
+
+                    auto failed = [this, fn](const QString &error) {
+                        // don't let read() pick up the broken file on the next start
+                        if (!m_mappedFile || (m_mappedFile->fileName() != fn))
+                            QFile::remove(fn);
+                        emit updateFinished(false, tr("Could not load the new database:") % u"\n\n" % error);
+                        setUpdateStatus(UpdateStatus::UpdateFailed);
+                    };
+
+                    try {
+                        installSnapshot(watcher->result()); // re-throws the exception from the worker
+                        emit updateFinished(true, { });
+                        setUpdateStatus(UpdateStatus::Ok);
+                    } catch (const Exception &e) {
+                        failed(e.error());
+                    } catch (const std::exception &e) {
+                        // e.g. a std::bad_alloc while decoding, wrapped in a QUnhandledException
+                        failed(QString::fromLocal8Bit(e.what()));
+                    } catch (...) {
+                        failed(tr("Unknown error"));
+                    }
+                });
+                watcher->setFuture(QtConcurrent::run([fn]() { return loadSnapshot(fn); }));
             }
         } catch (const Exception &e) {
             emit updateFinished(false, tr("Could not load the new database:") % u"\n\n" % e.error());
@@ -190,61 +576,186 @@ void Database::cancelUpdate()
         m_transfer->abortAllJobs();
 }
 
+struct Database::Snapshot
+{
+    QString                          fileName;
+    QDateTime                        generationDate;
+    std::vector<Color>               colors;
+    std::vector<Category>            categories;
+    std::vector<ItemType>            itemTypes;
+    std::vector<ItemChangeLogEntry>  itemChangelog;
+    std::vector<ColorChangeLogEntry> colorChangelog;
+    std::vector<PartColorCode>       pccs;
+    DatabaseArray<Item>                  items;
+    DatabaseArray<char>                  itemIds;
+    DatabaseArray<char16_t>              itemNames;
+    DatabaseArray<Item::AppearsInRecord> appearsIn;
+    DatabaseArray<Item::ConsistsOf>      consistsOf;
+    DatabaseArray<quint16>               knownColors;
+    std::unique_ptr<QFile>               mappedFile;
+    DatabaseArray<quint32>               itemIndex;
+    QHash<QString, quint16>              colorNameIndex;
+    QHash<int, quint16>                  colorLDrawIndex;
+};
+
 void Database::read(const QString &fileName)
 {
     try {
-        stopwatch *sw = nullptr; //new stopwatch("Database::read()");
+        QString fn = !fileName.isEmpty() ? fileName : core()->dataPath() + Database::defaultDatabaseName();
+
+        if (fileName.isEmpty() && QFile::exists(fn % u".new")) {
+            // an update was downloaded while the old database was still memory mapped: only
+            // switch over to it, if it can actually be loaded
+            std::shared_ptr<Snapshot> snapshot;
+            try {
+                snapshot = loadSnapshot(fn % u".new");
+            } catch (const Exception &e) {
+                qWarning() << "Could not load the updated database, keeping the old one:" << e.error();
+                QFile::remove(fn % u".new");
+            }
+            if (snapshot) {
+                // the .new file stays mapped, so we cannot rename it: startUpdate() alternates
+                // between the two names anyway
+                installSnapshot(std::move(snapshot));
+                QFile::remove(fn);
+                return;
+            }
+        }
 
-        QFile f(!fileName.isEmpty() ? fileName : core()->dataPath() + Database::defaultDatabaseName());
+        installSnapshot(loadSnapshot(fn));
 
-        if (!f.open(QFile::ReadOnly))
-            throw Exception(&f, "could not open database for reading");
+    } catch (const Exception &) {
+        if (m_valid) {
+            m_valid = false;
+            emit validChanged(m_valid);
+        }
+        throw;
+    }
+}
 
-        const char *data = reinterpret_cast<char *>(f.map(0, f.size()));
+std::shared_ptr<Database::Snapshot> Database::loadSnapshot(const QString &fn)
+{
+    // This function must not touch any member variables: it is run on a worker thread when
+    // updating the database, while the GUI is still using the currently installed data.
 
-        if (!data)
-            throw Exception("could not memory map the database (%1)").arg(f.fileName());
+    stopwatch *sw = nullptr; //new stopwatch("Database::loadSnapshot()");
 
-        QByteArray ba = QByteArray::fromRawData(data, int(f.size()));
-        QBuffer buf(&ba);
-        buf.open(QIODevice::ReadOnly);
-        ChunkReader cr(&buf, QDataStream::LittleEndian);
-        QDataStream &ds = cr.dataStream();
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->fileName = fn;
 
-        if (!cr.startChunk() || cr.chunkId() != ChunkId('B','S','D','B'))
-            throw Exception("invalid database format - wrong magic (%1)").arg(f.fileName());
+    auto f = std::make_unique<QFile>(fn);
 
-        if (cr.chunkVersion() != int(Version::Latest)) {
-            throw Exception("invalid database version: expected %1, but got %2")
-                .arg(int(Version::Latest)).arg(cr.chunkVersion());
-        }
+    if (!f->open(QFile::ReadOnly))
+        throw Exception(f.get(), "could not open database for reading");
 
-        bool gotColors = false, gotCategories = false, gotItemTypes = false, gotItems = false;
-        bool gotItemChangeLog = false, gotColorChangeLog = false, gotPccs = false;
+    // the items are used directly from the memory mapped file, so the mapping has to
+    // stay alive for as long as this database is installed
+    const char *data = reinterpret_cast<char *>(f->map(0, f->size()));
 
-        auto check = [&ds, &f]() {
-            if (ds.status() != QDataStream::Ok)
-                throw Exception("failed to read from database (%1) at position %2")
-                    .arg(f.fileName()).arg(f.pos());
-        };
+    if (!data)
+        throw Exception("could not memory map the database (%1)").arg(f->fileName());
 
-        auto sizeCheck = [&f](int s, int max) {
-            if (s > max)
-                throw Exception("failed to read from database (%1) at position %2: size value %L3 is larger than expected maximum %L4")
-                    .arg(f.fileName()).arg(f.pos()).arg(s).arg(max);
-        };
+    if (QSysInfo::ByteOrder != QSysInfo::LittleEndian)
+        throw Exception("memory mapped databases are only supported on little-endian systems");
 
-        QDateTime                        generationDate;
-        std::vector<Color>               colors;
-        std::vector<Category>            categories;
-        std::vector<ItemType>            itemTypes;
-        std::vector<Item>                items;
-        std::vector<ItemChangeLogEntry>  itemChangelog;
-        std::vector<ColorChangeLogEntry> colorChangelog;
-        std::vector<PartColorCode>       pccs;
+    const qint64 fileSize = f->size();
 
+    QByteArray ba = QByteArray::fromRawData(data, int(fileSize));
+    QBuffer buf(&ba);
+    buf.open(QIODevice::ReadOnly);
+    ChunkReader cr(&buf, QDataStream::LittleEndian);
+
+    if (!cr.startChunk() || cr.chunkId() != ChunkId('B','S','D','B'))
+        throw Exception("invalid database format - wrong magic (%1)").arg(fn);
+
+    if (cr.chunkVersion() != int(Version::Latest)) {
+        throw Exception("invalid database version: expected %1, but got %2")
+            .arg(int(Version::Latest)).arg(cr.chunkVersion());
+    }
+
+    auto chunkDirectory = readChunkDirectory(data, fileSize);
+
+    if (chunkDirectory.isEmpty()) {
+        // no directory: walk the chunk headers instead, skipping over the data
         while (cr.startChunk()) {
-            switch (cr.chunkId() | quint64(cr.chunkVersion()) << 32) {
+            chunkDirectory.append({ cr.chunkId(), cr.chunkVersion(), buf.pos(), cr.chunkSize(), { } });
+            if (!cr.skipChunk() || !cr.endChunk()) {
+                throw Exception("missed the end of a chunk when reading from database (%1) at position %2")
+                    .arg(fn).arg(buf.pos());
+            }
+        }
+        if (!cr.endChunk()) {
+            throw Exception("missed the end of the root chunk when reading from database (%1) at position %2")
+                .arg(fn).arg(buf.pos());
+        }
+    }
+
+    bool gotColors = false, gotCategories = false, gotItemTypes = false, gotItems = false;
+    bool gotItemChangeLog = false, gotColorChangeLog = false, gotPccs = false;
+    bool gotItemIds = false, gotItemNames = false, gotAppearsIn = false, gotConsistsOf = false;
+    bool gotKnownColors = false, gotItemIndex = false;
+
+    auto &generationDate = snapshot->generationDate;
+    auto &colors = snapshot->colors;
+    auto &categories = snapshot->categories;
+    auto &itemTypes = snapshot->itemTypes;
+    auto &itemChangelog = snapshot->itemChangelog;
+    auto &colorChangelog = snapshot->colorChangelog;
+    auto &pccs = snapshot->pccs;
+    auto &items = snapshot->items;
+    auto &itemIds = snapshot->itemIds;
+    auto &itemNames = snapshot->itemNames;
+    auto &appearsIn = snapshot->appearsIn;
+    auto &consistsOf = snapshot->consistsOf;
+    auto &knownColors = snapshot->knownColors;
+    auto &itemIndex = snapshot->itemIndex;
+
+    // All chunks are independent of each other, so they can be decoded in parallel: every
+    // chunk is written to its own set of variables, so there is no need for any locking.
+    // Exceptions cannot be transported out of QtConcurrent, so we just record the errors.
+    auto decodeChunk = [&](ChunkDirectoryEntry &cde) {
+        try {
+            QByteArray chunkBa = QByteArray::fromRawData(data, int(fileSize));
+            QBuffer chunkBuf(&chunkBa);
+            chunkBuf.open(QIODevice::ReadOnly);
+            chunkBuf.seek(cde.offset - 16); // the chunk header
+            ChunkReader cr(&chunkBuf, QDataStream::LittleEndian);
+            QDataStream &ds = cr.dataStream();
+
+            if (!cr.startChunk() || (cr.chunkId() != cde.id) || (cr.chunkVersion() != cde.version)
+                    || (cr.chunkSize() != cde.size)) {
+                throw Exception("chunk directory mismatch in database (%1) at position %2")
+                    .arg(fn).arg(cde.offset);
+            }
+            const qint64 chunkEnd = cde.offset + cde.size;
+
+            auto check = [&]() {
+                if (ds.status() != QDataStream::Ok)
+                    throw Exception("failed to read from database (%1) at position %2")
+                        .arg(fn).arg(chunkBuf.pos());
+            };
+
+            auto sizeCheck = [&](int s, int max) {
+                if (s > max)
+                    throw Exception("failed to read from database (%1) at position %2: size value %L3 is larger than expected maximum %L4")
+                        .arg(fn).arg(chunkBuf.pos()).arg(s).arg(max);
+            };
+
+            // no decoding at all: just reference the data in the memory mapped file
+            auto mapArray = [&](auto &array, qint64 count) {
+                using T = typename decltype(array.span())::element_type;
+                const qint64 pos = chunkBuf.pos();
+                const qint64 size = count * qint64(sizeof(T));
+
+                if ((pos % qint64(alignof(T))) || ((pos + size) > chunkEnd)) {
+                    throw Exception("failed to map a data array from the database (%1) at position %2")
+                        .arg(fn).arg(pos);
+                }
+                array = { data + pos, size_t(count) };
+                chunkBuf.seek(pos + size);
+            };
+
+            switch (cde.id | quint64(cde.version) << 32) {
             case ChunkId('D','A','T','E') | 1ULL << 32: {
                 ds >> generationDate;
                 break;
@@ -291,21 +802,52 @@ void Database::read(const QString &fileName)
                 gotItemTypes = true;
                 break;
             }
-            case ChunkId('I','T','E','M') | 1ULL << 32: {
+            case ChunkId('I','T','E','M') | 2ULL << 32: {
                 quint32 itc = 0;
-                ds >> itc;
+                quint32 recordSize = 0;
+                quint64 reserved = 0;
+                ds >> itc >> recordSize >> reserved;
                 check();
                 sizeCheck(itc, 1'000'000);
 
-                items.resize(itc);
-                for (quint32 i = 0; i < itc; ++i) {
-                    readItemFromDatabase(items[i], ds, Version::Latest);
-                    check();
+                if (recordSize != sizeof(Item)) {
+                    throw Exception("invalid item record size in database (%1): expected %2, but got %3")
+                        .arg(fn).arg(sizeof(Item)).arg(recordSize);
                 }
-                items.shrink_to_fit();
+                mapArray(items, itc);
                 gotItems = true;
                 break;
             }
+            case ChunkId('I','I','D','S') | 1ULL << 32: {
+                mapArray(itemIds, cde.size / qint64(sizeof(char)));
+                gotItemIds = true;
+                break;
+            }
+            case ChunkId('I','N','A','M') | 1ULL << 32: {
+                mapArray(itemNames, cde.size / qint64(sizeof(char16_t)));
+                gotItemNames = true;
+                break;
+            }
+            case ChunkId('I','A','P','P') | 1ULL << 32: {
+                mapArray(appearsIn, cde.size / qint64(sizeof(Item::AppearsInRecord)));
+                gotAppearsIn = true;
+                break;
+            }
+            case ChunkId('I','C','O','N') | 1ULL << 32: {
+                mapArray(consistsOf, cde.size / qint64(sizeof(Item::ConsistsOf)));
+                gotConsistsOf = true;
+                break;
+            }
+            case ChunkId('I','K','N','C') | 1ULL << 32: {
+                mapArray(knownColors, cde.size / qint64(sizeof(quint16)));
+                gotKnownColors = true;
+                break;
+            }
+            case ChunkId('I','I','D','X') | 1ULL << 32: {
+                mapArray(itemIndex, cde.size / qint64(sizeof(quint32)));
+                gotItemIndex = true;
+                break;
+            }
             case ChunkId('I','C','H','G') | 1ULL << 32: {
                 quint32 clc = 0;
                 ds >> clc;
@@ -335,9 +877,8 @@ void Database::read(const QString &fileName)
                 break;
             }
             case ChunkId('P','C','C',' ') | 1ULL << 32: {
-                if (!gotItems || !gotColors)
-                    throw Exception("found a 'PCC ' chunk before the 'ITEM' and 'COL ' chunks");
-
+                // the PCCs only reference items and colors by index, so there is no need to
+                // wait for the ITEM and COL chunks to be decoded
                 quint32 pccc = 0;
                 ds >> pccc;
                 check();
@@ -359,60 +900,178 @@ void Database::read(const QString &fileName)
             }
             if (!cr.endChunk()) {
                 throw Exception("missed the end of a chunk when reading from database (%1) at position %2")
-                    .arg(f.fileName()).arg(f.pos());
+                    .arg(fn).arg(chunkBuf.pos());
             }
+        } catch (const Exception &e) {
+            cde.error = e.error();
         }
-        if (!cr.endChunk()) {
-            throw Exception("missed the end of the root chunk when reading from database (%1) at position %2")
-                .arg(f.fileName()).arg(f.pos());
-        }
+    };
 
-        delete sw;
+    QtConcurrent::blockingMap(chunkDirectory, decodeChunk);
 
-        if (!gotColors || !gotCategories || !gotItemTypes || !gotItems || !gotItemChangeLog
-                || !gotColorChangeLog || !gotPccs) {
-            throw Exception("not all required data chunks were found in the database (%1)")
-                .arg(f.fileName());
-        }
+    for (const auto &cde : qAsConst(chunkDirectory)) {
+        if (!cde.error.isEmpty())
+            throw Exception(cde.error);
+    }
 
-        qDebug().noquote() << "Loaded database from" << f.fileName()
-                 << "\n  Generated at:" << QLocale().toString(generationDate)
-                 << "\n  Colors      :" << colors.size()
-                 << "\n  Item Types  :" << itemTypes.size()
-                 << "\n  Categories  :" << categories.size()
-                 << "\n  Items       :" << items.size()
-                 << "\n  PCCs        :" << pccs.size()
-                 << "\n  ChangeLog I :" << itemChangelog.size()
-                 << "\n  ChangeLog C :" << colorChangelog.size();
+    delete sw;
 
+    if (!gotColors || !gotCategories || !gotItemTypes || !gotItems || !gotItemChangeLog
+            || !gotColorChangeLog || !gotPccs || !gotItemIds || !gotItemNames || !gotAppearsIn
+            || !gotConsistsOf || !gotKnownColors) {
+        throw Exception("not all required data chunks were found in the database (%1)")
+            .arg(fn);
+    }
 
-        emit core()->beginResetDatabase();
+    // The memory mapped records are used as-is, so every offset and index in them has to be
+    // checked once, before anything walks over them: a truncated or corrupt file would
+    // otherwise lead to reads out of bounds later on.
+    {
+        auto isRange = [](quint64 offset, quint64 size, size_t poolSize) {
+            return (offset + size) <= poolSize;
+        };
+        auto isIndex = [](qint64 index, size_t count, bool optional) {
+            return (optional && (index == -1)) || ((index >= 0) && (quint64(index) < count));
+        };
+        auto invalid = [&fn](const char *what, size_t index, const char *reason) {
+            return Exception("invalid %1 record #%2 in database (%3): %4")
+                .arg(QLatin1String(what)).arg(index).arg(fn).arg(QLatin1String(reason));
+        };
 
-        m_colors = colors;
-        m_categories = categories;
-        m_itemTypes = itemTypes;
-        m_items = items;
-        m_itemChangelog = itemChangelog;
-        m_colorChangelog = colorChangelog;
-        m_pccs = pccs;
+        const auto itemSpan = items.span();
+        const auto appearsInSpan = appearsIn.span();
+        const auto consistsOfSpan = consistsOf.span();
+        const auto knownColorsSpan = knownColors.span();
 
-        emit core()->endResetDatabase();
+        for (size_t i = 0; i < itemSpan.size(); ++i) {
+            const Item &item = itemSpan[i];
+
+            if (!isRange(item.m_idOffset, item.m_idSize, itemIds.size())
+                    || !isRange(item.m_nameOffset, item.m_nameSize, itemNames.size())
+                    || !isRange(item.m_appearsInOffset, item.m_appearsInSize, appearsInSpan.size())
+                    || !isRange(item.m_consistsOfOffset, item.m_consistsOfSize, consistsOfSpan.size())
+                    || !isRange(item.m_knownColorsOffset, item.m_knownColorsSize, knownColorsSpan.size())) {
+                throw invalid("item", i, "data offset out of range");
+            }
+            if (!isIndex(item.m_itemTypeIndex, itemTypes.size(), true)
+                    || !isIndex(item.m_categoryIndex, categories.size(), true)
+                    || !isIndex(item.m_defaultColorIndex, colors.size(), true)) {
+                throw invalid("item", i, "type, category or color index out of range");
+            }
+            for (const auto &co : consistsOfSpan.subspan(item.m_consistsOfOffset, item.m_consistsOfSize)) {
+                if ((co.m_itemIndex >= itemSpan.size()) || (co.m_colorIndex >= colors.size()))
+                    throw invalid("item", i, "consists-of index out of range");
+            }
+            const auto kci = knownColorsSpan.subspan(item.m_knownColorsOffset, item.m_knownColorsSize);
+            for (const quint16 colorIndex : kci) {
+                if (colorIndex >= colors.size())
+                    throw invalid("item", i, "known color index out of range");
+            }
 
-        if (generationDate != m_lastUpdated) {
-            m_lastUpdated = generationDate;
-            emit lastUpdatedChanged(generationDate);
+            // 1st level (color header): m12: color index / m20: size of 2nd level vector
+            // 2nd level (color entry):  m12: quantity / m20: item index
+            const auto ai = appearsInSpan.subspan(item.m_appearsInOffset, item.m_appearsInSize);
+            for (size_t j = 0; j < ai.size(); ) {
+                const auto &header = ai[j++];
+                if ((header.m12 >= colors.size()) || (header.m20 > (ai.size() - j)))
+                    throw invalid("item", i, "appears-in color header out of range");
+                for (const auto &entry : ai.subspan(j, header.m20)) {
+                    if (entry.m12 && (entry.m20 >= itemSpan.size()))
+                        throw invalid("item", i, "appears-in item index out of range");
+                }
+                j += header.m20;
+            }
         }
-        if (!m_valid) {
-            m_valid = true;
-            emit validChanged(m_valid);
+        for (size_t i = 0; i < itemTypes.size(); ++i) {
+            for (const quint16 categoryIndex : itemTypes[i].m_categoryIndexes) {
+                if (categoryIndex >= categories.size())
+                    throw invalid("item type", i, "category index out of range");
+            }
         }
-
-    } catch (const Exception &) {
-        if (m_valid) {
-            m_valid = false;
-            emit validChanged(m_valid);
+        for (size_t i = 0; i < pccs.size(); ++i) {
+            if (!isIndex(pccs[i].m_itemIndex, itemSpan.size(), true)
+                    || !isIndex(pccs[i].m_colorIndex, colors.size(), true)) {
+                throw invalid("part color code", i, "item or color index out of range");
+            }
         }
-        throw;
+    }
+
+    qDebug().noquote() << "Loaded database from" << fn
+             << "\n  Generated at:" << QLocale().toString(generationDate)
+             << "\n  Colors      :" << colors.size()
+             << "\n  Item Types  :" << itemTypes.size()
+             << "\n  Categories  :" << categories.size()
+             << "\n  Items       :" << items.size()
+             << "\n  PCCs        :" << pccs.size()
+             << "\n  ChangeLog I :" << itemChangelog.size()
+             << "\n  ChangeLog C :" << colorChangelog.size();
+
+    // files written before the item index was stored need to build it once
+    if (!gotItemIndex)
+        itemIndex = buildItemIndex(items.span(), itemIds.span());
+    else if (!isValidItemIndex(itemIndex.span(), items.size()))
+        throw Exception("invalid item index in database (%1)").arg(fn);
+
+    buildColorIndexes(colors, snapshot->colorNameIndex, snapshot->colorLDrawIndex);
+
+    // the QFile was created on this (worker) thread, but it will be destroyed on the main thread
+    if (auto app = QCoreApplication::instance())
+        f->moveToThread(app->thread());
+    snapshot->mappedFile = std::move(f);
+    return snapshot;
+}
+
+void Database::installSnapshot(std::shared_ptr<Snapshot> snapshot)
+{
+    // Publishing the new snapshot only swaps the containers: the old data ends up in the
+    // snapshot object and gets freed together with it, so we never hold two copies at once
+    // and the GUI thread is only blocked for the model resets.
+    emit core()->beginResetDatabase();
+
+    finishItemTextIndex(); // still reading from the current arrays
+
+    m_colors.swap(snapshot->colors);
+    m_categories.swap(snapshot->categories);
+    m_itemTypes.swap(snapshot->itemTypes);
+    m_itemChangelog.swap(snapshot->itemChangelog);
+    m_colorChangelog.swap(snapshot->colorChangelog);
+    m_pccs.swap(snapshot->pccs);
+    std::swap(m_items, snapshot->items);
+    std::swap(m_itemIds, snapshot->itemIds);
+    std::swap(m_itemNames, snapshot->itemNames);
+    std::swap(m_appearsIn, snapshot->appearsIn);
+    std::swap(m_consistsOf, snapshot->consistsOf);
+    std::swap(m_knownColors, snapshot->knownColors);
+    std::swap(m_mappedFile, snapshot->mappedFile);
+    std::swap(m_itemIndex, snapshot->itemIndex);
+    m_colorNameIndex.swap(snapshot->colorNameIndex);
+    m_colorLDrawIndex.swap(snapshot->colorLDrawIndex);
+    ++m_generation;
+    buildItemTextIndex();
+
+    emit core()->endResetDatabase();
+
+    const QString fn = snapshot->fileName;
+    const QDateTime generationDate = snapshot->generationDate;
+
+    if (auto &f = snapshot->mappedFile) {
+        // the mapping of the old database is not needed anymore
+        const QString oldFileName = f->fileName();
+        f.reset();
+
+        // get rid of the stale database file, if we alternated file names (see startUpdate())
+        if ((QString(oldFileName % u".new") == fn) || (QString(fn % u".new") == oldFileName))
+            QFile::remove(oldFileName);
+    }
+    snapshot.reset();
+
+    if (generationDate != m_lastUpdated) {
+        m_lastUpdated = generationDate;
+        emit lastUpdatedChanged(generationDate);
+    }
+    if (!m_valid) {
+        m_valid = true;
+        emit validChanged(m_valid);
     }
 }
 
@@ -436,50 +1095,89 @@ void Database::write(const QString &filename, Version version) const
                 .arg(f.fileName()).arg(f.pos());
     };
 
+    // remember the position and size of every chunk for the chunk directory
+    QVector<ChunkDirectoryEntry> chunkDirectory;
+
+    auto startChunk = [&](quint32 id, quint32 chunkVersion) {
+        check(cw.startChunk(id, chunkVersion));
+        chunkDirectory.append({ id, chunkVersion, f.pos(), 0, { } });
+    };
+    auto endChunk = [&]() {
+        chunkDirectory.last().size = f.pos() - chunkDirectory.last().offset;
+        check(cw.endChunk());
+    };
+
     check(cw.startChunk(ChunkId('B','S','D','B'), uint(version)));
 
-    check(cw.startChunk(ChunkId('D','A','T','E'), 1));
+    startChunk(ChunkId('D','A','T','E'), 1);
     ds << QDateTime::currentDateTimeUtc();
-    check(cw.endChunk());
+    endChunk();
 
-    check(cw.startChunk(ChunkId('C','O','L',' '), 1));
+    startChunk(ChunkId('C','O','L',' '), 1);
     ds << quint32(m_colors.size());
     for (const Color &col : m_colors)
         writeColorToDatabase(col, ds, version);
-    check(cw.endChunk());
+    endChunk();
 
-    check(cw.startChunk(ChunkId('C','A','T',' '), 1));
+    startChunk(ChunkId('C','A','T',' '), 1);
     ds << quint32(m_categories.size());
     for (const Category &cat : m_categories)
         writeCategoryToDatabase(cat, ds, version);
-    check(cw.endChunk());
+    endChunk();
 
-    check(cw.startChunk(ChunkId('T','Y','P','E'), 1));
+    startChunk(ChunkId('T','Y','P','E'), 1);
     ds << quint32(m_itemTypes.size());
     for (const ItemType &itt : m_itemTypes)
         writeItemTypeToDatabase(itt, ds, version);
-    check(cw.endChunk());
+    endChunk();
+
+    if (version >= Version::Version_6) {
+        if (QSysInfo::ByteOrder != QSysInfo::LittleEndian)
+            throw Exception("memory mapped databases can only be written on little-endian systems");
+
+        // these arrays are memory mapped directly when reading: no encoding at all
+        auto writeArray = [&](quint32 id, quint32 chunkVersion, auto span) {
+            startChunk(id, chunkVersion);
+            check(ds.writeRawData(reinterpret_cast<const char *>(span.data()), int(span.size_bytes()))
+                  == int(span.size_bytes()));
+            endChunk();
+        };
 
-    check(cw.startChunk(ChunkId('I','T','E','M'), 1));
-    ds << quint32(m_items.size());
-    for (const Item &item : m_items)
-        writeItemToDatabase(item, ds, version);
-    check(cw.endChunk());
+        // the 16 byte header keeps the records aligned
+        startChunk(ChunkId('I','T','E','M'), 2);
+        ds << quint32(m_items.size()) << quint32(sizeof(Item)) << quint64(0);
+        check(ds.writeRawData(reinterpret_cast<const char *>(m_items.span().data()),
+                              int(m_items.span().size_bytes())) == int(m_items.span().size_bytes()));
+        endChunk();
+
+        writeArray(ChunkId('I','I','D','S'), 1, m_itemIds.span());
+        writeArray(ChunkId('I','N','A','M'), 1, m_itemNames.span());
+        writeArray(ChunkId('I','A','P','P'), 1, m_appearsIn.span());
+        writeArray(ChunkId('I','C','O','N'), 1, m_consistsOf.span());
+        writeArray(ChunkId('I','K','N','C'), 1, m_knownColors.span());
+        writeArray(ChunkId('I','I','D','X'), 1, m_itemIndex.span());
+    } else {
+        startChunk(ChunkId('I','T','E','M'), 1);
+        ds << quint32(m_items.size());
+        for (const Item &item : m_items.span())
+            writeItemToDatabase(item, ds, version);
+        endChunk();
+    }
 
     if (version >= Version::Version_5) {
-        check(cw.startChunk(ChunkId('I','C','H','G'), 1));
+        startChunk(ChunkId('I','C','H','G'), 1);
         ds << quint32(m_itemChangelog.size());
         for (const ItemChangeLogEntry &e : m_itemChangelog)
             writeItemChangeLogToDatabase(e, ds, version);
-        check(cw.endChunk());
+        endChunk();
 
-        check(cw.startChunk(ChunkId('C','C','H','G'), 1));
+        startChunk(ChunkId('C','C','H','G'), 1);
         ds << quint32(m_colorChangelog.size());
         for (const ColorChangeLogEntry &e : m_colorChangelog)
             writeColorChangeLogToDatabase(e, ds, version);
-        check(cw.endChunk());
+        endChunk();
     } else {
-        check(cw.startChunk(ChunkId('C','H','G','L'), 1));
+        startChunk(ChunkId('C','H','G','L'), 1);
         ds << quint32(m_itemChangelog.size() + m_colorChangelog.size());
         for (const ItemChangeLogEntry &e : m_itemChangelog) {
             ds << static_cast<QByteArray>("\x03\t" % QByteArray(1, e.fromItemTypeId()) % '\t' % e.fromItemId()
@@ -489,14 +1187,23 @@ void Database::write(const QString &filename, Version version) const
             ds << static_cast<QByteArray>("\x07\t" % QByteArray::number(e.fromColorId()) % "\tx\t"
                                           % QByteArray::number(e.toColorId()) % "\tx");
         }
-        check(cw.endChunk());
+        endChunk();
     }
 
     if (version >= Version::Version_3) {
-        check(cw.startChunk(ChunkId('P','C','C',' '), 1));
+        startChunk(ChunkId('P','C','C',' '), 1);
         ds << quint32(m_pccs.size());
         for (const PartColorCode &pcc : m_pccs)
             writePCCToDatabase(pcc, ds, version);
+        endChunk();
+    }
+
+    if (version >= Version::Version_6) {
+        // this has to be the last chunk, so that read() can find it at the end of the file
+        check(cw.startChunk(ChunkId('C','D','I','R'), 1));
+        ds << quint32(chunkDirectory.size());
+        for (const auto &cde : qAsConst(chunkDirectory))
+            ds << cde.id << cde.version << cde.offset << cde.size;
         check(cw.endChunk());
     }
 
@@ -593,73 +1300,25 @@ void Database::writeItemTypeToDatabase(const ItemType &itt, QDataStream &dataStr
 }
 
 
-void Database::readItemFromDatabase(Item &item, QDataStream &dataStream, Version)
-{
-    dataStream >> item.m_id >> item.m_name >> item.m_itemTypeIndex >> item.m_categoryIndex
-            >> item.m_defaultColorIndex >> (qint8 &) item.m_itemTypeId >> item.m_year
-            >> item.m_lastInventoryUpdate >> item.m_weight;
-
-    quint32 appearsInSize = 0;
-    dataStream >> appearsInSize;
-    item.m_appears_in.clear();
-    item.m_appears_in.reserve(appearsInSize);
-
-    union {
-        quint32 ui32;
-        Item::AppearsInRecord ai;
-    } appearsInUnion;
-
-    while (appearsInSize-- > 0) {
-        dataStream >> appearsInUnion.ui32;
-        item.m_appears_in.push_back(appearsInUnion.ai);
-    }
-    item.m_appears_in.shrink_to_fit();
-
-    quint32 consistsOfSize = 0;
-    dataStream >> consistsOfSize;
-    item.m_consists_of.clear();
-    item.m_consists_of.reserve(consistsOfSize);
-
-    union {
-        quint64 ui64;
-        Item::ConsistsOf co;
-    } consistsOfUnion;
-
-    while (consistsOfSize-- > 0) {
-        dataStream >> consistsOfUnion.ui64;
-        item.m_consists_of.push_back(consistsOfUnion.co);
-    }
-    item.m_consists_of.shrink_to_fit();
-
-    quint32 knownColorsSize;
-    dataStream >> knownColorsSize;
-    item.m_knownColorIndexes.clear();
-    item.m_knownColorIndexes.reserve(knownColorsSize);
-
-    quint16 colorIndex;
-
-    while (knownColorsSize-- > 0) {
-        dataStream >> colorIndex;
-        item.m_knownColorIndexes.push_back(colorIndex);
-    }
-    item.m_knownColorIndexes.shrink_to_fit();
-}
-
 void Database::writeItemToDatabase(const Item &item, QDataStream &dataStream, Version v) const
 {
-    dataStream << item.m_id;
+    const auto appearsIn = m_appearsIn.span().subspan(item.m_appearsInOffset, item.m_appearsInSize);
+    const auto consistsOf = m_consistsOf.span().subspan(item.m_consistsOfOffset, item.m_consistsOfSize);
+    const auto knownColors = m_knownColors.span().subspan(item.m_knownColorsOffset, item.m_knownColorsSize);
+
+    dataStream << itemId(&item);
     if (v <= Version::Version_3) {
-        dataStream << item.m_name.toUtf8()
+        dataStream << itemName(&item).toUtf8()
                    << qint8(item.m_itemTypeId)
-                   << quint32(item.category()->id())
-                   << quint32((item.m_defaultColorIndex != -1) ? item.defaultColor()->id()
+                   << quint32(m_categories[item.m_categoryIndex].id())
+                   << quint32((item.m_defaultColorIndex != -1) ? m_colors[item.m_defaultColorIndex].id()
                                                                : Color::InvalidId)
                    << item.m_lastInventoryUpdate
                    << item.m_weight
-                   << quint32(&item - m_items.data()) // the index
+                   << quint32(&item - m_items.span().data()) // the index
                    << quint32(item.m_year);
     } else {
-        dataStream << item.m_name
+        dataStream << itemName(&item)
                    << item.m_itemTypeIndex
                    << item.m_categoryIndex
                    << item.m_defaultColorIndex
@@ -675,14 +1334,14 @@ void Database::writeItemToDatabase(const Item &item, QDataStream &dataStream, Ve
     } appearsInUnion;
     if (v <= Version::Version_3) {
         quint32 colorCount = 0;
-        for (auto it = item.m_appears_in.cbegin(); it != item.m_appears_in.cend(); ) {
+        for (auto it = appearsIn.begin(); it != appearsIn.end(); ) {
             ++colorCount;
             it += (1 + it->m20);
         }
         dataStream << colorCount; // color count
         if (colorCount)
-            dataStream << quint32(2 + item.m_appears_in.size()); // dword count
-        for (auto it = item.m_appears_in.cbegin(); it != item.m_appears_in.cend(); ) {
+            dataStream << quint32(2 + appearsIn.size()); // dword count
+        for (auto it = appearsIn.begin(); it != appearsIn.end(); ) {
             // fix color header (index -> id)
             uint colorCount = it->m20;
             uint colorId = quint32(m_colors[it->m12].id());
@@ -697,27 +1356,27 @@ void Database::writeItemToDatabase(const Item &item, QDataStream &dataStream, Ve
             }
         }
     } else {
-        dataStream << quint32(item.m_appears_in.size());
-        for (const auto &ai : item.m_appears_in) {
+        dataStream << quint32(appearsIn.size());
+        for (const auto &ai : appearsIn) {
             appearsInUnion.ai = ai;
             dataStream << appearsInUnion.ui32;
         }
     }
 
-    dataStream << quint32(item.m_consists_of.size());
+    dataStream << quint32(consistsOf.size());
     union {
         quint64 ui64;
         Item::ConsistsOf co;
     } consistsOfUnion;
-    for (const auto &co : item.m_consists_of) {
+    for (const auto &co : consistsOf) {
         consistsOfUnion.co = co;
         if (v <= Version::Version_3) // fix color index -> id
             consistsOfUnion.co.m_colorIndex = m_colors[consistsOfUnion.co.m_colorIndex].id();
         dataStream << consistsOfUnion.ui64;
     }
 
-    dataStream << quint32(item.m_knownColorIndexes.size());
-    for (const quint16 colorIndex : item.m_knownColorIndexes) {
+    dataStream << quint32(knownColors.size());
+    for (const quint16 colorIndex : knownColors) {
         if (v <= Version::Version_3)
             dataStream << quint32(m_colors[colorIndex].id());
         else
@@ -736,8 +1395,9 @@ void Database::readPCCFromDatabase(PartColorCode &pcc, QDataStream &dataStream,
 void Database::writePCCToDatabase(const PartColorCode &pcc, QDataStream &dataStream, Version v) const
 {
     if (v <= Version::Version_3) {
-        dataStream << pcc.id() << qint8(pcc.item()->itemTypeId())
-                   << QString::fromLatin1(pcc.item()->id()) << pcc.color()->id();
+        const Item &item = m_items.span()[pcc.m_itemIndex];
+        dataStream << pcc.id() << qint8(item.m_itemTypeId)
+                   << QString::fromLatin1(itemId(&item)) << m_colors[pcc.m_colorIndex].id();
     } else {
         dataStream << pcc.m_id << qint32(pcc.m_itemIndex) << qint32(pcc.m_colorIndex);
     }
@@ -13,8 +13,15 @@
 */
 #pragma once
 
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
 #include <QObject>
 #include <QDateTime>
+#include <QHash>
+#include <QFuture>
 
 #include "bricklink/global.h"
 #include "bricklink/color.h"
@@ -25,13 +32,84 @@
 #include "bricklink/partcolorcode.h"
 
 
+QT_FORWARD_DECLARE_CLASS(QFile)
+
 class Transfer;
+class tst_BrickStore;
 
 namespace BrickLink {
 
 class Core;
 
 
+// A read-only array, that either points directly into the memory mapped database file or
+// owns its data (e.g. after a text import)
+template <typename T> class DatabaseArray
+{
+    Q_STATIC_ASSERT(std::is_trivially_copyable_v<T>);
+
+public:
+    DatabaseArray() = default;
+    DatabaseArray(std::vector<T> &&data)
+        : m_data(std::move(data))
+        , m_span(m_data)
+    { }
+    DatabaseArray(const char *mappedData, size_t count)
+        : m_span(reinterpret_cast<const T *>(mappedData), count)
+    { }
+    DatabaseArray(const DatabaseArray &) = delete;
+    DatabaseArray &operator=(const DatabaseArray &) = delete;
+
+    // moving a std::vector keeps its buffer, so the span stays valid
+    DatabaseArray(DatabaseArray &&other) noexcept
+        : m_data(std::move(other.m_data))
+        , m_span(std::exchange(other.m_span, { }))
+    { }
+    DatabaseArray &operator=(DatabaseArray &&other) noexcept
+    {
+        m_data = std::move(other.m_data);
+        m_span = std::exchange(other.m_span, { });
+        return *this;
+    }
+
+    inline std::span<const T> span() const  { return m_span; }
+    inline size_t size() const              { return m_span.size(); }
+
+private:
+    std::vector<T> m_data;
+    std::span<const T> m_span;
+};
+
+
+// An inverted index over the case-folded words in all item ids and names. It is used to narrow
+// down the candidates for the text filter of the item browser, without scanning every item.
+// The suffixes of all unique words are sorted, so that the words containing a search term
+// can be found via binary search.
+class ItemTextIndex
+{
+public:
+    ItemTextIndex(std::span<const Item> items, std::span<const char> ids, std::span<const char16_t> names);
+
+    // Returns the sorted indexes of all items that could contain term in their "id name" string:
+    // the result is a superset of the actual matches. Returns false if the term is too short to
+    // narrow anything down.
+    bool candidates(QStringView term, std::vector<quint32> &result) const;
+
+private:
+    struct Suffix {
+        quint32 word;
+        quint32 offset;
+    };
+    QStringView suffixView(const Suffix &s) const;
+
+    std::vector<char16_t> m_wordChars;      // all unique words, concatenated
+    std::vector<quint32> m_wordOffsets;     // word i: [offsets[i], offsets[i + 1])
+    std::vector<quint32> m_postingOffsets;  // items for word i: [offsets[i], offsets[i + 1])
+    std::vector<quint32> m_postings;        // item indexes, sorted per word
+    std::vector<Suffix> m_suffixes;         // all suffixes of all words, sorted
+};
+
+
 class Database : public QObject
 {
     Q_OBJECT
@@ -47,15 +125,19 @@ public:
         Version_3,
         Version_4,
         Version_5,
+        Version_6, // memory mapped items
 
-        Latest = Version_5
+        Latest = Version_6
     };
 
+    ~Database() override;
+
     Q_INVOKABLE bool isUpdateNeeded() const;
 
     bool isValid() const          { return m_valid; }
     QDateTime lastUpdated() const { return m_lastUpdated; }
     BrickLink::UpdateStatus updateStatus() const  { return m_updateStatus; }
+    uint generation() const       { return m_generation; }
 
     static QString defaultDatabaseName(Version version = Version::Latest);
 
@@ -66,6 +148,8 @@ public:
     void read(const QString &fileName = { });
     void write(const QString &fileName, Version version) const;
 
+    const ItemTextIndex *itemTextIndex() const;
+
 signals:
     void updateStarted();
     void updateProgress(int received, int total);
@@ -83,22 +167,66 @@ private:
 
     void clear();
 
+    // everything read from a database file: it is decoded on a worker thread while updating
+    // and then installed in one go on the main thread
+    struct Snapshot;
+    static std::shared_ptr<Snapshot> loadSnapshot(const QString &fileName);
+    void installSnapshot(std::shared_ptr<Snapshot> snapshot);
+
+    QByteArray itemId(const Item *item) const;
+    QString itemName(const Item *item) const;
+
+    const Item *findItem(char itemTypeId, const char *id, qsizetype idSize) const;
+    static std::vector<quint32> buildItemIndex(std::span<const Item> items, std::span<const char> ids);
+    static bool isValidItemIndex(std::span<const quint32> index, size_t itemCount);
+    static void buildColorIndexes(const std::vector<Color> &colors, QHash<QString, quint16> &nameIndex,
+                                  QHash<int, quint16> &ldrawIndex);
+
     bool m_valid = false;
     BrickLink::UpdateStatus m_updateStatus = BrickLink::UpdateStatus::UpdateFailed;
     int m_updateInterval = 0;
     QDateTime m_lastUpdated;
+    uint m_generation = 0; // incremented every time a new database is installed
     Transfer *m_transfer;
 
     std::vector<Color>               m_colors;
     std::vector<Category>            m_categories;
     std::vector<ItemType>            m_itemTypes;
-    std::vector<Item>                m_items;
     std::vector<ItemChangeLogEntry>  m_itemChangelog;
     std::vector<ColorChangeLogEntry> m_colorChangelog;
     std::vector<PartColorCode>       m_pccs;
 
+    // the fixed-size item records and the pools for their variable sized data
+    DatabaseArray<Item>                  m_items;
+    DatabaseArray<char>                  m_itemIds;
+    DatabaseArray<char16_t>              m_itemNames;
+    DatabaseArray<Item::AppearsInRecord> m_appearsIn;
+    DatabaseArray<Item::ConsistsOf>      m_consistsOf;
+    DatabaseArray<quint16>               m_knownColors;
+    std::unique_ptr<QFile>               m_mappedFile;
+
+    // open addressing hash table for the (item-type, id) lookups: the slots contain the
+    // item index + 1 (0 marks an empty slot) and the size is always a power of 2. It is
+    // stored in the database file, so it is usually memory mapped as well.
+    DatabaseArray<quint32>               m_itemIndex;
+
+    // color indexes by case-folded name and by LDraw id
+    QHash<QString, quint16>              m_colorNameIndex;
+    QHash<int, quint16>                  m_colorLDrawIndex;
+
+    // the text index is only needed for searching, so it is built in the background after a
+    // new database has been installed: see buildItemTextIndex()
+    std::unique_ptr<ItemTextIndex>       m_itemTextIndex;
+    QFuture<ItemTextIndex *>             m_itemTextIndexFuture;
+    bool                                 m_itemTextIndexPending = false;
+
+    void buildItemTextIndex();
+    void finishItemTextIndex();
+
     friend class Core;
+    friend class Item;
     friend class TextImport;
+    friend class ::tst_BrickStore;
 
     // IO
 
@@ -108,7 +236,6 @@ private:
     void writeCategoryToDatabase(const Category &category, QDataStream &dataStream, Version v) const;
     static void readItemTypeFromDatabase(ItemType &itt, QDataStream &dataStream, Version v);
     void writeItemTypeToDatabase(const ItemType &itemType, QDataStream &dataStream, Version v) const;
-    static void readItemFromDatabase(Item &item, QDataStream &dataStream, Version v);
     void writeItemToDatabase(const Item &item, QDataStream &dataStream, Version v) const;
     static void readPCCFromDatabase(PartColorCode &pcc, QDataStream &dataStream, Version v);
     void writePCCToDatabase(const PartColorCode &pcc, QDataStream &dataStream, Version v) const;
@@ -11,7 +11,6 @@
 **
 ** See http://fsf.org/licensing/licenses/gpl.html for GPL licensing information.
 */
-
 #include "bricklink/item.h"
 #include "bricklink/core.h"
 
@@ -23,74 +22,95 @@ int _dwords_for_appears  = 0;
 int _qwords_for_consists = 0;
 
 
-bool BrickLink::Item::lessThan(const Item &item, const std::pair<char, QByteArray> &ids)
+QByteArray BrickLink::Item::id() const
 {
-    int d = (item.m_itemTypeId - ids.first);
-    return d == 0 ? (item.m_id.compare(ids.second) < 0) : (d < 0);
+    return core()->database()->itemId(this);
 }
 
-// color-idx -> { vector < qty, item-idx > }
-void BrickLink::Item::setAppearsIn(const QHash<uint, QVector<QPair<int, uint>>> &appearHash)
+QString BrickLink::Item::name() const
 {
-    // we are compacting a "hash of a vector of pairs" down to a list of 32bit integers
-
-    m_appears_in.clear();
+    return core()->database()->itemName(this);
+}
 
-    for (auto it = appearHash.cbegin(); it != appearHash.cend(); ++it) {
-        const auto &colorVector = it.value();
+QLatin1String BrickLink::Item::idView() const
+{
+    return QLatin1String(core()->database()->m_itemIds.span().data() + m_idOffset, m_idSize);
+}
 
-        m_appears_in.push_back({ it.key() /*colorIndex*/, uint(colorVector.size()) /*vectorSize*/ });
+QStringView BrickLink::Item::nameView() const
+{
+    return QStringView(core()->database()->m_itemNames.span().data() + m_nameOffset, m_nameSize);
+}
 
-        for (auto vecIt = colorVector.cbegin(); vecIt != colorVector.cend(); ++vecIt)
-            m_appears_in.push_back({ uint(vecIt->first) /*quantity*/, vecIt->second /*itemIndex*/ });
-    }
-    m_appears_in.shrink_to_fit();
+std::span<const BrickLink::Item::AppearsInRecord> BrickLink::Item::appearsInRecords() const
+{
+    return core()->database()->m_appearsIn.span().subspan(m_appearsInOffset, m_appearsInSize);
+}
 
-    _dwords_for_appears += int(m_appears_in.size());
+std::span<const quint16> BrickLink::Item::knownColorIndexes() const
+{
+    return core()->database()->m_knownColors.span().subspan(m_knownColorsOffset, m_knownColorsSize);
 }
 
 BrickLink::AppearsIn BrickLink::Item::appearsIn(const Color *onlyColor) const
 {
     AppearsIn appearsHash;
+    for (const auto &entry : appearsInRange(onlyColor))
+        appearsHash[entry.color].append(qMakePair(entry.quantity, entry.item));
+    return appearsHash;
+}
 
-    for (auto it = m_appears_in.cbegin(); it != m_appears_in.cend(); ) {
-        // 1st level (color header):  m12: color index / m20: size of 2nd level vector
-        quint32 colorIndex = it->m12;
-        quint32 vectorSize = it->m20;
-
-        ++it;
-        const Color *color = &core()->colors()[colorIndex];
-
-        if (!onlyColor || (color == onlyColor)) {
-            AppearsInColor &vec = appearsHash[color];
-
-            for (quint32 i = 0; i < vectorSize; ++i, ++it) {
-                // 2nd level (color entry):   m12: quantity / m20: item index
-
-                int quantity = int(it->m12);
-                quint32 itemIndex = it->m20;
+BrickLink::Item::AppearsInRange BrickLink::Item::appearsInRange(const Color *onlyColor) const
+{
+    return AppearsInRange(appearsInRecords(), onlyColor);
+}
 
-                const Item *item = &core()->items()[itemIndex];
+BrickLink::Item::AppearsInIterator::AppearsInIterator(const AppearsInRecord *begin,
+                                                      const AppearsInRecord *end,
+                                                      const Color *onlyColor)
+    : m_current(begin)
+    , m_next(begin)
+    , m_end(end)
+    , m_onlyColor(onlyColor)
+{
+    advance();
+}
 
-                if (quantity)
-                    vec.append(qMakePair(quantity, item));
+void BrickLink::Item::AppearsInIterator::advance()
+{
+    while (m_next != m_end) {
+        if (!m_left) {
+            // 1st level (color header):  m12: color index / m20: size of 2nd level vector
+            const quint32 colorIndex = m_next->m12;
+            const quint32 vectorSize = m_next->m20;
+            ++m_next;
+
+            const Color *color = &core()->colors()[colorIndex];
+            if (m_onlyColor && (color != m_onlyColor)) {
+                m_next += vectorSize; // skip 2nd level
+            } else {
+                m_entry.color = color;
+                m_left = vectorSize;
             }
         } else {
-            it += vectorSize; // skip 2nd level
+            // 2nd level (color entry):   m12: quantity / m20: item index
+            const AppearsInRecord *record = m_next++;
+            --m_left;
+
+            if (record->m12) {
+                m_current = record;
+                m_entry.quantity = int(record->m12);
+                m_entry.item = &core()->items()[record->m20];
+                return;
+            }
         }
     }
-    return appearsHash;
-}
-
-void BrickLink::Item::setConsistsOf(const QVector<BrickLink::Item::ConsistsOf> &items)
-{
-    m_consists_of = items;
-    _qwords_for_consists += m_consists_of.size();
+    m_current = m_end;
 }
 
-const QVector<BrickLink::Item::ConsistsOf> &BrickLink::Item::consistsOf() const
+std::span<const BrickLink::Item::ConsistsOf> BrickLink::Item::consistsOf() const
 {
-    return m_consists_of;
+    return core()->database()->m_consistsOf.span().subspan(m_consistsOfOffset, m_consistsOfSize);
 }
 
 const BrickLink::ItemType *BrickLink::Item::itemType() const
@@ -120,16 +140,14 @@ bool BrickLink::Item::hasKnownColor(const Color *col) const
 {
     if (!col)
         return true;
-//    return std::find(m_knownColorIndexes.cbegin(), m_knownColorIndexes.cend(),
-//                     quint16(col - core()->colors().data())) != m_knownColorIndexes.cend();
-    return std::binary_search(m_knownColorIndexes.cbegin(), m_knownColorIndexes.cend(),
-                              quint16(col - core()->colors().data()));
+    const auto kci = knownColorIndexes();
+    return std::binary_search(kci.begin(), kci.end(), quint16(col - core()->colors().data()));
 }
 
 const QVector<const BrickLink::Color *> BrickLink::Item::knownColors() const
 {
     QVector<const Color *> result;
-    for (const quint16 idx : m_knownColorIndexes)
+    for (const quint16 idx : knownColorIndexes())
         result << &core()->colors()[idx];
     return result;
 }
@@ -141,7 +159,7 @@ uint BrickLink::Item::index() const
 
 const BrickLink::Item *BrickLink::Item::ConsistsOf::item() const
 {
-    return &core()->items().at(m_itemIndex);
+    return &core()->items()[m_itemIndex];
 }
 
 const BrickLink::Color *BrickLink::Item::ConsistsOf::color() const
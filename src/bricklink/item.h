@@ -13,6 +13,9 @@
 */
 #pragma once
 
+#include <iterator>
+#include <span>
+
 #include <QtCore/QMetaType>
 #include <QtCore/QString>
 #include <QtCore/QVector>
@@ -22,14 +25,19 @@
 #include "bricklink/color.h"
 #include "bricklink/itemtype.h"
 
+class tst_BrickStore;
+
 
 namespace BrickLink {
 
 class Item
 {
 public:
-    inline QByteArray id() const           { return m_id; }
-    inline QString name() const            { return m_name; }
+    QByteArray id() const;
+    QString name() const;
+    // allocation free views into the database's string pools
+    QLatin1String idView() const;
+    QStringView nameView() const;
     inline char itemTypeId() const         { return m_itemTypeId; }
     const ItemType *itemType() const;
     const Category *category() const;
@@ -41,7 +49,7 @@ public:
     bool hasKnownColor(const Color *col) const;
     const QVector<const Color *> knownColors() const;
 
-    AppearsIn appearsIn(const Color *color = nullptr) const;
+    AppearsIn appearsIn(const Color *color = nullptr) const; // convenience wrapper for appearsInRange()
 
     class ConsistsOf {
     public:
@@ -80,7 +88,7 @@ public:
     };
     Q_STATIC_ASSERT(sizeof(ConsistsOf) == 8);
 
-    const QVector<ConsistsOf> &consistsOf() const;
+    std::span<const ConsistsOf> consistsOf() const;
 
     uint index() const;   // only for internal use (picture/priceguide hashes)
 
@@ -88,17 +96,28 @@ public:
     Item(std::nullptr_t) : Item() { } // for scripting only!
 
 private:
-    QString    m_name;
-    QByteArray m_id;
+    // This is a fixed-size record that is memory mapped directly from the database file:
+    // all variable sized data lives in the Database's pools and is referenced by offset.
+    // Don't add any members with constructors and don't change the layout without also
+    // bumping the database version.
+    qint64     m_lastInventoryUpdate = -1;
+    quint32    m_idOffset = 0;          // Latin-1
+    quint32    m_nameOffset = 0;        // UTF-16
+    quint32    m_appearsInOffset = 0;
+    quint32    m_appearsInSize = 0;
+    quint32    m_consistsOfOffset = 0;
+    quint32    m_consistsOfSize = 0;
+    quint32    m_knownColorsOffset = 0;
+    float      m_weight = 0;
+    quint16    m_idSize = 0;
+    quint16    m_nameSize = 0;
+    quint16    m_knownColorsSize = 0;
     qint16     m_itemTypeIndex = -1;
     qint16     m_categoryIndex = -1;
     qint16     m_defaultColorIndex = -1;
-    char       m_itemTypeId; // the same itemType()->id()
+    char       m_itemTypeId = 0; // the same itemType()->id()
     quint8     m_year = 0;
-    qint64     m_lastInventoryUpdate = -1;
-    float      m_weight = 0;
-    // 4 bytes padding here
-    std::vector<quint16> m_knownColorIndexes;
+    quint16    m_reserved = 0; // explicit padding, so that the file contents are deterministic
 
     struct AppearsInRecord {
 #if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
@@ -111,23 +130,80 @@ private:
     };
     Q_STATIC_ASSERT(sizeof(AppearsInRecord) == 4);
 
-    std::vector<AppearsInRecord> m_appears_in;
-    QVector<ConsistsOf> m_consists_of;
+public:
+    struct AppearsInEntry {
+        const Color *color = nullptr;
+        int quantity = 0;
+        const Item *item = nullptr;
+    };
 
-private:
-    void setAppearsIn(const QHash<uint, QVector<QPair<int, uint>>> &appearHash);
-    void setConsistsOf(const QVector<ConsistsOf> &items);
+    // walks the packed appears-in records directly, without allocating anything
+    class AppearsInIterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = AppearsInEntry;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const AppearsInEntry *;
+        using reference = const AppearsInEntry &;
+
+        AppearsInIterator() = default;
+        AppearsInIterator(const AppearsInRecord *begin, const AppearsInRecord *end,
+                          const Color *onlyColor);
+
+        reference operator*() const   { return m_entry; }
+        pointer operator->() const    { return &m_entry; }
+        AppearsInIterator &operator++()  { advance(); return *this; }
+        AppearsInIterator operator++(int)  { auto it = *this; advance(); return it; }
+        bool operator==(const AppearsInIterator &other) const  { return m_current == other.m_current; }
+        bool operator!=(const AppearsInIterator &other) const  { return m_current != other.m_current; }
 
+    private:
+        void advance();
+
+        const AppearsInRecord *m_current = nullptr; // the record of m_entry
+        const AppearsInRecord *m_next = nullptr;
+        const AppearsInRecord *m_end = nullptr;
+        quint32 m_left = 0; // records left in the current color group
+        const Color *m_onlyColor = nullptr;
+        AppearsInEntry m_entry;
+    };
+
+    class AppearsInRange
+    {
+    public:
+        AppearsInRange(std::span<const AppearsInRecord> records, const Color *onlyColor)
+            : m_begin(records.data(), records.data() + records.size(), onlyColor)
+            , m_end(records.data() + records.size(), records.data() + records.size(), onlyColor)
+        { }
+        AppearsInIterator begin() const  { return m_begin; }
+        AppearsInIterator end() const    { return m_end; }
+        bool empty() const               { return m_begin == m_end; }
+
+    private:
+        AppearsInIterator m_begin;
+        AppearsInIterator m_end;
+    };
+
+    AppearsInRange appearsInRange(const Color *onlyColor = nullptr) const;
+
+private:
+    std::span<const AppearsInRecord> appearsInRecords() const;
+    std::span<const quint16> knownColorIndexes() const;
 
     static int compare(const Item **a, const Item **b);
-    static bool lessThan(const Item &item, const std::pair<char, QByteArray> &ids);
 
     friend class Core;
     friend class Database;
+    friend class ItemTextIndex;
     friend class ItemType;
     friend class TextImport;
+    friend class ::tst_BrickStore;
 };
 
+Q_STATIC_ASSERT(sizeof(Item) == 56);
+Q_STATIC_ASSERT(std::is_trivially_copyable_v<Item>);
+
 class Incomplete
 {
 public:
@@ -154,6 +154,10 @@ public:
     void save(QDataStream &ds) const;
     static Lot *restore(QDataStream &ds);
 
+    // index into the side tables of the DocumentModel owning this lot: never copied
+    int modelSlot() const              { return m_modelSlot; }
+    void setModelSlot(int slot)        { m_modelSlot = slot; }
+
 private:
     const Item * m_item;
     const Color *m_color;
@@ -192,6 +196,8 @@ private:
     QDateTime m_dateAdded;
     QDateTime m_dateLastSold;
 
+    int m_modelSlot = -1;
+
     friend class Core;
 };
 
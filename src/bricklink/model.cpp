@@ -11,6 +11,9 @@
 **
 ** See http://fsf.org/licensing/licenses/gpl.html for GPL licensing information.
 */
+#include <algorithm>
+#include <iterator>
+
 #include <QtCore/QBuffer>
 #include <QtCore/QStringBuilder>
 #include <QtCore/QThreadStorage>
@@ -44,6 +47,34 @@ BrickLink::ColorModel::ColorModel(QObject *parent)
     : StaticPointerModel(parent)
 {
     MODELTEST_ATTACH(this)
+
+    connect(core(), &Core::beginResetDatabase, this, &ColorModel::beginResetDatabase);
+    connect(core(), &Core::endResetDatabase, this, &ColorModel::endResetDatabase);
+}
+
+void BrickLink::ColorModel::beginResetDatabase()
+{
+    beginResetPointers();
+
+    m_reset_itemtype_id = m_itemtype_filter ? m_itemtype_filter->id() : 0;
+    m_itemtype_filter = nullptr;
+    m_reset_color_ids.clear();
+    for (const auto *color : qAsConst(m_color_filter))
+        m_reset_color_ids << color->id();
+    m_color_filter.clear();
+}
+
+void BrickLink::ColorModel::endResetDatabase()
+{
+    if (m_reset_itemtype_id)
+        m_itemtype_filter = core()->itemType(m_reset_itemtype_id);
+    for (uint colorId : qAsConst(m_reset_color_ids)) {
+        if (auto color = core()->color(colorId))
+            m_color_filter << color;
+    }
+    m_reset_color_ids.clear();
+
+    endResetPointers();
 }
 
 int BrickLink::ColorModel::columnCount(const QModelIndex &parent) const
@@ -233,6 +264,25 @@ BrickLink::CategoryModel::CategoryModel(QObject *parent)
     : StaticPointerModel(parent), m_itemtype_filter(nullptr), m_all_filter(false)
 {
     MODELTEST_ATTACH(this)
+
+    connect(core(), &Core::beginResetDatabase, this, &CategoryModel::beginResetDatabase);
+    connect(core(), &Core::endResetDatabase, this, &CategoryModel::endResetDatabase);
+}
+
+void BrickLink::CategoryModel::beginResetDatabase()
+{
+    beginResetPointers();
+
+    m_reset_itemtype_id = m_itemtype_filter ? m_itemtype_filter->id() : 0;
+    m_itemtype_filter = nullptr;
+}
+
+void BrickLink::CategoryModel::endResetDatabase()
+{
+    if (m_reset_itemtype_id)
+        m_itemtype_filter = core()->itemType(m_reset_itemtype_id);
+
+    endResetPointers();
 }
 
 int BrickLink::CategoryModel::columnCount(const QModelIndex &parent) const
@@ -353,6 +403,9 @@ BrickLink::ItemTypeModel::ItemTypeModel(QObject *parent)
     : StaticPointerModel(parent), m_inv_filter(false)
 {
     MODELTEST_ATTACH(this)
+
+    connect(core(), &Core::beginResetDatabase, this, [this]() { beginResetPointers(); });
+    connect(core(), &Core::endResetDatabase, this, [this]() { endResetPointers(); });
 }
 
 int BrickLink::ItemTypeModel::columnCount(const QModelIndex &parent) const
@@ -463,6 +516,45 @@ BrickLink::ItemModel::ItemModel(QObject *parent)
     }
 
     connect(core(), &Core::pictureUpdated, this, &ItemModel::pictureUpdated);
+    connect(core(), &Core::beginResetDatabase, this, &ItemModel::beginResetDatabase);
+    connect(core(), &Core::endResetDatabase, this, &ItemModel::endResetDatabase);
+}
+
+void BrickLink::ItemModel::beginResetDatabase()
+{
+    beginResetPointers();
+
+    m_reset_itemtype_id = m_itemtype_filter ? m_itemtype_filter->id() : 0;
+    m_reset_category_id = !m_category_filter ? uint(-1)
+                                             : (m_category_filter == CategoryModel::AllCategories)
+                                               ? uint(-2) : m_category_filter->id();
+    m_reset_color_id = m_color_filter ? m_color_filter->id() : uint(-1);
+
+    m_itemtype_filter = nullptr;
+    m_category_filter = nullptr;
+    m_color_filter = nullptr;
+    m_filter_appearsIn.clear();
+    m_filter_consistsOf.clear();
+    m_filter_ids.second.clear();
+    m_filter_candidates.clear();
+    m_filter_itemSets.clear();
+}
+
+void BrickLink::ItemModel::endResetDatabase()
+{
+    if (m_reset_itemtype_id)
+        m_itemtype_filter = core()->itemType(m_reset_itemtype_id);
+    if (m_reset_category_id == uint(-2))
+        m_category_filter = CategoryModel::AllCategories;
+    else if (m_reset_category_id != uint(-1))
+        m_category_filter = core()->category(m_reset_category_id);
+    if (m_reset_color_id != uint(-1))
+        m_color_filter = core()->color(m_reset_color_id);
+
+    // the item references in the filter text have to be resolved again
+    parseFilterText();
+
+    endResetPointers();
 }
 
 int BrickLink::ItemModel::columnCount(const QModelIndex &parent) const
@@ -477,12 +569,12 @@ int BrickLink::ItemModel::pointerCount() const
 
 const void *BrickLink::ItemModel::pointerAt(int index) const
 {
-    return &core()->items().at(size_t(index));
+    return &core()->items()[size_t(index)];
 }
 
 int BrickLink::ItemModel::pointerIndexOf(const void *pointer) const
 {
-    const auto &items = core()->items();
+    const auto items = core()->items();
     auto d = static_cast<const Item *>(pointer) - items.data();
     return (d >= 0 && d < int(items.size())) ? d : -1;
 }
@@ -590,13 +682,19 @@ void BrickLink::ItemModel::setFilterText(const QString &filter)
         return;
 
     m_text_filter = filter;
+    parseFilterText();
+    invalidateFilter();
+}
+
+void BrickLink::ItemModel::parseFilterText()
+{
     m_filter_text.clear();
     m_filter_appearsIn.clear();
     m_filter_consistsOf.clear();
     m_filter_ids.second.clear();
     m_filter_ids.first = false;
 
-    const QStringList sl = filter.simplified().split(' '_l1);
+    const QStringList sl = m_text_filter.simplified().split(' '_l1);
 
     QString quoted;
     bool quotedNegate = false;
@@ -669,7 +767,66 @@ void BrickLink::ItemModel::setFilterText(const QString &filter)
         }
     }
 
-    invalidateFilter();
+    // Resolve the appears-in and consists-of filters into sets of matching items once, instead of
+    // looking at the inventories of every single item in filterAccepts()
+    m_filter_itemSets.clear();
+    const auto items = core()->items();
+
+    for (const auto &a : qAsConst(m_filter_appearsIn)) {
+        // the appears-in data is generated from the non-extra parts of all inventories, so the
+        // inventory of the set or minifig is the exact reverse lookup
+        QBitArray matches(int(items.size()));
+        for (const auto &co : a.second->consistsOf()) {
+            if (!co.isExtra())
+                matches.setBit(int(co.item()->index()));
+        }
+        m_filter_itemSets << qMakePair(a.first, matches);
+    }
+    if (!m_filter_consistsOf.isEmpty()) {
+        // a single pass over all inventories resolves all consists-of filters at once
+        QVector<QBitArray> matches(m_filter_consistsOf.size(), QBitArray(int(items.size())));
+        for (size_t i = 0; i < items.size(); ++i) {
+            for (const auto &co : items[i].consistsOf()) {
+                for (int f = 0; f < m_filter_consistsOf.size(); ++f) {
+                    const auto &c = m_filter_consistsOf.at(f).second;
+                    if ((co.item() == c.first) && (!c.second || (co.color() == c.second)))
+                        matches[f].setBit(int(i));
+                }
+            }
+        }
+        for (int f = 0; f < m_filter_consistsOf.size(); ++f)
+            m_filter_itemSets << qMakePair(m_filter_consistsOf.at(f).first, matches.at(f));
+    }
+
+    // use the inverted index to narrow down the candidates for the (non-negated) text filters,
+    // so that filterAccepts() can reject most items without looking at their ids and names
+    m_filter_candidates.clear();
+    if (const auto *textIndex = core()->database()->itemTextIndex()) {
+        std::vector<quint32> candidates;
+        std::vector<quint32> termCandidates;
+        std::vector<quint32> intersection;
+        bool narrowed = false;
+
+        for (const auto &p : qAsConst(m_filter_text)) {
+            if (p.first || !textIndex->candidates(p.second, termCandidates))
+                continue;
+            if (!narrowed) {
+                candidates.swap(termCandidates);
+                narrowed = true;
+            } else {
+                intersection.clear();
+                std::set_intersection(candidates.cbegin(), candidates.cend(),
+                                      termCandidates.cbegin(), termCandidates.cend(),
+                                      std::back_inserter(intersection));
+                candidates.swap(intersection);
+            }
+        }
+        if (narrowed) {
+            m_filter_candidates = QBitArray(int(items.size()));
+            for (const quint32 i : candidates)
+                m_filter_candidates.setBit(int(i));
+        }
+    }
 }
 
 void BrickLink::ItemModel::setFilterWithoutInventory(bool b)
@@ -686,8 +843,10 @@ bool BrickLink::ItemModel::lessThan(const void *p1, const void *p2, int column)
     const Item *i1 = static_cast<const Item *>(p1);
     const Item *i2 = static_cast<const Item *>(p2);
 
-    return Utility::naturalCompare((column == 2) ? i1->name() : QLatin1String(i1->id()),
-                                   (column == 2) ? i2->name() : QLatin1String(i2->id())) < 0;
+    if (column == 2)
+        return Utility::naturalCompare(i1->nameView(), i2->nameView()) < 0;
+    else
+        return Utility::naturalCompare(i1->idView(), i2->idView()) < 0;
 }
 
 bool BrickLink::ItemModel::filterAccepts(const void *pointer) const
@@ -696,6 +855,8 @@ bool BrickLink::ItemModel::filterAccepts(const void *pointer) const
 
     if (!item)
         return false;
+    else if (!m_filter_candidates.isEmpty() && !m_filter_candidates.testBit(int(item->index())))
+        return false;
     else if (m_itemtype_filter && item->itemType() != m_itemtype_filter)
         return false;
     else if (m_category_filter && (m_category_filter != BrickLink::CategoryModel::AllCategories) && (item->category() != m_category_filter))
@@ -705,13 +866,30 @@ bool BrickLink::ItemModel::filterAccepts(const void *pointer) const
     else if (m_color_filter && !item->hasKnownColor(m_color_filter))
         return false;
     else {
-        const QString matchStr = QLatin1String(item->id()) % u' ' % item->name();
+        // Match the id and the name directly in the string pools, without allocating anything.
+        // Only quoted terms can contain spaces: these could match across id and name.
+        const QLatin1String id = item->idView();
+        const QStringView name = item->nameView();
+        QString matchStr;
 
         // .first is always "bool negate"
 
         bool match = true;
-        for (const auto &p : m_filter_text)
-            match = match && (matchStr.contains(p.second, Qt::CaseInsensitive) == !p.first); // contains() xor negate
+        for (const auto &p : m_filter_text) {
+            if (!match)
+                break;
+
+            bool found;
+            if (p.second.contains(u' ')) {
+                if (matchStr.isEmpty())
+                    matchStr = QString(id) % u' ' % name.toString();
+                found = matchStr.contains(p.second, Qt::CaseInsensitive);
+            } else {
+                found = id.contains(p.second, Qt::CaseInsensitive)
+                        || name.contains(p.second, Qt::CaseInsensitive);
+            }
+            match = (found == !p.first); // contains() xor negate
+        }
 
         bool idMatched = m_filter_ids.second.isEmpty();
         for (const auto &i : m_filter_ids.second) {
@@ -722,33 +900,9 @@ bool BrickLink::ItemModel::filterAccepts(const void *pointer) const
         }
         match = match && (idMatched == !m_filter_ids.first); // found xor negate
 
-        for (const auto &a : m_filter_appearsIn) {
-            bool found = false;
-            const auto appearsvec = item->appearsIn();
-            for (const AppearsInColor &vec : appearsvec) {
-                for (const AppearsInItem &ai : vec) {
-                    if (ai.second == a.second) {
-                        found = true;
-                        break;
-                    }
-                }
-                if (found)
-                    break;
-            }
-            match = match && (found == !a.first); // found xor negate
-        }
-        for (const auto &c : m_filter_consistsOf) {
-            bool found = false;
-            const auto &containslist = item->consistsOf();
-            for (const auto &ci : containslist) {
-                if ((ci.item() == c.second.first)
-                        && (!c.second.second || (ci.color() == c.second.second))) {
-                    found = true;
-                    break;
-                }
-            }
-            match = match && (found == !c.first); // found xor negate
-        }
+        const int itemIndex = int(item->index());
+        for (const auto &s : m_filter_itemSets)
+            match = match && (s.second.testBit(itemIndex) == !s.first); // found xor negate
 
         return match;
     }
@@ -780,18 +934,15 @@ BrickLink::InternalAppearsInModel::InternalAppearsInModel(const QVector<QPair<co
         if (!p.first)
             continue;
 
-        const auto appearsvec = p.first->appearsIn(p.second);
-        for (const AppearsInColor &vec : appearsvec) {
-            for (const AppearsInItem &item : vec) {
-                if (single_item) {
-                    m_items.append(new AppearsInItem(item.first, item.second));
-                } else {
-                    auto it = unique.find(item.second);
-                    if (it != unique.end())
-                        ++it.value();
-                    else if (first_item)
-                        unique.insert(item.second, 1);
-                }
+        for (const auto &entry : p.first->appearsInRange(p.second)) {
+            if (single_item) {
+                m_items.append(new AppearsInItem(entry.quantity, entry.item));
+            } else {
+                auto it = unique.find(entry.item);
+                if (it != unique.end())
+                    ++it.value();
+                else if (first_item)
+                    unique.insert(entry.item, 1);
             }
         }
         first_item = false;
@@ -800,6 +951,23 @@ BrickLink::InternalAppearsInModel::InternalAppearsInModel(const QVector<QPair<co
         if (it.value() >= list.count())
             m_items.append(new AppearsInItem(-1, it.key()));
     }
+
+    connect(core(), &Core::beginResetDatabase, this, &InternalAppearsInModel::beginResetDatabase);
+    connect(core(), &Core::endResetDatabase, this, &InternalAppearsInModel::endResetDatabase);
+}
+
+void BrickLink::InternalAppearsInModel::beginResetDatabase()
+{
+    // all the items we reference are gone after the reset
+    beginResetModel();
+    qDeleteAll(m_items);
+    m_items.clear();
+    m_appearsin.clear();
+}
+
+void BrickLink::InternalAppearsInModel::endResetDatabase()
+{
+    endResetModel();
 }
 
 BrickLink::InternalAppearsInModel::~InternalAppearsInModel()
@@ -923,10 +1091,10 @@ bool BrickLink::AppearsInModel::lessThan(const QModelIndex &left, const QModelIn
         switch (left.column()) {
         default:
         case  0: return ai1->first < ai2->first;
-        case  1: return (Utility::naturalCompare(QLatin1String(ai1->second->id()),
-                                                 QLatin1String(ai2->second->id())) < 0);
-        case  2: return (Utility::naturalCompare(ai1->second->name(),
-                                                 ai2->second->name()) < 0);
+        case  1: return (Utility::naturalCompare(ai1->second->idView(),
+                                                 ai2->second->idView()) < 0);
+        case  2: return (Utility::naturalCompare(ai1->second->nameView(),
+                                                 ai2->second->nameView()) < 0);
         }
     }
 }
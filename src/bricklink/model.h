@@ -15,6 +15,7 @@
 
 #include <QAbstractListModel>
 #include <QSortFilterProxyModel>
+#include <QBitArray>
 
 #include "bricklink/color.h"
 #include "bricklink/itemtype.h"
@@ -55,11 +56,18 @@ protected:
     bool lessThan(const void *pointer1, const void *pointer2, int column) const override;
 
 private:
+    void beginResetDatabase();
+    void endResetDatabase();
+
     const ItemType *m_itemtype_filter = nullptr;
     Color::Type m_type_filter {};
     qreal m_popularity_filter = 0;
     QVector<const Color *> m_color_filter;
 
+    // the filter pointers are saved as ids while the database is being reset
+    char m_reset_itemtype_id = 0;
+    QVector<uint> m_reset_color_ids;
+
     friend class Core;
 };
 
@@ -94,8 +102,12 @@ protected:
     bool lessThan(const void *pointer1, const void *pointer2, int column) const override;
 
 private:
+    void beginResetDatabase();
+    void endResetDatabase();
+
     const ItemType *m_itemtype_filter;
     bool m_all_filter;
+    char m_reset_itemtype_id = 0;
 
     friend class Core;
 };
@@ -168,14 +180,23 @@ protected:
     bool lessThan(const void *pointer1, const void *pointer2, int column) const override;
 
 private:
+    void parseFilterText();
+    void beginResetDatabase();
+    void endResetDatabase();
+
     const ItemType *m_itemtype_filter = nullptr;
     const Category *m_category_filter = nullptr;
     const Color *   m_color_filter = nullptr;
+    char            m_reset_itemtype_id = 0;
+    uint            m_reset_category_id = uint(-1);
+    uint            m_reset_color_id = uint(-1);
     QString         m_text_filter;
     QVector<QPair<bool, QString>> m_filter_text;
     QVector<QPair<bool, QPair<const Item *, const Color *>>> m_filter_consistsOf;
     QVector<QPair<bool, const Item *>> m_filter_appearsIn;
     QPair<bool, QVector<const Item *>> m_filter_ids;
+    QBitArray       m_filter_candidates; // from the ItemTextIndex, empty if not narrowed down
+    QVector<QPair<bool, QBitArray>> m_filter_itemSets; // the appears-in and consists-of filters
     bool            m_inv_filter = false;
     static QString  s_consistsOfPrefix;
     static QString  s_appearsInPrefix;
@@ -207,6 +228,9 @@ protected:
     InternalAppearsInModel(const QVector<QPair<const Item *, const Color *> > &list, QObject *parent);
     InternalAppearsInModel(const Item *item, const Color *color, QObject *parent);
 
+    void beginResetDatabase();
+    void endResetDatabase();
+
     AppearsIn m_appearsin;
     QVector<AppearsInItem *> m_items;
 
@@ -1064,6 +1064,7 @@ void Orders::startUpdateAddress(Order *order)
     url.setQuery(query);
 
     auto job = TransferJob::get(url);
+    job->setJobClass(TransferJob::Order);
     job->setUserData("address", order->id());
     m_addressJobs << job;
 
@@ -1182,6 +1183,7 @@ void Orders::startUpdateInternal(const QDate &fromDate, const QDate &toDate,
         url.setQuery(query);
 
         auto job = TransferJob::post(url);
+        job->setJobClass(TransferJob::Order);
         job->setUserData(type, true);
         m_jobs << job;
 
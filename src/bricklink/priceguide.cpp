@@ -12,12 +12,21 @@
 ** See http://fsf.org/licensing/licenses/gpl.html for GPL licensing information.
 */
 
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <type_traits>
+
 #include <QtCore/QScopedPointer>
 #include <QtCore/QLocale>
 #include <QtCore/QFile>
 #include <QtCore/QSaveFile>
-#include <QtCore/QTextStream>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QDataStream>
+#include <QtCore/QStringBuilder>
 #include <QtCore/QRegularExpression>
+#include <QtCore/QDebug>
 
 #include "bricklink/priceguide.h"
 #include "bricklink/core.h"
@@ -44,27 +53,8 @@ BrickLink::PriceGuide::~PriceGuide()
 
 void BrickLink::PriceGuide::saveToDisk(const QDateTime &fetched, const Data &data)
 {
-    QScopedPointer<QSaveFile> f(core()->dataSaveFile(u"priceguide.txt", m_item, m_color));
-
-    if (f && f->isOpen()) {
-        QTextStream ts(f.data());
-
-        ts << "# Price Guide for part #" << m_item->id() << " (" << m_item->name() << "), color #" << m_color->id() << " (" << m_color->name() << ")\n";
-        ts << "# last update: " << fetched.toString() << "\n#\n";
-
-        for (int ti = 0; ti < int(Time::Count); ti++) {
-            for (int ci = 0; ci < int(Condition::Count); ci++) {
-                ts << (ti == int(Time::PastSix) ? 'O' : 'I') << '\t' << (ci == int(Condition::New) ? 'N' : 'U') << '\t'
-                   << data.lots[ti][ci] << '\t'
-                   << data.quantities[ti][ci] << '\t'
-                   << QString::number(data.prices[ti][ci][int(Price::Lowest)], 'f', 3) << '\t'
-                   << QString::number(data.prices[ti][ci][int(Price::Average)], 'f', 3) << '\t'
-                   << QString::number(data.prices[ti][ci][int(Price::WAverage)], 'f', 3) << '\t'
-                   << QString::number(data.prices[ti][ci][int(Price::Highest)], 'f', 3) << '\n';
-            }
-        }
-        f->commit();
-    }
+    if (auto *store = core()->priceGuideStore())
+        store->save(m_item, m_color, fetched, data);
 }
 
 bool BrickLink::PriceGuide::loadFromDisk(QDateTime &fetched, Data &data) const
@@ -72,31 +62,57 @@ bool BrickLink::PriceGuide::loadFromDisk(QDateTime &fetched, Data &data) const
     if (!m_item || !m_color)
         return false;
 
-    QScopedPointer<QFile> f(core()->dataReadFile(u"priceguide.txt", m_item, m_color));
+    auto *store = core()->priceGuideStore();
+    return store && store->load(m_item, m_color, fetched, data);
+}
 
-    if (f && f->isOpen()) {
-        if (parse(f->readAll(), data)) {
-            fetched = f->fileTime(QFileDevice::FileModificationTime);
-            return true;
-        }
-    }
-    return false;
+template <typename T> static T parseNumber(const char *first, const char *last)
+{
+    T value = { };
+#if !defined(__cpp_lib_to_chars) || (__cpp_lib_to_chars < 201611L)
+    // not every standard library supports from_chars for floating point numbers yet
+    if constexpr (std::is_floating_point_v<T>)
+        value = T(QByteArray::fromRawData(first, int(last - first)).toDouble());
+    else
+#endif
+        std::from_chars(first, last, value);
+    return value;
 }
 
-bool BrickLink::PriceGuide::parse(const QByteArray &ba, Data &result) const
+bool BrickLink::PriceGuide::parse(const QByteArray &ba, Data &result)
 {
     result = { };
 
-    QTextStream ts(ba);
-    QString line;
+    const char *p = ba.constData();
+    const char *end = p + ba.size();
+
+    for (const char *eol; p < end; p = eol + 1) {
+        eol = static_cast<const char *>(memchr(p, '\n', size_t(end - p)));
+        if (!eol)
+            eol = end;
 
-    while (!(line = ts.readLine()).isNull()) {
-        if (line.isEmpty() || (line[0] == '#'_l1) || (line[0] == '\r'_l1))         // skip comments fast
+        const char *last = eol;
+        if ((last > p) && (last[-1] == '\r'))
+            --last;
+        if ((last == p) || (*p == '#'))         // skip comments fast
             continue;
 
-        QStringList sl = line.split('\t'_l1, Qt::KeepEmptyParts);
+        std::pair<const char *, const char *> fields[8];
+        int fieldCount = 0;
+
+        for (const char *field = p, *c = p; ; ++c) {
+            if ((c == last) || (*c == '\t')) {
+                if (fieldCount < 8)
+                    fields[fieldCount] = { field, c };
+                ++fieldCount;
+                field = c + 1;
+                if (c == last)
+                    break;
+            }
+        }
 
-        if ((sl.count() != 8) || (sl[0].length() != 1) || (sl[1].length() != 1)) {             // sanity check
+        if ((fieldCount != 8) || ((fields[0].second - fields[0].first) != 1)
+                || ((fields[1].second - fields[1].first) != 1)) {             // sanity check
             continue;
         }
 
@@ -104,7 +120,7 @@ bool BrickLink::PriceGuide::parse(const QByteArray &ba, Data &result) const
         int ci = -1;
         bool oldformat = false;
 
-        switch (sl[0][0].toLatin1()) {
+        switch (*fields[0].first) {
         case 'P': oldformat = true;
                   Q_FALLTHROUGH();
         case 'O': ti = int(Time::PastSix);
@@ -115,18 +131,21 @@ bool BrickLink::PriceGuide::parse(const QByteArray &ba, Data &result) const
                   break;
         }
 
-        switch (sl[1][0].toLatin1()) {
+        switch (*fields[1].first) {
         case 'N': ci = int(Condition::New);  break;
         case 'U': ci = int(Condition::Used); break;
         }
 
         if ((ti != -1) && (ci != -1)) {
-            result.lots[ti][ci]                         = sl[oldformat ? 3 : 2].toInt();
-            result.quantities[ti][ci]                   = sl[oldformat ? 2 : 3].toInt();
-            result.prices[ti][ci][int(Price::Lowest)]   = sl[4].toDouble();
-            result.prices[ti][ci][int(Price::Average)]  = sl[5].toDouble();
-            result.prices[ti][ci][int(Price::WAverage)] = sl[6].toDouble();
-            result.prices[ti][ci][int(Price::Highest)]  = sl[7].toDouble();
+            const auto &lots = fields[oldformat ? 3 : 2];
+            const auto &quantities = fields[oldformat ? 2 : 3];
+
+            result.lots[ti][ci]                         = parseNumber<int>(lots.first, lots.second);
+            result.quantities[ti][ci]                   = parseNumber<int>(quantities.first, quantities.second);
+            result.prices[ti][ci][int(Price::Lowest)]   = parseNumber<double>(fields[4].first, fields[4].second);
+            result.prices[ti][ci][int(Price::Average)]  = parseNumber<double>(fields[5].first, fields[5].second);
+            result.prices[ti][ci][int(Price::WAverage)] = parseNumber<double>(fields[6].first, fields[6].second);
+            result.prices[ti][ci][int(Price::Highest)]  = parseNumber<double>(fields[7].first, fields[7].second);
         }
     }
     return true;
@@ -208,3 +227,315 @@ void BrickLink::PriceGuide::cancelUpdate()
     if (core())
         core()->cancelPriceGuideUpdate(this);
 }
+
+
+static const quint32 PriceGuideStoreMagic = 0x47505342; // 'BSPG'
+static const quint32 PriceGuideStoreVersion = 2; // 2: added the flags to the header
+static const qint64 PriceGuideStoreFlagsOffset = 8;
+static const quint32 PriceGuideStoreMigratedFlag = 0x01; // the priceguide.txt files are imported
+// fetched (qint64), lots and quantities (qint32), prices (double)
+static const int PriceGuideStoreDataSize = 8
+        + 2 * 4 * int(BrickLink::Time::Count) * int(BrickLink::Condition::Count)
+        + 8 * int(BrickLink::Time::Count) * int(BrickLink::Condition::Count) * int(BrickLink::Price::Count);
+
+static void setupDataStream(QDataStream &ds)
+{
+    ds.setVersion(QDataStream::Qt_5_11);
+    ds.setByteOrder(QDataStream::LittleEndian);
+    ds.setFloatingPointPrecision(QDataStream::DoublePrecision);
+}
+
+BrickLink::PriceGuideStore::PriceGuideStore(const QString &fileName, const QString &legacyDataDir)
+    : m_fileName(fileName)
+{
+    if (open()) {
+        compact();
+        if (!(m_flags & PriceGuideStoreMigratedFlag))
+            migrateTextFiles(legacyDataDir);
+    }
+}
+
+QByteArray BrickLink::PriceGuideStore::key(const Item *item, const Color *color)
+{
+    // the in-memory cache key uses the item index, which is not stable across database updates
+    return QByteArray(1, item->itemTypeId()) % item->id() % '@' % QByteArray::number(color->id());
+}
+
+void BrickLink::PriceGuideStore::writeRecord(QDataStream &ds, const QByteArray &key,
+                                             const QDateTime &fetched, const PriceGuide::Data &data)
+{
+    ds << key << qint64(fetched.toMSecsSinceEpoch());
+
+    for (int ti = 0; ti < int(Time::Count); ti++) {
+        for (int ci = 0; ci < int(Condition::Count); ci++) {
+            ds << qint32(data.lots[ti][ci]) << qint32(data.quantities[ti][ci]);
+            for (int pi = 0; pi < int(Price::Count); pi++)
+                ds << data.prices[ti][ci][pi];
+        }
+    }
+}
+
+bool BrickLink::PriceGuideStore::open()
+{
+    m_index.clear();
+    m_recordCount = 0;
+    m_flags = 0;
+    m_needsRewrite = false;
+
+    m_file.setFileName(m_fileName);
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qWarning() << "BrickLink::PriceGuideStore failed to open" << m_fileName << ":"
+                   << m_file.errorString();
+        return false;
+    }
+
+    QDataStream ds(&m_file);
+    setupDataStream(ds);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 flags = 0;
+    ds >> magic >> version;
+    if (version >= 2)
+        ds >> flags;
+
+    if ((ds.status() != QDataStream::Ok) || (magic != PriceGuideStoreMagic)
+            || (version < 1) || (version > PriceGuideStoreVersion)) {
+        // empty or incompatible: this is just a cache, so simply start over
+        m_file.resize(0);
+        m_file.seek(0);
+        ds.resetStatus();
+        ds << PriceGuideStoreMagic << PriceGuideStoreVersion << m_flags;
+        return m_file.flush() && (ds.status() == QDataStream::Ok);
+    }
+    m_flags = flags;
+    // version 1 files only differ in the header: compact() rewrites them
+    m_needsRewrite = (version != PriceGuideStoreVersion);
+
+    qint64 pos = m_file.pos();
+    while (!ds.atEnd()) {
+        QByteArray k;
+        ds >> k;
+        if ((ds.status() != QDataStream::Ok)
+                || (ds.skipRawData(PriceGuideStoreDataSize) != PriceGuideStoreDataSize)) {
+            break;
+        }
+        m_index.insert(k, pos);
+        ++m_recordCount;
+        pos = m_file.pos();
+    }
+    // a crash while appending may have left an incomplete record at the end
+    if (pos != m_file.size())
+        m_file.resize(pos);
+    return true;
+}
+
+bool BrickLink::PriceGuideStore::readRecord(QIODevice *dev, qint64 offset, QDateTime &fetched,
+                                            PriceGuide::Data &data)
+{
+    if (!dev->seek(offset))
+        return false;
+
+    QDataStream ds(dev);
+    setupDataStream(ds);
+
+    QByteArray k;
+    qint64 msecs = 0;
+    ds >> k >> msecs;
+
+    for (int ti = 0; ti < int(Time::Count); ti++) {
+        for (int ci = 0; ci < int(Condition::Count); ci++) {
+            qint32 lots = 0, quantity = 0;
+            ds >> lots >> quantity;
+            data.lots[ti][ci] = lots;
+            data.quantities[ti][ci] = quantity;
+            for (int pi = 0; pi < int(Price::Count); pi++)
+                ds >> data.prices[ti][ci][pi];
+        }
+    }
+    fetched = QDateTime::fromMSecsSinceEpoch(msecs);
+    return (ds.status() == QDataStream::Ok);
+}
+
+bool BrickLink::PriceGuideStore::load(const Item *item, const Color *color, QDateTime &fetched,
+                                      PriceGuide::Data &data)
+{
+    if (!item || !color)
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+    auto it = m_index.constFind(key(item, color));
+    return (it != m_index.cend()) && readRecord(&m_file, *it, fetched, data);
+}
+
+void BrickLink::PriceGuideStore::load(std::vector<Entry> &entries)
+{
+    std::vector<std::pair<qint64, size_t>> offsets;
+    offsets.reserve(entries.size());
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        for (size_t i = 0; i < entries.size(); ++i) {
+            auto &entry = entries[i];
+            entry.valid = false;
+            if (entry.item && entry.color) {
+                auto it = m_index.constFind(key(entry.item, entry.color));
+                if (it != m_index.cend())
+                    offsets.emplace_back(*it, i);
+            }
+        }
+    }
+    if (offsets.empty())
+        return;
+
+    // Records are only ever appended and are complete before they are indexed, so each batch
+    // can read through its own file handle without blocking the other loader threads.
+    QFile f(m_fileName);
+    if (!f.open(QIODevice::ReadOnly))
+        return;
+
+    // read in file order
+    std::sort(offsets.begin(), offsets.end());
+
+    for (const auto &[offset, i] : offsets) {
+        auto &entry = entries[i];
+        entry.valid = readRecord(&f, offset, entry.fetched, entry.data);
+    }
+}
+
+bool BrickLink::PriceGuideStore::save(const Item *item, const Color *color,
+                                      const QDateTime &fetched, const PriceGuide::Data &data)
+{
+    if (!item || !color)
+        return false;
+
+    const QByteArray k = key(item, color);
+    QByteArray record;
+    {
+        QDataStream ds(&record, QIODevice::WriteOnly);
+        setupDataStream(ds);
+        writeRecord(ds, k, fetched, data);
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_file.isOpen())
+        return false;
+
+    qint64 offset = m_file.size();
+    if (!m_file.seek(offset) || (m_file.write(record) != record.size()) || !m_file.flush()) {
+        qWarning() << "BrickLink::PriceGuideStore failed to write to" << m_fileName << ":"
+                   << m_file.errorString();
+        m_file.resize(offset);
+        return false;
+    }
+    m_index.insert(k, offset);
+    ++m_recordCount;
+    return true;
+}
+
+void BrickLink::PriceGuideStore::migrateTextFiles(const QString &dataDir)
+{
+    // Price guides used to be saved as one text file per item and color in
+    // <item type>/<hash>/<item id>/<color id>/priceguide.txt: move all of them into the store
+    // at once, so that a price guide missing from the store never needs a file system lookup.
+    if (!m_file.isOpen() || m_needsRewrite || dataDir.isEmpty())
+        return;
+
+    QByteArray buffer;
+    QDataStream ds(&buffer, QIODevice::WriteOnly);
+    setupDataStream(ds);
+    std::vector<std::pair<QByteArray, qint64>> imported;
+    QStringList fileNames;
+
+    const QDir dir(dataDir);
+    QDirIterator it(dataDir, { "priceguide.txt"_l1 }, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString fileName = it.next();
+        const auto parts = dir.relativeFilePath(fileName).split(u'/');
+        bool colorOk = false;
+        if ((parts.size() != 5) || (parts.at(0).size() != 1) || parts.at(2).isEmpty())
+            continue;
+        parts.at(3).toUInt(&colorOk);
+        if (!colorOk)
+            continue;
+
+        const QByteArray k = parts.at(0).toLatin1() % parts.at(2).toLatin1() % '@'
+                % parts.at(3).toLatin1();
+        fileNames << fileName;
+        if (m_index.contains(k))
+            continue; // already superseded by a newer download
+
+        QFile f(fileName);
+        PriceGuide::Data data;
+        if (!f.open(QIODevice::ReadOnly) || !PriceGuide::parse(f.readAll(), data))
+            continue;
+
+        imported.emplace_back(k, ds.device()->pos());
+        writeRecord(ds, k, f.fileTime(QFileDevice::FileModificationTime), data);
+    }
+
+    qint64 offset = m_file.size();
+    if (!buffer.isEmpty()) {
+        if (!m_file.seek(offset) || (m_file.write(buffer) != buffer.size()) || !m_file.flush()) {
+            qWarning() << "BrickLink::PriceGuideStore failed to write to" << m_fileName << ":"
+                       << m_file.errorString();
+            m_file.resize(offset);
+            return;
+        }
+        for (const auto &[k, recordOffset] : imported)
+            m_index.insert(k, offset + recordOffset);
+        m_recordCount += int(imported.size());
+    }
+
+    QDataStream fds(&m_file);
+    setupDataStream(fds);
+    m_file.seek(PriceGuideStoreFlagsOffset);
+    fds << (m_flags | PriceGuideStoreMigratedFlag);
+    if (!m_file.flush() || (fds.status() != QDataStream::Ok)) {
+        qWarning() << "BrickLink::PriceGuideStore failed to write to" << m_fileName << ":"
+                   << m_file.errorString();
+        return;
+    }
+    m_flags |= PriceGuideStoreMigratedFlag;
+
+    // only remove the old files once the store is safely written
+    for (const auto &fileName : std::as_const(fileNames))
+        QFile::remove(fileName);
+}
+
+void BrickLink::PriceGuideStore::compact()
+{
+    // only rewrite the file if more than half of it consists of outdated records
+    if (!m_needsRewrite && ((m_recordCount < 1000) || ((m_index.size() * 2) > m_recordCount)))
+        return;
+
+    std::vector<std::pair<qint64, QByteArray>> offsets;
+    offsets.reserve(size_t(m_index.size()));
+    for (auto it = m_index.cbegin(); it != m_index.cend(); ++it)
+        offsets.emplace_back(it.value(), it.key());
+    std::sort(offsets.begin(), offsets.end());
+
+    QByteArray buffer;
+    {
+        QDataStream ds(&buffer, QIODevice::WriteOnly);
+        setupDataStream(ds);
+        ds << PriceGuideStoreMagic << PriceGuideStoreVersion << m_flags;
+
+        for (const auto &[offset, k] : offsets) {
+            QDateTime fetched;
+            PriceGuide::Data data;
+            if (readRecord(&m_file, offset, fetched, data))
+                writeRecord(ds, k, fetched, data);
+        }
+    }
+    m_file.close();
+
+    QSaveFile f(m_fileName);
+    if (!f.open(QIODevice::WriteOnly) || (f.write(buffer) != buffer.size()) || !f.commit()) {
+        qWarning() << "BrickLink::PriceGuideStore failed to compact" << m_fileName << ":"
+                   << f.errorString();
+    }
+    open();
+}
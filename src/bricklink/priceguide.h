@@ -13,12 +13,19 @@
 */
 #pragma once
 
+#include <vector>
+
 #include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
 
 #include "global.h"
 #include "utility/ref.h"
 
+QT_FORWARD_DECLARE_CLASS(QDataStream)
 class TransferJob;
+class tst_BrickStore;
 
 
 namespace BrickLink {
@@ -70,11 +77,57 @@ private:
     bool loadFromDisk(QDateTime &fetched, Data &data) const;
     void saveToDisk(const QDateTime &fetched, const Data &data);
 
-    bool parse(const QByteArray &ba, Data &result) const;
+    static bool parse(const QByteArray &ba, Data &result);
     bool parseHtml(const QByteArray &ba, Data &result);
 
     friend class Core;
     friend class PriceGuideLoaderJob;
+    friend class PriceGuideBatchLoaderJob;
+    friend class PriceGuideStore;
+    friend class ::tst_BrickStore;
+};
+
+
+// All price guides are kept in one append-only file: each record holds the item type and id,
+// the color id, the fetch time and the fixed size PriceGuide::Data. The offset of the newest
+// record per price guide is indexed when the file is opened.
+// The old priceguide.txt files in the data directory are imported once, when the store is
+// created: the header records that, so a missing price guide never touches the file system.
+class PriceGuideStore
+{
+public:
+    explicit PriceGuideStore(const QString &fileName, const QString &legacyDataDir = { });
+
+    struct Entry {
+        const Item *item = nullptr;
+        const Color *color = nullptr;
+        bool valid = false;
+        QDateTime fetched;
+        PriceGuide::Data data;
+    };
+
+    bool load(const Item *item, const Color *color, QDateTime &fetched, PriceGuide::Data &data);
+    void load(std::vector<Entry> &entries);
+    bool save(const Item *item, const Color *color, const QDateTime &fetched,
+              const PriceGuide::Data &data);
+
+private:
+    static QByteArray key(const Item *item, const Color *color);
+    static void writeRecord(QDataStream &ds, const QByteArray &key, const QDateTime &fetched,
+                            const PriceGuide::Data &data);
+    bool open();
+    void migrateTextFiles(const QString &dataDir);
+    static bool readRecord(QIODevice *dev, qint64 offset, QDateTime &fetched,
+                           PriceGuide::Data &data);
+    void compact();
+
+    QString m_fileName;
+    QMutex m_mutex;
+    QFile m_file;
+    QHash<QByteArray, qint64> m_index;
+    int m_recordCount = 0;
+    quint32 m_flags = 0;
+    bool m_needsRewrite = false;
 };
 
 } // namespace BrickLink
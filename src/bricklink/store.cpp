@@ -99,6 +99,7 @@ bool BrickLink::Store::startUpdate()
     url.setQuery(query);
 
     m_job = TransferJob::post(url);
+    m_job->setJobClass(TransferJob::Inventory);
     core()->retrieveAuthenticated(m_job);
     return true;
 }
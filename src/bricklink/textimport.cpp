@@ -27,12 +27,22 @@
 #include "bricklink/partcolorcode.h"
 #include "bricklink/changelogentry.h"
 
+extern int _dwords_for_appears;
+extern int _qwords_for_consists;
+
+
+static bool importItemLessThan(const BrickLink::TextImport::ImportItem &ii,
+                               const std::pair<char, QByteArray> &ids)
+{
+    int d = (ii.m_item.itemTypeId() - ids.first);
+    return d == 0 ? (ii.m_id.compare(ids.second) < 0) : (d < 0);
+}
 
 int BrickLink::TextImport::findItemIndex(char tid, const QByteArray &id) const
 {
     auto needle = std::make_pair(tid, id);
-    auto it = std::lower_bound(m_items.cbegin(), m_items.cend(), needle, Item::lessThan);
-    if ((it != m_items.cend()) && (it->itemTypeId() == tid) && (it->id() == id))
+    auto it = std::lower_bound(m_items.cbegin(), m_items.cend(), needle, importItemLessThan);
+    if ((it != m_items.cend()) && (it->m_item.itemTypeId() == tid) && (it->m_id == id))
         return std::distance(m_items.cbegin(), it);
     return -1;
 }
@@ -198,16 +208,18 @@ void BrickLink::TextImport::readItems(const QString &path, BrickLink::ItemType *
 {
     XmlHelpers::ParseXML p(path, "CATALOG", "ITEM");
     p.parse([this, &p, itt](QDomElement e) {
-        Item item;
-        item.m_id = p.elementText(e, "ITEMID").toLatin1();
-        item.m_name = p.elementText(e, "ITEMNAME");
+        ImportItem ii;
+        ii.m_id = p.elementText(e, "ITEMID").toLatin1();
+        ii.m_name = p.elementText(e, "ITEMNAME");
+
+        Item &item = ii.m_item;
         item.m_itemTypeIndex = (itt - m_item_types.data());
         item.m_itemTypeId = itt->id();
 
         uint catId = p.elementText(e, "CATEGORY").toUInt();
         item.m_categoryIndex = findCategoryIndex(catId);
         if (item.m_categoryIndex == -1)
-            throw ParseException("item %1 has no category").arg(QLatin1String(item.m_id));
+            throw ParseException("item %1 has no category").arg(QLatin1String(ii.m_id));
 
         // calculate the item-type -> category relation
         auto &catv = itt->m_categoryIndexes;
@@ -232,11 +244,11 @@ void BrickLink::TextImport::readItems(const QString &path, BrickLink::ItemType *
             item.m_defaultColorIndex = -1;
         }
 
-        m_items.push_back(item);
+        m_items.push_back(ii);
     });
 
-    std::sort(m_items.begin(), m_items.end(), [](const auto &item1, const auto &item2) {
-        return Item::lessThan(item1, std::make_pair(item2.itemTypeId(), item2.id()));
+    std::sort(m_items.begin(), m_items.end(), [](const auto &ii1, const auto &ii2) {
+        return importItemLessThan(ii1, std::make_pair(ii2.m_item.itemTypeId(), ii2.m_id));
     });
 }
 
@@ -290,17 +302,19 @@ bool BrickLink::TextImport::importInventories(std::vector<bool> &processedInvs)
         if (processedInvs[i]) // already yanked
             continue;
 
-        if (!m_items[i].hasInventory() || readInventory(&m_items[i]))
+        if (!m_items[i].m_item.hasInventory() || readInventory(i))
             processedInvs[i] = true;
     }
     return true;
 }
 
-bool BrickLink::TextImport::readInventory(const Item *item)
+bool BrickLink::TextImport::readInventory(uint itemIndex)
 {
-    std::unique_ptr<QFile> f(BrickLink::core()->dataReadFile(u"inventory.xml", item));
+    const ImportItem &ii = m_items[itemIndex];
+    std::unique_ptr<QFile> f(BrickLink::core()->dataReadFile(u"inventory.xml", ii.m_item.itemTypeId(),
+                                                             ii.m_id));
 
-    if (!f || !f->isOpen() || (f->fileTime(QFileDevice::FileModificationTime) < item->inventoryUpdated()))
+    if (!f || !f->isOpen() || (f->fileTime(QFileDevice::FileModificationTime) < ii.m_item.inventoryUpdated()))
         return false;
 
     QVector<Item::ConsistsOf> inventory;
@@ -337,8 +351,6 @@ bool BrickLink::TextImport::readInventory(const Item *item)
             addToKnownColors(itemIndex, colorIndex);
         });
 
-        uint itemIndex = item - items().data();;
-
         for (const Item::ConsistsOf &co : qAsConst(inventory)) {
             if (!co.m_extra) {
                 auto &vec = m_appears_in_hash[co.m_itemIndex][co.m_colorIndex];
@@ -441,7 +453,7 @@ void BrickLink::TextImport::readInventoryList(const QString &path)
                     t = dt.toSecsSinceEpoch();
                 }
             }
-            Item &item = m_items[itemIndex];
+            Item &item = m_items[itemIndex].m_item;
             item.m_lastInventoryUpdate = t;
             ItemType &itemType = m_item_types[item.m_itemTypeIndex];
             itemType.m_has_inventories = true;
@@ -512,20 +524,74 @@ void BrickLink::TextImport::exportTo(Database *db)
     std::swap(db->m_colors, m_colors);
     std::swap(db->m_itemTypes, m_item_types);
     std::swap(db->m_categories, m_categories);
-    std::swap(db->m_items, m_items);
     std::swap(db->m_pccs, m_pccs);
     std::swap(db->m_itemChangelog, m_itemChangelog);
     std::swap(db->m_colorChangelog, m_colorChangelog);
+    Database::buildColorIndexes(db->m_colors, db->m_colorNameIndex, db->m_colorLDrawIndex);
 
-    for (auto it = m_consists_of_hash.cbegin(); it != m_consists_of_hash.cend(); ++it) {
-        Item &item = db->m_items[it.key()];
-        item.setConsistsOf(it.value());
-    }
+    // move the variable sized item data into the pools
+    std::vector<Item> items;
+    std::vector<char> ids;
+    std::vector<char16_t> names;
+    std::vector<Item::AppearsInRecord> appearsIn;
+    std::vector<Item::ConsistsOf> consistsOf;
+    std::vector<quint16> knownColors;
+
+    items.reserve(m_items.size());
+
+    for (uint itemIndex = 0; itemIndex < m_items.size(); ++itemIndex) {
+        const ImportItem &ii = m_items[itemIndex];
+        Item item = ii.m_item;
+
+        item.m_idOffset = quint32(ids.size());
+        item.m_idSize = quint16(ii.m_id.size());
+        ids.insert(ids.end(), ii.m_id.cbegin(), ii.m_id.cend());
 
-    for (auto it = m_appears_in_hash.cbegin(); it != m_appears_in_hash.cend(); ++it) {
-        Item &item = db->m_items[it.key()];
-        item.setAppearsIn(it.value());
+        item.m_nameOffset = quint32(names.size());
+        item.m_nameSize = quint16(ii.m_name.size());
+        names.insert(names.end(), ii.m_name.utf16(), ii.m_name.utf16() + ii.m_name.size());
+
+        item.m_knownColorsOffset = quint32(knownColors.size());
+        item.m_knownColorsSize = quint16(ii.m_knownColorIndexes.size());
+        knownColors.insert(knownColors.end(), ii.m_knownColorIndexes.cbegin(),
+                           ii.m_knownColorIndexes.cend());
+
+        const auto inventory = m_consists_of_hash.value(itemIndex);
+        item.m_consistsOfOffset = quint32(consistsOf.size());
+        item.m_consistsOfSize = quint32(inventory.size());
+        consistsOf.insert(consistsOf.end(), inventory.cbegin(), inventory.cend());
+        _qwords_for_consists += inventory.size();
+
+        // color-idx -> { vector < qty, item-idx > }
+        // we are compacting a "hash of a vector of pairs" down to a list of 32bit integers
+        const auto appearHash = m_appears_in_hash.value(itemIndex);
+        item.m_appearsInOffset = quint32(appearsIn.size());
+
+        for (auto it = appearHash.cbegin(); it != appearHash.cend(); ++it) {
+            const auto &colorVector = it.value();
+
+            appearsIn.push_back({ it.key() /*colorIndex*/, uint(colorVector.size()) /*vectorSize*/ });
+
+            for (auto vecIt = colorVector.cbegin(); vecIt != colorVector.cend(); ++vecIt)
+                appearsIn.push_back({ uint(vecIt->first) /*quantity*/, vecIt->second /*itemIndex*/ });
+        }
+        item.m_appearsInSize = quint32(appearsIn.size() - item.m_appearsInOffset);
+        _dwords_for_appears += int(item.m_appearsInSize);
+
+        items.push_back(item);
     }
+
+    // the background text index build still reads from the old arrays
+    db->finishItemTextIndex();
+    db->m_itemTextIndex.reset();
+    db->m_items = DatabaseArray<Item>(std::move(items));
+    db->m_itemIds = DatabaseArray<char>(std::move(ids));
+    db->m_itemNames = DatabaseArray<char16_t>(std::move(names));
+    db->m_appearsIn = DatabaseArray<Item::AppearsInRecord>(std::move(appearsIn));
+    db->m_consistsOf = DatabaseArray<Item::ConsistsOf>(std::move(consistsOf));
+    db->m_knownColors = DatabaseArray<quint16>(std::move(knownColors));
+    db->m_mappedFile.reset();
+    db->m_itemIndex = Database::buildItemIndex(db->m_items.span(), db->m_itemIds.span());
 }
 
 void BrickLink::TextImport::calculateColorPopularity()
@@ -545,10 +611,9 @@ void BrickLink::TextImport::calculateColorPopularity()
 
 void BrickLink::TextImport::addToKnownColors(int itemIndex, int colorIndex)
 {
-    Item &item = m_items[itemIndex];
-    auto it = std::lower_bound(item.m_knownColorIndexes.begin(), item.m_knownColorIndexes.end(),
-                               colorIndex);
-    if ((it == item.m_knownColorIndexes.end()) || (*it != colorIndex))
-        item.m_knownColorIndexes.insert(it, colorIndex);
+    auto &kci = m_items[itemIndex].m_knownColorIndexes;
+    auto it = std::lower_bound(kci.begin(), kci.end(), colorIndex);
+    if ((it == kci.end()) || (*it != colorIndex))
+        kci.insert(it, colorIndex);
 }
 
@@ -38,7 +38,17 @@ public:
 
     bool importInventories(std::vector<bool> &processedInvs);
 
-    const std::vector<Item> &items() const { return m_items; }
+    // Items are fixed-size records referencing the database's pools, so we have to keep the
+    // variable sized data separate while importing
+    struct ImportItem
+    {
+        Item m_item;
+        QByteArray m_id;
+        QString m_name;
+        std::vector<quint16> m_knownColorIndexes;
+    };
+
+    const std::vector<ImportItem> &items() const { return m_items; }
 
 private:
     void readColors(const QString &path);
@@ -46,7 +56,7 @@ private:
     void readItemTypes(const QString &path);
     void readItems(const QString &path, ItemType *itt);
     void readPartColorCodes(const QString &path);
-    bool readInventory(const Item *item);
+    bool readInventory(uint itemIndex);
     void readLDrawColors(const QString &path);
     void readInventoryList(const QString &path);
     void readChangeLog(const QString &path);
@@ -62,7 +72,7 @@ private:
     std::vector<Color>         m_colors;
     std::vector<ItemType>      m_item_types;
     std::vector<Category>      m_categories;
-    std::vector<Item>          m_items;
+    std::vector<ImportItem>    m_items;
     std::vector<QByteArray>    m_changelog;
     std::vector<ItemChangeLogEntry>  m_itemChangelog;
     std::vector<ColorChangeLogEntry> m_colorChangelog;
@@ -618,6 +618,32 @@ void Config::setVisualChangesMarkModified(bool b)
     }
 }
 
+bool Config::liveSortFilter() const
+{
+    return value("General/LiveSortFilter"_l1, false).toBool();
+}
+
+void Config::setLiveSortFilter(bool b)
+{
+    if (liveSortFilter() != b) {
+        setValue("General/LiveSortFilter"_l1, b);
+        emit liveSortFilterChanged(b);
+    }
+}
+
+int Config::undoMemoryLimit() const
+{
+    return qMax(0, value("General/UndoMemoryLimit"_l1, 1024).toInt());
+}
+
+void Config::setUndoMemoryLimit(int megaBytes)
+{
+    if (undoMemoryLimit() != megaBytes) {
+        setValue("General/UndoMemoryLimit"_l1, qMax(0, megaBytes));
+        emit undoMemoryLimitChanged(megaBytes);
+    }
+}
+
 bool Config::restoreLastSession() const
 {
     return value("General/RestoreLastSession"_l1, true).toBool();
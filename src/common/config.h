@@ -79,6 +79,12 @@ public:
     bool visualChangesMarkModified() const;
     void setVisualChangesMarkModified(bool b);
 
+    bool liveSortFilter() const;
+    void setLiveSortFilter(bool b);
+
+    int undoMemoryLimit() const; // in MB, 0 == unlimited
+    void setUndoMemoryLimit(int megaBytes);
+
     bool restoreLastSession() const;
     void setRestoreLastSession(bool b);
 
@@ -187,6 +193,8 @@ signals:
     void showInputErrorsChanged(bool b);
     void showDifferenceIndicatorsChanged(bool b);
     void visualChangesMarkModifiedChanged(bool b);
+    void liveSortFilterChanged(bool b);
+    void undoMemoryLimitChanged(int megaBytes);
     void updateIntervalsChanged(const QMap<QByteArray, int> &intervals);
     void onlineStatusChanged(bool b);
     void recentFilesChanged(const QStringList &recent);
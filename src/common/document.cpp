@@ -33,6 +33,7 @@
 #include "bricklink/store.h"
 #include "utility/currency.h"
 #include "utility/exception.h"
+#include "utility/undo.h"
 #include "utility/utility.h"
 #include "actionmanager.h"
 #include "config.h"
@@ -247,11 +248,22 @@ Document::Document(DocumentModel *model, const QByteArray &columnsState, QObject
 
     connect(BrickLink::core(), &BrickLink::Core::priceGuideUpdated,
             this, &Document::priceGuideUpdated);
+    connect(BrickLink::core(), &BrickLink::Core::priceGuidesLoaded,
+            this, &Document::priceGuidesUpdated);
 
     updateItemFlagsMask();
 
     connect(model->undoStack(), &QUndoStack::indexChanged,
                this, [this]() { m_autosaveClean = false; });
+    connect(model->undoStack(), &UndoStack::oldestCommandsDropped,
+            this, [this](int count) {
+        // only tell once per document: from now on this happens on (almost) every change
+        if (m_undoDropNotified)
+            return;
+        m_undoDropNotified = true;
+        UIHelpers::information(tr("The undo history of %1 exceeded the memory limit of %2 MB.<br /><br />The oldest %n step(s) have been removed.",
+                                  nullptr, count).arg(title()).arg(Config::inst()->undoMemoryLimit()));
+    });
     connect(&m_autosaveTimer, &QTimer::timeout,
             this, &Document::autosave);
     m_autosaveTimer.start(1min);
@@ -481,6 +493,13 @@ Document::~Document()
     m_autosaveTimer.stop();
     deleteAutosave();
 
+    if (m_setToPG) {
+        for (auto it = m_setToPG->priceGuides.cbegin(); it != m_setToPG->priceGuides.cend(); ++it) {
+            for (int i = 0; i < it.value().size(); ++i)
+                it.key()->release();
+        }
+    }
+
     delete m_model;
     //qWarning() << "~" << this;
 }
@@ -928,8 +947,8 @@ void Document::setStockroom(BrickLink::Stockroom stockroom)
 
 void Document::setPrice(double price)
 {
-    applyTo(selectedLots(), [price](const auto &from, auto &to) {
-        (to = from).setPrice(price); return true;
+    applyToColumns(selectedLots(), { DocumentModel::Price }, [price](auto &columns) {
+        std::fill(columns[0].begin(), columns[0].end(), price);
     });
 }
 
@@ -951,8 +970,15 @@ void Document::setPriceToGuide(BrickLink::Time time, BrickLink::Price price, boo
     m_setToPG->price = price;
     m_setToPG->currencyRate = Currency::inst()->rate(m_model->currencyCode());
 
-    for (Lot *item : sel) {
-        BrickLink::PriceGuide *pg = BrickLink::core()->priceGuide(item->item(), item->color());
+    QVector<QPair<const BrickLink::Item *, const BrickLink::Color *>> itemsAndColors;
+    itemsAndColors.reserve(sel.size());
+    for (const Lot *lot : sel)
+        itemsAndColors.append({ lot->item(), lot->color() });
+    const auto pgs = BrickLink::core()->priceGuides(itemsAndColors);
+
+    for (int i = 0; i < sel.size(); ++i) {
+        Lot *item = sel.at(i);
+        BrickLink::PriceGuide *pg = pgs.at(i);
 
         if (pg && (forceUpdate || !pg->isValid())
                 && (pg->updateStatus() != BrickLink::UpdateStatus::Updating)) {
@@ -961,8 +987,9 @@ void Document::setPriceToGuide(BrickLink::Time time, BrickLink::Price price, boo
 
         if (pg && ((pg->updateStatus() == BrickLink::UpdateStatus::Loading)
                    || (pg->updateStatus() == BrickLink::UpdateStatus::Updating))) {
-            m_setToPG->priceGuides.insert(pg, item);
-            pg->addRef();
+            // keep the reference we got from priceGuides() until applyPriceGuide()
+            m_setToPG->priceGuides[pg].append(item);
+            pg = nullptr;
 
         } else if (pg && pg->isValid()) {
             double price = pg->price(m_setToPG->time, item->condition(), m_setToPG->price)
@@ -985,48 +1012,77 @@ void Document::setPriceToGuide(BrickLink::Time time, BrickLink::Price price, boo
             ++m_setToPG->doneCount;
             emit blockingOperationProgress(m_setToPG->doneCount, m_setToPG->totalCount);
         }
+        if (pg)
+            pg->release(); // applied or failed right away
     }
 
     setBlockingOperationTitle(tr("Downloading price guide data from BrickLink"));
     setBlockingOperationCancelCallback(std::bind(&Document::cancelPriceGuideUpdates, this));
 
-    if (m_setToPG->priceGuides.isEmpty())
-        priceGuideUpdated(nullptr);
+    finishSetPriceToGuide();
 }
 
 void Document::priceGuideUpdated(BrickLink::PriceGuide *pg)
 {
-    if (m_setToPG && pg) {
-        const auto lots = m_setToPG->priceGuides.values(pg);
-
-        if (lots.isEmpty())
-            return; // not a PG requested by us
-        if (pg->updateStatus() == BrickLink::UpdateStatus::Updating)
-            return; // loaded now, but still needs an online update
+    // The guides loaded in a batch are also announced one by one after the batch: they have
+    // already been handled in priceGuidesUpdated() and are not in the map anymore. Online
+    // updates (and reloads after a database reset) however only arrive here.
+    if (m_setToPG && pg && applyPriceGuide(pg)) {
+        emit blockingOperationProgress(m_setToPG->doneCount, m_setToPG->totalCount);
+        finishSetPriceToGuide();
+    }
+}
 
-        for (auto lot : lots) {
-            if (!m_setToPG->canceled) {
-                double price = pg->isValid() ? (pg->price(m_setToPG->time, lot->condition(),
-                                                          m_setToPG->price) * m_setToPG->currencyRate)
-                                             : 0;
+void Document::priceGuidesUpdated(const QVector<BrickLink::PriceGuide *> &pgs)
+{
+    if (!m_setToPG)
+        return;
 
-                if (!qFuzzyCompare(price, lot->price())) {
-                    Lot newLot = *lot;
-                    newLot.setPrice(price);
-                    m_setToPG->changes.emplace_back(lot, newLot);
-                }
-            }
-            pg->release();
-        }
+    int doneCount = 0;
+    for (BrickLink::PriceGuide *pg : pgs)
+        doneCount += applyPriceGuide(pg);
 
-        m_setToPG->doneCount += lots.size();
+    if (doneCount) {
         emit blockingOperationProgress(m_setToPG->doneCount, m_setToPG->totalCount);
+        finishSetPriceToGuide();
+    }
+}
+
+int Document::applyPriceGuide(BrickLink::PriceGuide *pg)
+{
+    auto it = m_setToPG->priceGuides.find(pg);
 
-        if (!pg->isValid() || (pg->updateStatus() == BrickLink::UpdateStatus::UpdateFailed))
-            m_setToPG->failCount += lots.size();
-        m_setToPG->priceGuides.remove(pg);
+    if (it == m_setToPG->priceGuides.end())
+        return 0; // not a PG requested by us
+    if (pg->updateStatus() == BrickLink::UpdateStatus::Updating)
+        return 0; // loaded now, but still needs an online update
+
+    const LotList lots = it.value();
+    m_setToPG->priceGuides.erase(it);
+
+    for (auto lot : lots) {
+        if (!m_setToPG->canceled) {
+            double price = pg->isValid() ? (pg->price(m_setToPG->time, lot->condition(),
+                                                      m_setToPG->price) * m_setToPG->currencyRate)
+                                         : 0;
+
+            if (!qFuzzyCompare(price, lot->price())) {
+                Lot newLot = *lot;
+                newLot.setPrice(price);
+                m_setToPG->changes.emplace_back(lot, newLot);
+            }
+        }
+        pg->release();
     }
 
+    m_setToPG->doneCount += lots.size();
+    if (!pg->isValid() || (pg->updateStatus() == BrickLink::UpdateStatus::UpdateFailed))
+        m_setToPG->failCount += lots.size();
+    return int(lots.size());
+}
+
+void Document::finishSetPriceToGuide()
+{
     if (m_setToPG && m_setToPG->priceGuides.isEmpty()
             && (m_setToPG->doneCount == m_setToPG->totalCount)) {
         int failCount = m_setToPG->failCount;
@@ -1053,7 +1109,7 @@ void Document::cancelPriceGuideUpdates()
 {
     if (m_setToPG) {
         m_setToPG->canceled = true;
-        const auto pgs = m_setToPG->priceGuides.uniqueKeys();
+        const auto pgs = m_setToPG->priceGuides.keys();
         for (BrickLink::PriceGuide *pg : pgs) {
             if (pg->updateStatus() == BrickLink::UpdateStatus::Updating)
                 pg->cancelUpdate();
@@ -1064,13 +1120,12 @@ void Document::cancelPriceGuideUpdates()
 
 void Document::roundPrice()
 {
-    applyTo(selectedLots(), [](const auto &from, auto &to) {
-        double price = int(from.price() * 100 + .5) / 100.;
-        if (!qFuzzyCompare(price, from.price())) {
-            (to = from).setPrice(price);
-            return true;
+    applyToColumns(selectedLots(), { DocumentModel::Price }, [](auto &columns) {
+        for (double &price : columns[0]) {
+            double rounded = int(price * 100 + .5) / 100.;
+            if (!qFuzzyCompare(rounded, price))
+                price = rounded;
         }
-        return false;
     });
 }
 
@@ -1081,39 +1136,29 @@ void Document::priceAdjust(bool isFixed, double value, bool applyToTiers)
 
     double factor = isFixed ? 0 : (1.+ value / 100.);
 
-    applyTo(selectedLots(), [=](const auto &from, auto &to) {
-        double price = from.price();
-
-        if (isFixed)
-            price += value;
-        else
-            price *= factor;
-
-        if (!qFuzzyCompare(price, from.price())) {
-            (to = from).setPrice(price);
+    QVector<DocumentModel::Field> fields { DocumentModel::Price };
+    if (applyToTiers)
+        fields << DocumentModel::TierP1 << DocumentModel::TierP2 << DocumentModel::TierP3;
 
-            if (applyToTiers) {
-                for (int i = 0; i < 3; i++) {
-                    price = from.tierPrice(i);
+    applyToColumns(selectedLots(), fields, [=](auto &columns) {
+        auto adjust = [=](double price) { return isFixed ? (price + value) : (price * factor); };
+        auto &prices = columns[0];
 
-                    if (isFixed)
-                        price += value;
-                    else
-                        price *= factor;
-
-                    to.setTierPrice(i, price);
-                }
-            }
-            return true;
+        for (size_t i = 0; i < prices.size(); ++i) {
+            double price = adjust(prices[i]);
+            if (qFuzzyCompare(price, prices[i]))
+                continue;
+            prices[i] = price;
+            for (int t = 1; t < columns.size(); ++t)
+                columns[t][i] = adjust(columns[t][i]);
         }
-        return false;
     });
 }
 
 void Document::setCost(double cost)
 {
-    applyTo(m_selectedLots, [cost](const auto &from, auto &to) {
-        (to = from).setCost(cost); return true;
+    applyToColumns(m_selectedLots, { DocumentModel::Cost }, [cost](auto &columns) {
+        std::fill(columns[0].begin(), columns[0].end(), cost);
     });
 }
 
@@ -1131,22 +1176,24 @@ void Document::spreadCost(double spreadAmount, SpreadCost how)
     if (qFuzzyCompare(f, 1))
         return;
 
-    applyTo(selectedLots(), [=](const auto &from, auto &to) {
-        (to = from).setCost(f * ((how == SpreadCost::ByPrice) ? from.price()
-                                                              : from.weight()));
-        return true;
+    const auto sel = selectedLots();
+    applyToColumns(sel, { DocumentModel::Cost }, [=](auto &columns) {
+        auto &costs = columns[0];
+        for (size_t i = 0; i < costs.size(); ++i) {
+            const Lot *lot = sel.at(int(i));
+            costs[i] = f * ((how == SpreadCost::ByPrice) ? lot->price() : lot->weight());
+        }
     });
 }
 
 void Document::roundCost()
 {
-    applyTo(selectedLots(), [](const auto &from, auto &to) {
-        double cost = int(from.cost() * 100 + .5) / 100.;
-        if (!qFuzzyCompare(cost, from.cost())) {
-            (to = from).setCost(cost);
-            return true;
+    applyToColumns(selectedLots(), { DocumentModel::Cost }, [](auto &columns) {
+        for (double &cost : columns[0]) {
+            double rounded = int(cost * 100 + .5) / 100.;
+            if (!qFuzzyCompare(rounded, cost))
+                cost = rounded;
         }
-        return false;
     });
 }
 
@@ -1157,19 +1204,12 @@ void Document::costAdjust(bool isFixed, double value)
 
     double factor = isFixed ? 0 : (1.+ value / 100.);
 
-    applyTo(selectedLots(), [=](const auto &from, auto &to) {
-        double cost = from.cost();
-
-        if (isFixed)
-            cost += value;
-        else
-            cost *= factor;
-
-        if (!qFuzzyCompare(cost, from.cost())) {
-            (to = from).setCost(cost);
-            return true;
+    applyToColumns(selectedLots(), { DocumentModel::Cost }, [=](auto &columns) {
+        for (double &cost : columns[0]) {
+            double adjusted = isFixed ? (cost + value) : (cost * factor);
+            if (!qFuzzyCompare(adjusted, cost))
+                cost = adjusted;
         }
-        return false;
     });
 }
 
@@ -1193,8 +1233,9 @@ void Document::divideQuantity(int divisor)
         return;
     }
 
-    applyTo(selectedLots(), [=](const auto &from, auto &to) {
-        (to = from).setQuantity(from.quantity() / divisor); return true;
+    applyToColumns(selectedLots(), { DocumentModel::Quantity }, [=](auto &columns) {
+        for (double &quantity : columns[0])
+            quantity = int(quantity) / divisor;
     });
 }
 
@@ -1217,8 +1258,9 @@ void Document::multiplyQuantity(int factor)
         return;
     }
 
-    applyTo(selectedLots(), [=](const auto &from, auto &to) {
-        (to = from).setQuantity(from.quantity() * factor); return true;
+    applyToColumns(selectedLots(), { DocumentModel::Quantity }, [=](auto &columns) {
+        for (double &quantity : columns[0])
+            quantity *= factor;
     });
 }
 
@@ -1226,22 +1268,22 @@ void Document::multiplyQuantity(int factor)
 
 void Document::setSale(int sale)
 {
-    applyTo(selectedLots(), [sale](const auto &from, auto &to) {
-        (to = from).setSale(sale); return true;
+    applyToColumns(selectedLots(), { DocumentModel::Sale }, [sale](auto &columns) {
+        std::fill(columns[0].begin(), columns[0].end(), qBound(-99, sale, 100));
     });
 }
 
 void Document::setBulkQuantity(int qty)
 {
-    applyTo(selectedLots(), [qty](const auto &from, auto &to) {
-        (to = from).setBulkQuantity(qty); return true;
+    applyToColumns(selectedLots(), { DocumentModel::Bulk }, [qty](auto &columns) {
+        std::fill(columns[0].begin(), columns[0].end(), qMax(1, qty));
     });
 }
 
 void Document::setQuantity(int quantity)
 {
-    applyTo(selectedLots(), [quantity](const auto &from, auto &to) {
-        (to = from).setQuantity(quantity); return true;
+    applyToColumns(selectedLots(), { DocumentModel::Quantity }, [quantity](auto &columns) {
+        std::fill(columns[0].begin(), columns[0].end(), quantity);
     });
 }
 
@@ -1582,10 +1624,10 @@ Document *Document::fromPartInventory(const BrickLink::Item *item,
 {
     Q_ASSERT(item);
     Q_ASSERT(item && item->hasInventory());
-    Q_ASSERT(item && !item->consistsOf().isEmpty());
+    Q_ASSERT(item && !item->consistsOf().empty());
     Q_ASSERT(multiply != 0);
 
-    const auto &parts = item->consistsOf();
+    const auto parts = item->consistsOf();
     BrickLink::IO::ParseResult pr;
 
     for (const BrickLink::Item::ConsistsOf &part : parts) {
@@ -1723,6 +1765,15 @@ void Document::applyTo(const LotList &lots, std::function<bool(const Lot &, Lot
     model()->applyTo(lots, callback, actionText);
 }
 
+void Document::applyToColumns(const LotList &lots, const QVector<DocumentModel::Field> &fields,
+                              std::function<void(DocumentModel::FieldColumns &)> callback)
+{
+    QString actionText;
+    if (auto a = qobject_cast<QAction *>(sender()))
+        actionText = a->text();
+    model()->applyToColumns(lots, fields, callback, actionText);
+}
+
 
 void Document::copyFields(const LotList &srcLots, DocumentModel::MergeMode defaultMergeMode,
                           const QHash<DocumentModel::Field, DocumentModel::MergeMode> &fieldMergeModes)
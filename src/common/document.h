@@ -294,7 +294,12 @@ signals:
 private:
     QString actionText() const;
     void applyTo(const LotList &lots, std::function<bool(const Lot &, Lot &)> callback);
+    void applyToColumns(const LotList &lots, const QVector<DocumentModel::Field> &fields,
+                        std::function<void(DocumentModel::FieldColumns &)> callback);
     void priceGuideUpdated(BrickLink::PriceGuide *pg);
+    void priceGuidesUpdated(const QVector<BrickLink::PriceGuide *> &pgs);
+    int applyPriceGuide(BrickLink::PriceGuide *pg);
+    void finishSetPriceToGuide();
     void cancelPriceGuideUpdates();
     enum ExportCheckMode {
         ExportToFile = 0,
@@ -331,7 +336,7 @@ private:
     struct SetToPriceGuideData
     {
         std::vector<std::pair<Lot *, Lot>> changes;
-        QMultiHash<BrickLink::PriceGuide *, Lot *>    priceGuides;
+        QHash<BrickLink::PriceGuide *, LotList>       priceGuides;
         int              failCount = 0;
         int              doneCount = 0;
         int              totalCount = 0;
@@ -358,6 +363,7 @@ private:
     QTimer                m_autosaveTimer;
     mutable bool          m_autosaveClean = true;
     bool                  m_restoredFromAutosave = false;
+    bool                  m_undoDropNotified = false;
 
     static std::function<QObject *(Document *)> s_qmlLotsFactory;
     QPointer<QObject>     m_qmlLots;
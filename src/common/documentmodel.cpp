@@ -13,6 +13,8 @@
 */
 #include <utility>
 #include <algorithm>
+#include <numeric>
+#include <iterator>
 #if defined(BS_HAS_PARALLEL_STL) && __has_include(<execution>)
 #  include <execution>
 #  if (__cpp_lib_execution >= 201603) && (__cpp_lib_parallel_algorithm >= 201603)
@@ -27,6 +29,7 @@
 #include <QTimer>
 #include <QStringBuilder>
 #include <QtConcurrentFilter>
+#include <QtConcurrentMap>
 #include <QtAlgorithms>
 #include <QStringListModel>
 
@@ -151,6 +154,99 @@ private:
     }
 };
 
+// the accessors for DocumentModel::isNumericField() fields, used by the column based bulk edits
+static double numericFieldValue(const Lot *lot, DocumentModel::Field field)
+{
+    switch (field) {
+    case DocumentModel::Quantity: return lot->quantity();
+    case DocumentModel::Bulk    : return lot->bulkQuantity();
+    case DocumentModel::Sale    : return lot->sale();
+    case DocumentModel::Price   : return lot->price();
+    case DocumentModel::Cost    : return lot->cost();
+    case DocumentModel::TierQ1  : return lot->tierQuantity(0);
+    case DocumentModel::TierQ2  : return lot->tierQuantity(1);
+    case DocumentModel::TierQ3  : return lot->tierQuantity(2);
+    case DocumentModel::TierP1  : return lot->tierPrice(0);
+    case DocumentModel::TierP2  : return lot->tierPrice(1);
+    case DocumentModel::TierP3  : return lot->tierPrice(2);
+    default: Q_ASSERT(false); return 0;
+    }
+}
+
+static void setNumericFieldValue(Lot *lot, DocumentModel::Field field, double value)
+{
+    switch (field) {
+    case DocumentModel::Quantity: lot->setQuantity(qRound(value)); break;
+    case DocumentModel::Bulk    : lot->setBulkQuantity(qRound(value)); break;
+    case DocumentModel::Sale    : lot->setSale(qRound(value)); break;
+    case DocumentModel::Price   : lot->setPrice(value); break;
+    case DocumentModel::Cost    : lot->setCost(value); break;
+    case DocumentModel::TierQ1  : lot->setTierQuantity(0, qRound(value)); break;
+    case DocumentModel::TierQ2  : lot->setTierQuantity(1, qRound(value)); break;
+    case DocumentModel::TierQ3  : lot->setTierQuantity(2, qRound(value)); break;
+    case DocumentModel::TierP1  : lot->setTierPrice(0, value); break;
+    case DocumentModel::TierP2  : lot->setTierPrice(1, value); break;
+    case DocumentModel::TierP3  : lot->setTierPrice(2, value); break;
+    default: Q_ASSERT(false); break;
+    }
+}
+
+// the fields that a currency change converts: CurrencyCmd stores one column per field
+static const DocumentModel::Field currencyFields[] = {
+    DocumentModel::Cost, DocumentModel::Price,
+    DocumentModel::TierP1, DocumentModel::TierP2, DocumentModel::TierP3,
+};
+
+// the fields that ChangeCmd can record as single values instead of complete lot copies
+static const DocumentModel::Field fieldChangeFields[] = {
+    DocumentModel::Status, DocumentModel::Condition, DocumentModel::Quantity,
+    DocumentModel::Price, DocumentModel::Cost, DocumentModel::Bulk, DocumentModel::Sale,
+    DocumentModel::Comments, DocumentModel::Remarks, DocumentModel::TierQ1,
+    DocumentModel::TierP1, DocumentModel::TierQ2, DocumentModel::TierP2,
+    DocumentModel::TierQ3, DocumentModel::TierP3, DocumentModel::LotId,
+    DocumentModel::Retain, DocumentModel::Stockroom, DocumentModel::Reserved,
+    DocumentModel::Weight,
+};
+
+static void readFieldChange(const Lot *lot, DocumentModel::FieldChange &fc)
+{
+    switch (fc.field) {
+    case DocumentModel::Comments : fc.text = lot->comments(); break;
+    case DocumentModel::Remarks  : fc.text = lot->remarks(); break;
+    case DocumentModel::Reserved : fc.text = lot->reserved(); break;
+    case DocumentModel::Status   : fc.number = int(lot->status()); break;
+    case DocumentModel::Condition: fc.number = int(lot->condition()); break;
+    case DocumentModel::Stockroom: fc.number = int(lot->stockroom()); break;
+    case DocumentModel::Retain   : fc.number = lot->retain() ? 1 : 0; break;
+    case DocumentModel::LotId    : fc.number = lot->lotId(); break;
+    case DocumentModel::Weight   : fc.number = lot->hasCustomWeight() ? lot->weight() : 0; break;
+    default                      : fc.number = numericFieldValue(lot, fc.field); break;
+    }
+}
+
+static void writeFieldChange(Lot *lot, const DocumentModel::FieldChange &fc)
+{
+    switch (fc.field) {
+    case DocumentModel::Comments : lot->setComments(fc.text); break;
+    case DocumentModel::Remarks  : lot->setRemarks(fc.text); break;
+    case DocumentModel::Reserved : lot->setReserved(fc.text); break;
+    case DocumentModel::Status   : lot->setStatus(BrickLink::Status(int(fc.number))); break;
+    case DocumentModel::Condition: lot->setCondition(BrickLink::Condition(int(fc.number))); break;
+    case DocumentModel::Stockroom: lot->setStockroom(BrickLink::Stockroom(int(fc.number))); break;
+    case DocumentModel::Retain   : lot->setRetain(fc.number != 0); break;
+    case DocumentModel::LotId    : lot->setLotId(uint(fc.number)); break;
+    case DocumentModel::Weight   : lot->setWeight(fc.number); break;
+    default                      : setNumericFieldValue(lot, fc.field, fc.number); break;
+    }
+}
+
+// the heap usage of a lot copy, ignoring implicit sharing
+static qint64 lotMemoryUsage(const Lot &lot)
+{
+    return qint64(sizeof(Lot)) + qint64(sizeof(QChar)) * (lot.comments().size() + lot.remarks().size()
+                                                           + lot.reserved().size() + lot.markerText().size());
+}
+
 
 ///////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////
@@ -162,6 +258,7 @@ enum {
     CID_AddRemove,
     CID_Currency,
     CID_ResetDifferenceMode,
+    CID_ColumnChange,
     CID_Sort,
     CID_Filter,
 
@@ -172,7 +269,7 @@ enum {
 AddRemoveCmd::AddRemoveCmd(Type t, DocumentModel *model, const QVector<int> &positions,
                            const QVector<int> &sortedPositions,
                            const QVector<int> &filteredPositions, const LotList &lots)
-    : QUndoCommand(genDesc(t == Add, qMax(lots.count(), positions.count())))
+    : UndoCommand(genDesc(t == Add, qMax(lots.count(), positions.count())))
     , m_model(model)
     , m_positions(positions)
     , m_sortedPositions(sortedPositions)
@@ -200,6 +297,17 @@ int AddRemoveCmd::id() const
     return CID_AddRemove;
 }
 
+qint64 AddRemoveCmd::memoryUsage() const
+{
+    qint64 size = qint64(sizeof(*this)) + qint64(sizeof(int)) * (m_positions.size() + m_sortedPositions.size()
+                                                                   + m_filteredPositions.size());
+    if (m_type == Add) { // we own the lots
+        for (const Lot *lot : m_lots)
+            size += lotMemoryUsage(*lot);
+    }
+    return size;
+}
+
 void AddRemoveCmd::redo()
 {
     if (m_type == Add) {
@@ -241,12 +349,44 @@ QString AddRemoveCmd::genDesc(bool is_add, int count)
 QTimer *ChangeCmd::s_eventLoopCounter = nullptr;
 
 ChangeCmd::ChangeCmd(DocumentModel *model, const std::vector<std::pair<Lot *, Lot>> &changes, DocumentModel::Field hint)
-    : QUndoCommand()
+    : UndoCommand()
     , m_model(model)
     , m_hint(hint)
-    , m_changes(changes)
 {
-    std::sort(m_changes.begin(), m_changes.end(), [](const auto &a, const auto &b) {
+    for (const auto &change : changes) {
+        Lot *lot = change.first;
+        int slot = m_model->lotSlot(lot);
+
+        if (slot >= 0) {
+            // record every supported field that differs, then check if that covers the change
+            Lot probe = change.second;
+            const auto first = m_fieldChanges.size();
+
+            for (const auto field : fieldChangeFields) {
+                DocumentModel::FieldChange oldValue { slot, field, 0, { } };
+                DocumentModel::FieldChange newValue { slot, field, 0, { } };
+                readFieldChange(lot, oldValue);
+                readFieldChange(&change.second, newValue);
+
+                if ((oldValue.number != newValue.number) || (oldValue.text != newValue.text)) {
+                    m_fieldChanges.push_back(newValue);
+                    writeFieldChange(&probe, oldValue);
+                }
+            }
+            if ((probe == *lot) && (probe.alternate() == lot->alternate())
+                    && (probe.alternateId() == lot->alternateId())
+                    && (probe.counterPart() == lot->counterPart())) {
+                continue;
+            }
+            m_fieldChanges.resize(first);
+        }
+        m_lotChanges.emplace_back(change);
+    }
+
+    std::sort(m_fieldChanges.begin(), m_fieldChanges.end(), [](const auto &a, const auto &b) {
+        return (a.slot < b.slot) || ((a.slot == b.slot) && (a.field < b.field));
+    });
+    std::sort(m_lotChanges.begin(), m_lotChanges.end(), [](const auto &a, const auto &b) {
         return a.first < b.first;
     });
 
@@ -269,9 +409,14 @@ ChangeCmd::ChangeCmd(DocumentModel *model, const std::vector<std::pair<Lot *, Lo
 
 void ChangeCmd::updateText()
 {
+    int count = int(m_lotChanges.size());
+    for (size_t i = 0; i < m_fieldChanges.size(); ++i) {
+        if (!i || (m_fieldChanges[i].slot != m_fieldChanges[i - 1].slot))
+            ++count;
+    }
+
     //: Generic undo/redo text for table edits: %1 == column name (e.g. "Price")
-    setText(QCoreApplication::translate("ChangeCmd", "Modified %1 on %Ln item(s)", nullptr,
-                                        int(m_changes.size()))
+    setText(QCoreApplication::translate("ChangeCmd", "Modified %1 on %Ln item(s)", nullptr, count)
             //: Generic undo/redo text for table edits: if more than one column was edited at once
             .arg((m_hint < DocumentModel::FieldCount) ? m_model->headerData(m_hint, Qt::Horizontal).toString()
                                                  : QCoreApplication::translate("ChangeCmd", "multiple fields")));
@@ -282,19 +427,59 @@ int ChangeCmd::id() const
     return CID_Change;
 }
 
+bool ChangeCmd::hasFieldChanges(int slot) const
+{
+    auto it = std::lower_bound(m_fieldChanges.cbegin(), m_fieldChanges.cend(), slot,
+                               [](const auto &fc, int s) { return fc.slot < s; });
+    return (it != m_fieldChanges.cend()) && (it->slot == slot);
+}
+
+bool ChangeCmd::hasLotChange(const Lot *lot) const
+{
+    auto it = std::lower_bound(m_lotChanges.cbegin(), m_lotChanges.cend(), lot,
+                               [](const auto &change, const Lot *l) { return change.first < l; });
+    return (it != m_lotChanges.cend()) && (it->first == lot);
+}
+
 bool ChangeCmd::mergeWith(const QUndoCommand *other)
 {
     if (other->id() == id()) {
         auto *otherChange = static_cast<const ChangeCmd *>(other);
         if ((m_loopCount == otherChange->m_loopCount) && (m_hint == otherChange->m_hint)) {
-            std::copy_if(otherChange->m_changes.cbegin(), otherChange->m_changes.cend(),
-                         std::back_inserter(m_changes), [this](const auto &change) {
-                return !std::binary_search(m_changes.begin(), m_changes.end(),
-                                           std::make_pair(change.first, Lot()),
-                                           [](const auto &a, const auto &b) {
-                    return a.first < b.first;
-                });
+            // a lot that is copied completely in one command can't have field changes in the other
+            for (const auto &change : otherChange->m_lotChanges) {
+                if (hasFieldChanges(m_model->lotSlot(change.first)))
+                    return false;
+            }
+            for (const auto &fc : otherChange->m_fieldChanges) {
+                if (hasLotChange(m_model->m_slotLots[size_t(fc.slot)]))
+                    return false;
+            }
+
+            // keep our (older) values for everything that was changed in both commands
+            std::vector<std::pair<Lot *, Lot>> newLotChanges;
+            std::copy_if(otherChange->m_lotChanges.cbegin(), otherChange->m_lotChanges.cend(),
+                         std::back_inserter(newLotChanges), [this](const auto &change) {
+                return !hasLotChange(change.first);
             });
+            m_lotChanges.insert(m_lotChanges.end(), newLotChanges.cbegin(), newLotChanges.cend());
+            std::sort(m_lotChanges.begin(), m_lotChanges.end(), [](const auto &a, const auto &b) {
+                return a.first < b.first;
+            });
+
+            auto fieldLessThan = [](const auto &a, const auto &b) {
+                return (a.slot < b.slot) || ((a.slot == b.slot) && (a.field < b.field));
+            };
+            auto oldSize = m_fieldChanges.size();
+            for (const auto &fc : otherChange->m_fieldChanges) {
+                if (!std::binary_search(m_fieldChanges.cbegin(), m_fieldChanges.cbegin() + oldSize,
+                                        fc, fieldLessThan)) {
+                    m_fieldChanges.push_back(fc);
+                }
+            }
+            std::inplace_merge(m_fieldChanges.begin(), m_fieldChanges.begin() + oldSize,
+                               m_fieldChanges.end(), fieldLessThan);
+
             updateText();
             return true;
         }
@@ -302,9 +487,24 @@ bool ChangeCmd::mergeWith(const QUndoCommand *other)
     return false;
 }
 
+qint64 ChangeCmd::memoryUsage() const
+{
+    qint64 size = qint64(sizeof(*this))
+            + qint64(sizeof(DocumentModel::FieldChange)) * qint64(m_fieldChanges.capacity())
+            + qint64(sizeof(std::pair<Lot *, Lot>)) * qint64(m_lotChanges.capacity());
+    for (const auto &fc : m_fieldChanges)
+        size += qint64(sizeof(QChar)) * fc.text.size();
+    for (const auto &change : m_lotChanges)
+        size += lotMemoryUsage(change.second) - qint64(sizeof(Lot));
+    return size;
+}
+
 void ChangeCmd::redo()
 {
-    m_model->changeLotsDirect(m_changes);
+    if (!m_fieldChanges.empty())
+        m_model->changeLotFieldsDirect(m_fieldChanges);
+    if (!m_lotChanges.empty())
+        m_model->changeLotsDirect(m_lotChanges);
 }
 
 void ChangeCmd::undo()
@@ -318,40 +518,79 @@ void ChangeCmd::undo()
 ///////////////////////////////////////////////////////////////////////
 
 
+ColumnChangeCmd::ColumnChangeCmd(DocumentModel *model, const LotList &lots,
+                                 const QVector<DocumentModel::Field> &fields,
+                                 std::vector<double> &&values)
+    : UndoCommand()
+    , m_model(model)
+    , m_lots(lots)
+    , m_fields(fields)
+    , m_values(std::move(values))
+{
+    Q_ASSERT(m_values.size() == size_t(m_lots.size()) * size_t(m_fields.size()));
+
+    setText(QCoreApplication::translate("ChangeCmd", "Modified %1 on %Ln item(s)", nullptr,
+                                        int(m_lots.size()))
+            .arg((m_fields.size() == 1) ? m_model->headerData(m_fields.constFirst(), Qt::Horizontal).toString()
+                                        : QCoreApplication::translate("ChangeCmd", "multiple fields")));
+}
+
+int ColumnChangeCmd::id() const
+{
+    return CID_ColumnChange;
+}
+
+qint64 ColumnChangeCmd::memoryUsage() const
+{
+    return qint64(sizeof(*this)) + qint64(sizeof(Lot *)) * m_lots.size()
+            + qint64(sizeof(DocumentModel::Field)) * m_fields.size()
+            + qint64(sizeof(double)) * qint64(m_values.size());
+}
+
+void ColumnChangeCmd::redo()
+{
+    m_model->changeLotColumnsDirect(m_lots, m_fields, m_values);
+}
+
+void ColumnChangeCmd::undo()
+{
+    redo();
+}
+
+
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+
+
 CurrencyCmd::CurrencyCmd(DocumentModel *model, const QString &ccode, qreal crate)
-    : QUndoCommand(QCoreApplication::translate("CurrencyCmd", "Changed currency"))
+    : UndoCommand(QCoreApplication::translate("CurrencyCmd", "Changed currency"))
     , m_model(model)
     , m_ccode(ccode)
     , m_crate(crate)
-    , m_prices(nullptr)
 { }
 
-CurrencyCmd::~CurrencyCmd()
+int CurrencyCmd::id() const
 {
-    delete [] m_prices;
+    return CID_Currency;
 }
 
-int CurrencyCmd::id() const
+qint64 CurrencyCmd::memoryUsage() const
 {
-    return CID_Currency;
+    return qint64(sizeof(*this)) + qint64(sizeof(QChar)) * m_ccode.size()
+            + qint64(sizeof(Lot *)) * m_lots.size() + qint64(sizeof(double)) * qint64(m_prices.size());
 }
 
 void CurrencyCmd::redo()
 {
-    Q_ASSERT(!m_prices);
-
     QString oldccode = m_model->currencyCode();
-    m_model->changeCurrencyDirect(m_ccode, m_crate, m_prices);
+    m_model->changeCurrencyDirect(m_ccode, m_crate, m_lots, m_prices);
     m_ccode = oldccode;
 }
 
 void CurrencyCmd::undo()
 {
-    Q_ASSERT(m_prices);
-
-    QString oldccode = m_model->currencyCode();
-    m_model->changeCurrencyDirect(m_ccode, m_crate, m_prices);
-    m_ccode = oldccode;
+    redo();
 }
 
 
@@ -361,7 +600,7 @@ void CurrencyCmd::undo()
 
 
 ResetDifferenceModeCmd::ResetDifferenceModeCmd(DocumentModel *model, const LotList &lots)
-    : QUndoCommand(QCoreApplication::translate("ResetDifferenceModeCmd", "Reset difference mode base values"))
+    : UndoCommand(QCoreApplication::translate("ResetDifferenceModeCmd", "Reset difference mode base values"))
     , m_model(model)
     , m_differenceBase(model->m_differenceBase)
 {
@@ -374,6 +613,14 @@ int ResetDifferenceModeCmd::id() const
     return CID_ResetDifferenceMode;
 }
 
+qint64 ResetDifferenceModeCmd::memoryUsage() const
+{
+    qint64 size = qint64(sizeof(*this));
+    for (const Lot &lot : m_differenceBase)
+        size += lotMemoryUsage(lot);
+    return size;
+}
+
 void ResetDifferenceModeCmd::redo()
 {
     m_model->resetDifferenceModeDirect(m_differenceBase);
@@ -391,7 +638,7 @@ void ResetDifferenceModeCmd::undo()
 
 
 SortCmd::SortCmd(DocumentModel *model, const QVector<QPair<int, Qt::SortOrder>> &columns)
-    : QUndoCommand(QCoreApplication::translate("SortCmd", "Sorted the view"))
+    : UndoCommand(QCoreApplication::translate("SortCmd", "Sorted the view"))
     , m_model(model)
     , m_created(QDateTime::currentDateTime())
     , m_columns(columns)
@@ -407,6 +654,12 @@ bool SortCmd::mergeWith(const QUndoCommand *other)
     return (other->id() == id());
 }
 
+qint64 SortCmd::memoryUsage() const
+{
+    return qint64(sizeof(*this)) + qint64(sizeof(QPair<int, Qt::SortOrder>)) * m_columns.size()
+            + qint64(sizeof(Lot *)) * m_unsorted.size();
+}
+
 void SortCmd::redo()
 {
     auto oldColumns = m_model->sortColumns();
@@ -428,7 +681,7 @@ void SortCmd::undo()
 
 
 FilterCmd::FilterCmd(DocumentModel *model, const QVector<Filter> &filterList)
-    : QUndoCommand(QCoreApplication::translate("FilterCmd", "Filtered the view"))
+    : UndoCommand(QCoreApplication::translate("FilterCmd", "Filtered the view"))
     , m_model(model)
     , m_created(QDateTime::currentDateTime())
     , m_filterList(filterList)
@@ -444,6 +697,14 @@ bool FilterCmd::mergeWith(const QUndoCommand *other)
     return (other->id() == id());
 }
 
+qint64 FilterCmd::memoryUsage() const
+{
+    qint64 size = qint64(sizeof(*this)) + qint64(sizeof(Lot *)) * m_unfiltered.size();
+    for (const auto &f : m_filterList)
+        size += qint64(sizeof(Filter)) + qint64(sizeof(QChar)) * f.expression().size();
+    return size;
+}
+
 void FilterCmd::redo()
 {
     auto oldFilterList = m_model->m_filter;
@@ -466,55 +727,79 @@ void FilterCmd::undo()
 
 DocumentModel::Statistics::Statistics(const DocumentModel *model, const LotList &list,
                                       bool ignoreExcluded, bool ignorePriceAndQuantityErrors)
+    : m_ignorePriceAndQuantityErrors(ignorePriceAndQuantityErrors)
+    , m_ccode(model->currencyCode())
 {
-    m_lots = 0;
-    m_items = 0;
-    m_val = m_minval = m_cost = 0.;
-    m_weight = .0;
-    m_errors = 0;
-    m_differences = 0;
-    m_incomplete = 0;
-    bool weight_missing = false;
-
     for (const Lot *lot : list) {
         if (ignoreExcluded && (lot->status() == BrickLink::Status::Exclude))
             continue;
 
-        ++m_lots;
+        addLot(lot, 1);
+        addLotFlags(model->lotFlags(lot), 1);
+    }
+}
 
-        int qty = lot->quantity();
-        double price = lot->price();
+double DocumentModel::Statistics::weight() const
+{
+    if (m_weightMissing)
+        return qFuzzyIsNull(m_weight) ? -std::numeric_limits<double>::min() : -m_weight;
+    return m_weight;
+}
 
-        m_val += (qty * price);
-        m_cost += (qty * lot->cost());
+void DocumentModel::Statistics::addLot(const Lot *lot, int sign)
+{
+    m_lots += sign;
 
-        for (int i = 0; i < 3; i++) {
-            if (lot->tierQuantity(i) && !qFuzzyIsNull(lot->tierPrice(i)))
-                price = lot->tierPrice(i);
-        }
-        m_minval += (qty * price * (1.0 - double(lot->sale()) / 100.0));
-        m_items += qty;
+    int qty = lot->quantity();
+    double price = lot->price();
 
-        if (lot->totalWeight() > 0)
-            m_weight += lot->totalWeight();
-        else
-            weight_missing = true;
+    m_val += sign * (qty * price);
+    m_cost += sign * (qty * lot->cost());
 
-        auto flags = model->lotFlags(lot);
-        if (flags.first) {
-            if (ignorePriceAndQuantityErrors)
-                flags.first &= ((1ULL << PartNo) | (1ULL <<Color));
-            m_errors += qPopulationCount(flags.first);
-        }
-        if (flags.second)
-            m_differences += qPopulationCount(flags.second);
+    for (int i = 0; i < 3; i++) {
+        if (lot->tierQuantity(i) && !qFuzzyIsNull(lot->tierPrice(i)))
+            price = lot->tierPrice(i);
+    }
+    m_minval += sign * (qty * price * (1.0 - double(lot->sale()) / 100.0));
+    m_items += sign * qty;
+
+    if (lot->totalWeight() > 0)
+        m_weight += sign * lot->totalWeight();
+    else
+        m_weightMissing += sign;
 
-        if (lot->isIncomplete())
-            m_incomplete++;
+    if (lot->isIncomplete())
+        m_incomplete += sign;
+
+    // don't let rounding errors accumulate in the running totals
+    if (!m_lots)
+        m_val = m_minval = m_cost = m_weight = 0;
+}
+
+void DocumentModel::Statistics::addLotFlags(QPair<quint64, quint64> flags, int sign)
+{
+    if (flags.first) {
+        m_errors += sign * qPopulationCount(flags.first);
+        m_partOrColorErrors += sign * qPopulationCount(flags.first & ((1ULL << PartNo) | (1ULL << Color)));
     }
-    if (weight_missing)
-        m_weight = qFuzzyIsNull(m_weight) ? -std::numeric_limits<double>::min() : -m_weight;
-    m_ccode = model->currencyCode();
+    if (flags.second)
+        m_differences += sign * qPopulationCount(flags.second);
+}
+
+DocumentModel::Statistics &DocumentModel::Statistics::operator+=(const Statistics &other)
+{
+    m_lots += other.m_lots;
+    m_items += other.m_items;
+    m_val += other.m_val;
+    m_minval += other.m_minval;
+    m_cost += other.m_cost;
+    m_weight += other.m_weight;
+    m_weightMissing += other.m_weightMissing;
+    m_errors += other.m_errors;
+    m_partOrColorErrors += other.m_partOrColorErrors;
+    m_differences += other.m_differences;
+    m_incomplete += other.m_incomplete;
+    return *this;
 }
 
 
@@ -558,6 +843,11 @@ DocumentModel::DocumentModel()
     : DocumentModel(0)
 {
     m_undo = new UndoStack(this);
+    m_undo->setMemoryLimit(qint64(Config::inst()->undoMemoryLimit()) * 1024 * 1024);
+    connect(Config::inst(), &Config::undoMemoryLimitChanged,
+            this, [this](int megaBytes) {
+        m_undo->setMemoryLimit(qint64(megaBytes) * 1024 * 1024);
+    });
     connect(m_undo, &QUndoStack::cleanChanged,
             this, [this](bool clean) {
         if (clean) {
@@ -568,6 +858,12 @@ DocumentModel::DocumentModel()
         }
         updateModified();
     });
+    connect(m_undo, &UndoStack::oldestCommandsDropped,
+            this, [this](int count) {
+        // the indexes shift down, but we can never get back to before a dropped command
+        if (m_firstNonVisualIndex)
+            m_firstNonVisualIndex = qMax(0, m_firstNonVisualIndex - count);
+    });
     connect(m_undo, &QUndoStack::indexChanged,
             this, [this](int index) {
         bool oldVisuallyClean = m_visuallyClean;
@@ -662,7 +958,32 @@ const LotList &DocumentModel::filteredLots() const
 DocumentModel::Statistics DocumentModel::statistics(const LotList &list, bool ignoreExcluded,
                                                     bool ignorePriceAndQuantityErrors) const
 {
-    return Statistics(this, list, ignoreExcluded, ignorePriceAndQuantityErrors);
+    if (&list != &m_lots)
+        return Statistics(this, list, ignoreExcluded, ignorePriceAndQuantityErrors);
+
+    // the whole document: no need to iterate, we have running totals for that
+    Statistics stat = m_includedStatistics;
+    if (!ignoreExcluded)
+        stat += m_excludedStatistics;
+    stat.m_ignorePriceAndQuantityErrors = ignorePriceAndQuantityErrors;
+    stat.m_ccode = currencyCode();
+    return stat;
+}
+
+void DocumentModel::addToStatistics(const Lot *lot, int sign)
+{
+    auto &stat = (lot->status() == BrickLink::Status::Exclude) ? m_excludedStatistics
+                                                               : m_includedStatistics;
+    stat.addLot(lot, sign);
+    stat.addLotFlags(lotFlags(lot), sign);
+}
+
+void DocumentModel::recalculateStatistics()
+{
+    m_includedStatistics = { };
+    m_excludedStatistics = { };
+    for (const Lot *lot : qAsConst(m_lots))
+        addToStatistics(lot, 1);
 }
 
 void DocumentModel::beginMacro(const QString &label)
@@ -675,7 +996,7 @@ void DocumentModel::endMacro(const QString &label)
     m_undo->endMacro(label);
 }
 
-QUndoStack *DocumentModel::undoStack() const
+UndoStack *DocumentModel::undoStack() const
 {
     return m_undo;
 }
@@ -704,9 +1025,9 @@ void DocumentModel::insertLotsAfter(const Lot *afterLot, LotList &&lots)
     if (lots.empty())
         return;
 
-    int afterPos = m_lots.indexOf(const_cast<Lot *>(afterLot)) + 1;
-    int afterSortedPos = m_sortedLots.indexOf(const_cast<Lot *>(afterLot)) + 1;
-    int afterFilteredPos = m_filteredLots.indexOf(const_cast<Lot *>(afterLot)) + 1;
+    int afterPos = lotIndex(afterLot) + 1;
+    int afterSortedPos = lotSortedIndex(afterLot) + 1;
+    int afterFilteredPos = lotRow(afterLot) + 1;
 
     Q_ASSERT((afterPos > 0) && (afterSortedPos > 0));
     if (afterFilteredPos == 0)
@@ -753,38 +1074,112 @@ void DocumentModel::setLotsDirect(const LotList &lots)
     insertLotsDirect(lots, posDummy, sortedPosDummy, filteredPosDummy);
 }
 
+// Merges lots into list, each at its final position (-1: not in the list at all).
+// Returns the first position that changed, or -1 if nothing was inserted.
+static int insertAtPositions(LotList &list, const LotList &lots, const QVector<int> &positions)
+{
+    std::vector<std::pair<int, Lot *>> inserts;
+    inserts.reserve(size_t(lots.size()));
+    for (int i = 0; i < lots.size(); ++i) {
+        if (positions.at(i) >= 0)
+            inserts.emplace_back(positions.at(i), lots.at(i));
+    }
+    if (inserts.empty())
+        return -1;
+    std::sort(inserts.begin(), inserts.end(), [](const auto &i1, const auto &i2) {
+        return i1.first < i2.first;
+    });
+
+    LotList result;
+    result.reserve(list.size() + int(inserts.size()));
+    int src = 0;
+    for (const auto &[pos, lot] : inserts) {
+        while ((result.size() < pos) && (src < list.size()))
+            result.append(list.at(src++));
+        result.append(lot);
+    }
+    while (src < list.size())
+        result.append(list.at(src++));
+    list = result;
+    return inserts.front().first;
+}
+
+// Removes the lots at the given positions (-1: not in the list at all) from list.
+// Returns the first position that changed, or -1 if nothing was removed.
+static int removeAtPositions(LotList &list, const QVector<int> &positions)
+{
+    std::vector<int> removes;
+    removes.reserve(size_t(positions.size()));
+    for (int pos : positions) {
+        if (pos >= 0)
+            removes.push_back(pos);
+    }
+    if (removes.empty())
+        return -1;
+    std::sort(removes.begin(), removes.end());
+
+    auto next = removes.cbegin();
+    int dst = removes.front();
+    for (int src = dst; src < list.size(); ++src) {
+        if ((next != removes.cend()) && (*next == src))
+            ++next;
+        else
+            list[dst++] = list.at(src);
+    }
+    list.resize(dst);
+    return removes.front();
+}
+
 void DocumentModel::insertLotsDirect(const LotList &lots, QVector<int> &positions,
                                      QVector<int> &sortedPositions, QVector<int> &filteredPositions)
 {
-    auto pos = positions.constBegin();
-    auto sortedPos = sortedPositions.constBegin();
-    auto filteredPos = filteredPositions.constBegin();
     bool isAppend = positions.isEmpty();
 
     Q_ASSERT((positions.size() == sortedPositions.size())
              && (positions.size() == filteredPositions.size()));
     Q_ASSERT(isAppend != (positions.size() == lots.size()));
 
+    // undo/redo restores the exact positions, so only new lots have to be placed
+    const bool live = isLiveSortFilter();
+    const bool liveBatch = live && isAppend && (lots.size() > LiveSortFilterBatchLimit);
+
     emit layoutAboutToBeChanged({ }, VerticalSortHint);
     QModelIndexList before = persistentIndexList();
 
     for (Lot *lot : qAsConst(lots)) {
-        if (!isAppend) {
-            m_lots.insert(*pos++, lot);
-            m_sortedLots.insert(*sortedPos++, lot);
-            m_filteredLots.insert(*filteredPos++, lot);
-        } else {
+        // this is really a new lot, not just a redo - start with no differences
+        if (!m_differenceBase.contains(lot))
+            m_differenceBase.insert(lot, *lot);
+        assignLotSlot(lot);
+        addToStatistics(lot, 1);
+    }
+
+    if (!isAppend) {
+        // the positions are the final ones (see removeLotsDirect()), so all lots can be
+        // merged in with a single pass over each list
+        if (int from = insertAtPositions(m_lots, lots, positions); from >= 0)
+            updateLotPositions(m_lots, &LotPositions::index, from);
+        if (int from = insertAtPositions(m_sortedLots, lots, sortedPositions); from >= 0)
+            updateLotPositions(m_sortedLots, &LotPositions::sorted, from);
+        if (int from = insertAtPositions(m_filteredLots, lots, filteredPositions); from >= 0)
+            updateLotPositions(m_filteredLots, &LotPositions::row, from);
+    } else {
+        for (Lot *lot : qAsConst(lots)) {
+            m_lotPositions[size_t(lotSlot(lot))] = { int(m_lots.size()), int(m_sortedLots.size()),
+                                                     int(m_filteredLots.size()) };
             m_lots.append(lot);
             m_sortedLots.append(lot);
             m_filteredLots.append(lot);
-        }
 
-        // this is really a new lot, not just a redo - start with no differences
-        if (!m_differenceBase.contains(lot))
-            m_differenceBase.insert(lot, *lot);
+            // everything but this lot has to be sorted already
+            if (live && !liveBatch)
+                moveLotToSortFilterPosition(lot, false);
+        }
+    }
 
+    // updateLotFlags() emits signals, so all the lookups have to be valid at this point
+    for (const Lot *lot : qAsConst(lots))
         updateLotFlags(lot);
-    }
 
     QModelIndexList after;
     foreach (const QModelIndex &idx, before)
@@ -792,13 +1187,18 @@ void DocumentModel::insertLotsDirect(const LotList &lots, QVector<int> &position
     changePersistentIndexList(before, after);
     emit layoutChanged({ }, VerticalSortHint);
 
+    if (liveBatch)
+        updateSortFilterOrder(lots);
+
     emit lotCountChanged(m_lots.count());
     emitStatisticsChanged();
 
-    if (isSorted())
-        emit isSortedChanged(m_isSorted = false);
-    if (isFiltered())
-        emit isFilteredChanged(m_isFiltered = false);
+    if (!live) {
+        if (isSorted())
+            emit isSortedChanged(m_isSorted = false);
+        if (isFiltered())
+            emit isFilteredChanged(m_isFiltered = false);
+    }
 }
 
 void DocumentModel::removeLotsDirect(const LotList &lots, QVector<int> &positions,
@@ -811,19 +1211,25 @@ void DocumentModel::removeLotsDirect(const LotList &lots, QVector<int> &position
     emit layoutAboutToBeChanged({ }, VerticalSortHint);
     QModelIndexList before = persistentIndexList();
 
-    for (int i = lots.count() - 1; i >= 0; --i) {
+    // record the positions before the removal: insertLotsDirect() puts the lots back there
+    for (int i = 0; i < lots.count(); ++i) {
         Lot *lot = lots.at(i);
-        int idx = m_lots.indexOf(lot);
-        int sortIdx = m_sortedLots.indexOf(lot);
-        int filterIdx = m_filteredLots.indexOf(lot);
-        Q_ASSERT(idx >= 0 && sortIdx >= 0);
-        positions[i] = idx;
-        sortedPositions[i] = sortIdx;
-        filteredPositions[i] = filterIdx;
-        m_lots.removeAt(idx);
-        m_sortedLots.removeAt(sortIdx);
-        m_filteredLots.removeAt(filterIdx);
+        const int slot = lotSlot(lot);
+        Q_ASSERT(slot >= 0);
+        auto &lp = m_lotPositions[size_t(slot)];
+        Q_ASSERT(lp.index >= 0 && lp.sorted >= 0);
+        positions[i] = lp.index;
+        sortedPositions[i] = lp.sorted;
+        filteredPositions[i] = lp.row;
+        lp = { };
+        addToStatistics(lot, -1);
     }
+    if (int from = removeAtPositions(m_lots, positions); from >= 0)
+        updateLotPositions(m_lots, &LotPositions::index, from);
+    if (int from = removeAtPositions(m_sortedLots, sortedPositions); from >= 0)
+        updateLotPositions(m_sortedLots, &LotPositions::sorted, from);
+    if (int from = removeAtPositions(m_filteredLots, filteredPositions); from >= 0)
+        updateLotPositions(m_filteredLots, &LotPositions::row, from);
 
     QModelIndexList after;
     foreach (const QModelIndex &idx, before)
@@ -834,81 +1240,292 @@ void DocumentModel::removeLotsDirect(const LotList &lots, QVector<int> &position
     emit lotCountChanged(m_lots.count());
     emitStatisticsChanged();
 
-    //TODO: we should remember and re-apply the isSorted/isFiltered state
-    if (isSorted())
-        emit isSortedChanged(m_isSorted = false);
-    if (isFiltered())
-        emit isFilteredChanged(m_isFiltered = false);
+    // removing lots can neither break the sort order nor the filter
+    if (!isLiveSortFilter()) {
+        //TODO: we should remember and re-apply the isSorted/isFiltered state
+        if (isSorted())
+            emit isSortedChanged(m_isSorted = false);
+        if (isFiltered())
+            emit isFilteredChanged(m_isFiltered = false);
+    }
 }
 
 void DocumentModel::changeLotsDirect(std::vector<std::pair<Lot *, Lot>> &changes)
 {
     Q_ASSERT(!changes.empty());
 
-    for (auto &change : changes) {
-        Lot *lot = change.first;
-        std::swap(*lot, change.second);
+    LotList lots;
+    lots.reserve(int(changes.size()));
+    for (const auto &change : changes)
+        lots.append(change.first);
+
+    changedLotsDirect(lots, [&changes](int i, Lot *lot) {
+        std::swap(*lot, changes[size_t(i)].second);
+    });
+}
+
+void DocumentModel::changeLotFieldsDirect(std::vector<FieldChange> &changes)
+{
+    Q_ASSERT(!changes.empty());
+
+    // the changes are sorted by slot: group them by lot
+    LotList lots;
+    std::vector<size_t> firstChange;
+    for (size_t i = 0; i < changes.size(); ++i) {
+        if (!i || (changes[i].slot != changes[i - 1].slot)) {
+            lots.append(m_slotLots[size_t(changes[i].slot)]);
+            firstChange.push_back(i);
+        }
+    }
+    firstChange.push_back(changes.size());
+
+    changedLotsDirect(lots, [&](int i, Lot *lot) {
+        for (size_t c = firstChange[size_t(i)]; c < firstChange[size_t(i) + 1]; ++c) {
+            FieldChange &fc = changes[c];
+            FieldChange oldValue { fc.slot, fc.field, 0, { } };
+            readFieldChange(lot, oldValue);
+            writeFieldChange(lot, fc);
+            fc.number = oldValue.number;
+            fc.text = oldValue.text;
+        }
+    });
+}
+
+void DocumentModel::changeLotColumnsDirect(const LotList &lots, const QVector<Field> &fields,
+                                           std::vector<double> &values)
+{
+    Q_ASSERT(!lots.isEmpty());
+
+    // swap the new and old values, just like changeLotsDirect() does with complete lots
+    const size_t count = size_t(lots.size());
+    changedLotsDirect(lots, [&](int i, Lot *lot) {
+        for (int f = 0; f < fields.size(); ++f) {
+            double &value = values[size_t(f) * count + size_t(i)];
+            const double oldValue = numericFieldValue(lot, fields.at(f));
+            setNumericFieldValue(lot, fields.at(f), value);
+            value = oldValue;
+        }
+    });
+}
+
+void DocumentModel::changedLotsDirect(const LotList &lots, const std::function<void(int, Lot *)> &change)
+{
+    const bool live = isLiveSortFilter();
+    const bool liveBatch = live && (lots.size() > LiveSortFilterBatchLimit);
+
+    for (int i = 0; i < lots.size(); ++i) {
+        Lot *lot = lots.at(i);
+        addToStatistics(lot, -1);
+        change(i, lot);
+        addToStatistics(lot, 1);
+        if (int slot = lotSlot(lot); slot >= 0)
+            m_lotVersions[size_t(slot)] = ++m_lastVersion;
 
         QModelIndex idx1 = index(lot, 0);
         QModelIndex idx2 = idx1.siblingAtColumn(columnCount() - 1);
         updateLotFlags(lot);
         emitDataChanged(idx1, idx2);
+
+        if (live && !liveBatch)
+            moveLotToSortFilterPosition(lot, true);
     }
 
+    if (liveBatch)
+        updateSortFilterOrder(lots);
+
     emitStatisticsChanged();
 
-    //TODO: we should remember and re-apply the isSorted/isFiltered state
-    if (isSorted())
-        emit isSortedChanged(m_isSorted = false);
+    if (!live) {
+        //TODO: we should remember and re-apply the isSorted/isFiltered state
+        if (isSorted())
+            emit isSortedChanged(m_isSorted = false);
+        if (isFiltered())
+            emit isFilteredChanged(m_isFiltered = false);
+    }
+}
+
+bool DocumentModel::isLiveSortFilter() const
+{
+    return (isSorted() || isFiltered()) && Config::inst()->liveSortFilter();
+}
+
+bool DocumentModel::lotLessThan(const Lot *l1, const Lot *l2) const
+{
+    // has to match the order created by sortLots()
+    for (const auto &sc : qAsConst(m_sortColumns)) {
+        const auto it = m_columns.constFind(sc.first);
+        if ((it == m_columns.cend()) || !it->compareFn)
+            continue;
+        if (int d = it->compareFn(l1, l2))
+            return (sc.second == Qt::DescendingOrder) ? (d > 0) : (d < 0);
+    }
+    bool descending = !m_sortColumns.isEmpty() && (m_sortColumns.constFirst().first != -1)
+            && (m_sortColumns.constFirst().second == Qt::DescendingOrder);
+    int d = lotIndex(l1) - lotIndex(l2);
+    return descending ? (d > 0) : (d < 0);
+}
+
+int DocumentModel::sortedPosition(const LotList &list, int from, const Lot *lot) const
+{
+    // Everything but lot itself is sorted, so we can binary search the parts before and after
+    // its current position. The result is the row to insert in front of, in the coordinates of
+    // the unchanged list (the same convention as QAbstractItemModel::beginMoveRows()).
+
+    auto lessThan = [this](const Lot *l1, const Lot *l2) { return lotLessThan(l1, l2); };
+
+    if (from < 0)
+        return int(std::lower_bound(list.cbegin(), list.cend(), lot, lessThan) - list.cbegin());
+
+    auto it = std::lower_bound(list.cbegin(), list.cbegin() + from, lot, lessThan);
+    if (it != (list.cbegin() + from))
+        return int(it - list.cbegin());
+    return int(std::lower_bound(list.cbegin() + from + 1, list.cend(), lot, lessThan) - list.cbegin());
+}
+
+void DocumentModel::moveLotToSortFilterPosition(Lot *lot, bool emitRowSignals)
+{
+    if (isSorted()) {
+        int from = lotSortedIndex(lot);
+        int to = sortedPosition(m_sortedLots, from, lot);
+        if ((to != from) && (to != (from + 1))) {
+            const int dest = (to > from) ? to - 1 : to;
+            m_sortedLots.move(from, dest);
+            updateLotPositions(m_sortedLots, &LotPositions::sorted, qMin(from, dest), qMax(from, dest));
+        }
+    }
+
+    const int oldRow = lotRow(lot);
+    bool accepted = (oldRow >= 0);
     if (isFiltered())
-        emit isFilteredChanged(m_isFiltered = false);
+        accepted = filterAcceptsLot(lot);
+
+    if (oldRow >= 0 && !accepted) {
+        if (emitRowSignals)
+            beginRemoveRows({ }, oldRow, oldRow);
+        m_filteredLots.removeAt(oldRow);
+        m_lotPositions[size_t(lotSlot(lot))].row = -1;
+        updateLotPositions(m_filteredLots, &LotPositions::row, oldRow);
+        if (emitRowSignals)
+            endRemoveRows();
+        return;
+    } else if (!accepted) {
+        return;
+    }
+
+    int newRow = oldRow;
+    if (isSorted()) {
+        newRow = sortedPosition(m_filteredLots, oldRow, lot);
+    } else if (oldRow < 0) {
+        // keep the current order: insert after the closest visible predecessor
+        newRow = 0;
+        for (int i = lotSortedIndex(lot) - 1; i >= 0; --i) {
+            int row = lotRow(m_sortedLots.at(i));
+            if (row >= 0) {
+                newRow = row + 1;
+                break;
+            }
+        }
+    }
+
+    if (oldRow < 0) {
+        if (emitRowSignals)
+            beginInsertRows({ }, newRow, newRow);
+        m_filteredLots.insert(newRow, lot);
+        updateLotPositions(m_filteredLots, &LotPositions::row, newRow);
+        if (emitRowSignals)
+            endInsertRows();
+    } else if ((newRow != oldRow) && (newRow != (oldRow + 1))) {
+        if (emitRowSignals)
+            beginMoveRows({ }, oldRow, oldRow, { }, newRow);
+        const int dest = (newRow > oldRow) ? newRow - 1 : newRow;
+        m_filteredLots.move(oldRow, dest);
+        updateLotPositions(m_filteredLots, &LotPositions::row, qMin(oldRow, dest), qMax(oldRow, dest));
+        if (emitRowSignals)
+            endMoveRows();
+    }
+}
+
+void DocumentModel::updateSortFilterOrder(const LotList &changedLots)
+{
+    // too many changes to move the lots one by one: re-sort everything, but only
+    // re-evaluate the filter for the lots that actually changed
+
+    emit layoutAboutToBeChanged({ }, VerticalSortHint);
+    QModelIndexList before = persistentIndexList();
+
+    if (isSorted())
+        m_sortedLots = sortLots(m_sortColumns);
+
+    QSet<const Lot *> visible(m_filteredLots.cbegin(), m_filteredLots.cend());
+    if (isFiltered()) {
+        for (const Lot *lot : changedLots) {
+            if (filterAcceptsLot(lot))
+                visible.insert(lot);
+            else
+                visible.remove(lot);
+        }
+    }
+    LotList filteredLots;
+    filteredLots.reserve(visible.size());
+    for (auto *lot : qAsConst(m_sortedLots)) {
+        if (visible.contains(lot))
+            filteredLots.append(lot);
+    }
+    m_filteredLots = filteredLots;
+    if (isSorted())
+        updateLotPositions(m_sortedLots, &LotPositions::sorted);
+    updateLotRows();
+
+    QModelIndexList after;
+    foreach (const QModelIndex &idx, before)
+        after.append(index(lot(idx), idx.column()));
+    changePersistentIndexList(before, after);
+    emit layoutChanged({ }, VerticalSortHint);
 }
 
-void DocumentModel::changeCurrencyDirect(const QString &ccode, qreal crate, double *&prices)
+void DocumentModel::changeCurrencyDirect(const QString &ccode, qreal crate, LotList &lots,
+                                         std::vector<double> &prices)
 {
     m_currencycode = ccode;
 
-    if (!qFuzzyCompare(crate, qreal(1)) || (ccode != m_currencycode)) {
-        bool createPrices = (prices == nullptr);
-        if (createPrices)
-            prices = new double[5 * m_lots.count()];
-
-        for (int i = 0; i < m_lots.count(); ++i) {
-            Lot *lot = m_lots[i];
-            if (createPrices) {
-                prices[i * 5] = lot->cost();
-                prices[i * 5 + 1] = lot->price();
-                prices[i * 5 + 2] = lot->tierPrice(0);
-                prices[i * 5 + 3] = lot->tierPrice(1);
-                prices[i * 5 + 4] = lot->tierPrice(2);
-
-                lot->setCost(prices[i * 5] * crate);
-                lot->setPrice(prices[i * 5 + 1] * crate);
-                lot->setTierPrice(0, prices[i * 5 + 2] * crate);
-                lot->setTierPrice(1, prices[i * 5 + 3] * crate);
-                lot->setTierPrice(2, prices[i * 5 + 4] * crate);
-            } else {
-                lot->setCost(prices[i * 5]);
-                lot->setPrice(prices[i * 5 + 1]);
-                lot->setTierPrice(0, prices[i * 5 + 2]);
-                lot->setTierPrice(1, prices[i * 5 + 3]);
-                lot->setTierPrice(2, prices[i * 5 + 4]);
-            }
+    // The first call converts all lots by crate, every later call (undo and redo) just swaps
+    // the recorded columns with the current values, just like changeLotColumnsDirect().
+    // All lots change at once, so this doesn't go through changedLotsDirect(): recalculating
+    // the statistics and emitting a single dataChanged is a lot cheaper than doing that per lot.
+    if (!prices.empty() || !qFuzzyCompare(crate, qreal(1))) {
+        const bool convert = prices.empty();
+        if (convert) {
+            lots = m_lots;
+            prices.resize(std::size(currencyFields) * size_t(lots.size()));
         }
+        const size_t count = size_t(lots.size());
+
+        for (size_t f = 0; f < std::size(currencyFields); ++f) {
+            const auto field = currencyFields[f];
+            double *column = prices.data() + f * count;
 
-        if (!createPrices) {
-            delete [] prices;
-            prices = nullptr;
+            for (size_t i = 0; i < count; ++i) {
+                Lot *lot = lots.at(int(i));
+                const double oldValue = numericFieldValue(lot, field);
+                setNumericFieldValue(lot, field, convert ? oldValue * crate : column[i]);
+                column[i] = oldValue;
+            }
         }
 
+        recalculateStatistics();
+        m_renderGeneration = ++m_lastVersion;
         emitDataChanged();
-        emitStatisticsChanged();
 
-        //TODO: we should remember and re-apply the isSorted/isFiltered state
-        if (isSorted())
-            emit isSortedChanged(m_isSorted = false);
-        if (isFiltered())
-            emit isFilteredChanged(m_isFiltered = false);
+        if (isLiveSortFilter()) {
+            updateSortFilterOrder(m_lots);
+        } else {
+            //TODO: we should remember and re-apply the isSorted/isFiltered state
+            if (isSorted())
+                emit isSortedChanged(m_isSorted = false);
+            if (isFiltered())
+                emit isFilteredChanged(m_isFiltered = false);
+        }
+        emitStatisticsChanged();
     }
     emit currencyCodeChanged(currencyCode());
 }
@@ -996,32 +1613,34 @@ void DocumentModel::updateLotFlags(const Lot *lot)
         errors = 0;
 
     if (auto base = differenceBaseLot(lot)) {
-        static const quint64 ignoreMask = 0ULL
-                | (1ULL << Index)
-                | (1ULL << Status)
-                | (1ULL << Picture)
-                | (1ULL << Description)
-                | (1ULL << QuantityOrig)
-                | (1ULL << QuantityDiff)
-                | (1ULL << PriceOrig)
-                | (1ULL << PriceDiff)
-                | (1ULL << Total)
-                | (1ULL << Category)
-                | (1ULL << ItemType)
-                | (1ULL << LotId)
-                | (1ULL << Weight)
-                | (1ULL << YearReleased)
-                | (1ULL << Marker)
-                | (1ULL << DateAdded)
-                | (1ULL << DateLastSold);
-
-        for (Field f = Index; f != FieldCount; f = Field(f + 1)) {
-            quint64 fmask = (1ULL << f);
-            if (fmask & ignoreMask)
-                continue;
-            if (dataForEditRole(lot, f) != dataForEditRole(base, f))
-                updated |= fmask;
-        }
+        // compare the fields directly instead of going through dataForEditRole() and
+        // QVariant: the generated fields (Total, Diff, ...) and the ones that are not
+        // editable anyway (Category, LotId, ...) are not tracked
+        auto differs = [&updated](Field f, bool b) {
+            if (b)
+                updated |= (1ULL << f);
+        };
+
+        differs(PartNo, (lot->item() != base->item())
+                || (!lot->item() && (lot->itemId() != base->itemId())));
+        differs(Condition, lot->condition() != base->condition());
+        differs(Color, lot->color() != base->color());
+        differs(Quantity, lot->quantity() != base->quantity());
+        differs(Price, !fuzzyCompare(lot->price(), base->price()));
+        differs(Cost, !fuzzyCompare(lot->cost(), base->cost()));
+        differs(Bulk, lot->bulkQuantity() != base->bulkQuantity());
+        differs(Sale, lot->sale() != base->sale());
+        differs(Comments, lot->comments() != base->comments());
+        differs(Remarks, lot->remarks() != base->remarks());
+        differs(TierQ1, lot->tierQuantity(0) != base->tierQuantity(0));
+        differs(TierP1, !fuzzyCompare(lot->tierPrice(0), base->tierPrice(0)));
+        differs(TierQ2, lot->tierQuantity(1) != base->tierQuantity(1));
+        differs(TierP2, !fuzzyCompare(lot->tierPrice(1), base->tierPrice(1)));
+        differs(TierQ3, lot->tierQuantity(2) != base->tierQuantity(2));
+        differs(TierP3, !fuzzyCompare(lot->tierPrice(2), base->tierPrice(2)));
+        differs(Retain, lot->retain() != base->retain());
+        differs(Stockroom, lot->stockroom() != base->stockroom());
+        differs(Reserved, lot->reserved() != base->reserved());
     }
 
     setLotFlags(lot, errors, updated);
@@ -1035,6 +1654,7 @@ void DocumentModel::resetDifferenceMode(const LotList &lotList)
 void DocumentModel::resetDifferenceModeDirect(QHash<const Lot *, Lot> &differenceBase)
 {
     std::swap(m_differenceBase, differenceBase);
+    m_renderGeneration = ++m_lastVersion; // the Orig. and Diff. columns depend on the base
 
     for (const auto *lot : qAsConst(m_lots))
         updateLotFlags(lot);
@@ -1169,6 +1789,93 @@ void DocumentModel::applyTo(const LotList &lots, std::function<bool(const Lot &,
     }
 }
 
+bool DocumentModel::isNumericField(Field field)
+{
+    switch (field) {
+    case Quantity:
+    case Bulk:
+    case Sale:
+    case Price:
+    case Cost:
+    case TierQ1:
+    case TierQ2:
+    case TierQ3:
+    case TierP1:
+    case TierP2:
+    case TierP3:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void DocumentModel::applyToColumns(const LotList &lots, const QVector<Field> &fields,
+                                   const std::function<void(FieldColumns &)> &callback,
+                                   const QString &actionText)
+{
+    if (lots.isEmpty() || fields.isEmpty())
+        return;
+    Q_ASSERT(std::all_of(fields.cbegin(), fields.cend(), isNumericField));
+
+    const int count = lots.size();
+    FieldColumns columns(fields.size());
+    for (int f = 0; f < fields.size(); ++f) {
+        auto &column = columns[f];
+        column.resize(size_t(count));
+        for (int i = 0; i < count; ++i)
+            column[size_t(i)] = numericFieldValue(lots.at(i), fields.at(f));
+    }
+
+    callback(columns);
+
+    // integer fields are stored rounded, so they have to be compared (and recorded) that way
+    for (int f = 0; f < fields.size(); ++f) {
+        switch (fields.at(f)) {
+        case Price: case Cost: case TierP1: case TierP2: case TierP3:
+            break;
+        default:
+            for (double &value : columns[f])
+                value = qRound(value);
+            break;
+        }
+    }
+
+    LotList changed;
+    std::vector<int> changedRows;
+    for (int i = 0; i < count; ++i) {
+        for (int f = 0; f < fields.size(); ++f) {
+            if (columns.at(f).at(size_t(i)) != numericFieldValue(lots.at(i), fields.at(f))) {
+                changed.append(lots.at(i));
+                changedRows.push_back(i);
+                break;
+            }
+        }
+    }
+
+    QString at = actionText;
+    if (actionText.endsWith("..."_l1))
+        at.chop(3);
+    if (!at.isEmpty())
+        beginMacro();
+
+    if (!changed.isEmpty()) {
+        const size_t changedCount = changedRows.size();
+        std::vector<double> values(changedCount * size_t(fields.size()));
+        for (int f = 0; f < fields.size(); ++f) {
+            const auto &column = columns.at(f);
+            double *dst = values.data() + size_t(f) * changedCount;
+            for (size_t i = 0; i < changedCount; ++i)
+                dst[i] = column[size_t(changedRows[i])];
+        }
+        m_undo->push(new ColumnChangeCmd(this, changed, fields, std::move(values)));
+    }
+
+    if (!at.isEmpty()) {
+        //: Generic undo/redo text: %1 == action name (e.g. "Set price")
+        endMacro(tr("%1 on %Ln item(s)", nullptr, changed.size()).arg(at));
+    }
+}
+
 Filter::Parser *DocumentModel::filterParser()
 {
     return m_filterParser.get();
@@ -1212,16 +1919,62 @@ void DocumentModel::updateModified()
 void DocumentModel::setLotFlagsMask(QPair<quint64, quint64> flagsMask)
 {
     m_lotFlagsMask = flagsMask;
+    recalculateStatistics();
     emitStatisticsChanged();
     emitDataChanged();
 }
 
 QPair<quint64, quint64> DocumentModel::lotFlags(const Lot *lot) const
 {
-    auto flags = m_lotFlags.value(lot, { });
-    flags.first &= m_lotFlagsMask.first;
-    flags.second &= m_lotFlagsMask.second;
-    return flags;
+    int slot = lotSlot(lot);
+    if (slot < 0)
+        return { };
+    return { m_lotErrorFlags[size_t(slot)] & m_lotFlagsMask.first,
+             m_lotDifferenceFlags[size_t(slot)] & m_lotFlagsMask.second };
+}
+
+int DocumentModel::lotSlot(const Lot *lot) const
+{
+    int slot = lot ? lot->modelSlot() : -1;
+    if ((slot < 0) || (size_t(slot) >= m_slotLots.size()) || (m_slotLots[size_t(slot)] != lot))
+        return -1;
+    return slot;
+}
+
+void DocumentModel::assignLotSlot(Lot *lot)
+{
+    // slots are never reused: a removed lot keeps its slot (and flags) for a later undo
+    if (lotSlot(lot) >= 0)
+        return;
+
+    lot->setModelSlot(int(m_slotLots.size()));
+    m_slotLots.push_back(lot);
+    m_lotPositions.emplace_back();
+    m_lotErrorFlags.push_back(0);
+    m_lotDifferenceFlags.push_back(0);
+    m_lotVersions.push_back(++m_lastVersion);
+}
+
+DocumentModel::RowRenderData DocumentModel::rowRenderData(int row) const
+{
+    if ((row < 0) || (row >= m_filteredLots.size()))
+        return { };
+
+    const Lot *lot = m_filteredLots.at(row);
+    int slot = lotSlot(lot);
+    if (slot < 0)
+        return { lot };
+
+    return { lot,
+             m_lotErrorFlags[size_t(slot)] & m_lotFlagsMask.first,
+             m_lotDifferenceFlags[size_t(slot)] & m_lotFlagsMask.second,
+             std::max(m_lotVersions[size_t(slot)], m_renderGeneration) };
+}
+
+Qt::Alignment DocumentModel::columnAlignment(int column) const
+{
+    const auto it = m_columns.constFind(column);
+    return Qt::Alignment((it != m_columns.cend()) ? it->alignment : int(Qt::AlignLeft));
 }
 
 void DocumentModel::setLotFlags(const Lot *lot, quint64 errors, quint64 updated)
@@ -1229,12 +1982,23 @@ void DocumentModel::setLotFlags(const Lot *lot, quint64 errors, quint64 updated)
     if (!lot)
         return;
 
-    auto oldFlags = m_lotFlags.value(lot, { });
-    if (oldFlags.first != errors || oldFlags.second != updated) {
-        if (errors || updated)
-            m_lotFlags.insert(lot, qMakePair(errors, updated));
-        else
-            m_lotFlags.remove(lot);
+    const int slot = lotSlot(lot);
+    if (slot < 0)
+        return;
+
+    auto &errorFlags = m_lotErrorFlags[size_t(slot)];
+    auto &differenceFlags = m_lotDifferenceFlags[size_t(slot)];
+
+    if (errorFlags != errors || differenceFlags != updated) {
+        // only ever called for lots in m_lots, which are already part of the statistics
+        auto &stat = (lot->status() == BrickLink::Status::Exclude) ? m_excludedStatistics
+                                                                   : m_includedStatistics;
+        stat.addLotFlags(lotFlags(lot), -1);
+
+        errorFlags = errors;
+        differenceFlags = updated;
+
+        stat.addLotFlags(lotFlags(lot), 1);
 
         emit lotFlagsChanged(lot);
         emitStatisticsChanged();
@@ -1265,12 +2029,45 @@ Lot *DocumentModel::lot(const QModelIndex &idx) const
 
 QModelIndex DocumentModel::index(const Lot *lot, int column) const
 {
-    int row = m_filteredLots.indexOf(const_cast<Lot *>(lot));
+    int row = lotRow(lot);
     if (row >= 0)
         return createIndex(row, column, const_cast<Lot *>(lot));
     return { };
 }
 
+int DocumentModel::lotIndex(const Lot *lot) const
+{
+    const int slot = lotSlot(lot);
+    return (slot >= 0) ? m_lotPositions[size_t(slot)].index : -1;
+}
+
+int DocumentModel::lotSortedIndex(const Lot *lot) const
+{
+    const int slot = lotSlot(lot);
+    return (slot >= 0) ? m_lotPositions[size_t(slot)].sorted : -1;
+}
+
+int DocumentModel::lotRow(const Lot *lot) const
+{
+    const int slot = lotSlot(lot);
+    return (slot >= 0) ? m_lotPositions[size_t(slot)].row : -1;
+}
+
+void DocumentModel::updateLotPositions(const LotList &list, int LotPositions::*position, int from, int to)
+{
+    if ((to < 0) || (to >= list.size()))
+        to = list.size() - 1;
+    for (int i = qMax(0, from); i <= to; ++i)
+        m_lotPositions[size_t(lotSlot(list.at(i)))].*position = i;
+}
+
+void DocumentModel::updateLotRows()
+{
+    for (const Lot *lot : qAsConst(m_lots))
+        m_lotPositions[size_t(lotSlot(lot))].row = -1;
+    updateLotPositions(m_filteredLots, &LotPositions::row);
+}
+
 int DocumentModel::rowCount(const QModelIndex &parent) const
 {
     return parent.isValid() ? 0 : m_filteredLots.size();
@@ -1321,12 +2118,14 @@ QVariant DocumentModel::data(const QModelIndex &index, int role) const
     if (index.isValid()) {
         const Lot *lot = this->lot(index);
         auto f = static_cast<Field>(index.column());
-        const auto &c = m_columns.value(index.column());
 
         switch (role) {
         case Qt::DisplayRole      : return dataForDisplayRole(lot, f);
         case BaseDisplayRole      : return dataForDisplayRole(differenceBaseLot(lot), f);
-        case Qt::TextAlignmentRole: return c.alignment | Qt::AlignVCenter;
+        case Qt::TextAlignmentRole: {
+            const auto it = m_columns.constFind(index.column());
+            return ((it != m_columns.cend()) ? it->alignment : int(Qt::AlignLeft)) | Qt::AlignVCenter;
+        }
         case Qt::EditRole         : return dataForEditRole(lot, f);
         case BaseEditRole         : return dataForEditRole(differenceBaseLot(lot), f);
         case FilterRole           : return dataForFilterRole(lot, f);
@@ -1435,14 +2234,14 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Index"),
           .displayFn = [&](const Lot *lot) {
               if (m_fakeIndexes.isEmpty()) {
-                  return QString::number(m_lots.indexOf(const_cast<Lot *>(lot)) + 1);
+                  return QString::number(lotIndex(lot) + 1);
               } else {
-                  auto fi = m_fakeIndexes.at(m_lots.indexOf(const_cast<Lot *>(lot)));
+                  auto fi = m_fakeIndexes.at(lotIndex(lot));
                   return fi >= 0 ? QString::number(fi + 1) : QString::fromLatin1("+");
               }
           },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return m_lots.indexOf(const_cast<Lot *>(l1)) - m_lots.indexOf(const_cast<Lot *>(l2));
+              return lotIndex(l1) - lotIndex(l2);
           },
       });
 
@@ -1537,6 +2336,10 @@ void DocumentModel::initializeColumns()
               auto base = differenceBaseLot(lot);
               return base ? base->quantity() : 0;
           },
+          .intFilterFn = [&](const Lot *lot) -> qint64 {
+              auto base = differenceBaseLot(lot);
+              return base ? base->quantity() : 0;
+          },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               auto base1 = differenceBaseLot(l1);
               auto base2 = differenceBaseLot(l2);
@@ -1555,6 +2358,10 @@ void DocumentModel::initializeColumns()
               if (auto base = differenceBaseLot(lot))
                   lot->setQuantity(base->quantity() + v.toInt());
           },
+          .intFilterFn = [&](const Lot *lot) -> qint64 {
+              auto base = differenceBaseLot(lot);
+              return base ? lot->quantity() - base->quantity() : 0;
+          },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               auto base1 = differenceBaseLot(l1);
               auto base2 = differenceBaseLot(l2);
@@ -1567,6 +2374,7 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Quantity"),
           .dataFn = [&](const Lot *lot) { return lot->quantity(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setQuantity(v.toInt()); },
+          .intFilterFn = [&](const Lot *lot) { return qint64(lot->quantity()); },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               return l1->quantity() - l2->quantity();
           },
@@ -1577,6 +2385,7 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Bulk"),
           .dataFn = [&](const Lot *lot) { return lot->bulkQuantity(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setBulkQuantity(v.toInt()); },
+          .intFilterFn = [&](const Lot *lot) { return qint64(lot->bulkQuantity()); },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               return l1->bulkQuantity() - l2->bulkQuantity();
           },
@@ -1589,6 +2398,10 @@ void DocumentModel::initializeColumns()
               auto base = differenceBaseLot(lot);
               return base ? base->price() : 0;
           },
+          .doubleFilterFn = [&](const Lot *lot) {
+              auto base = differenceBaseLot(lot);
+              return base ? base->price() : 0;
+          },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               auto base1 = differenceBaseLot(l1);
               auto base2 = differenceBaseLot(l2);
@@ -1606,6 +2419,10 @@ void DocumentModel::initializeColumns()
               if (auto base = differenceBaseLot(lot))
                   lot->setPrice(base->price() + v.toDouble());
           },
+          .doubleFilterFn = [&](const Lot *lot) {
+              auto base = differenceBaseLot(lot);
+              return base ? lot->price() - base->price() : 0;
+          },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               auto base1 = differenceBaseLot(l1);
               auto base2 = differenceBaseLot(l2);
@@ -1617,6 +2434,7 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Cost"),
           .dataFn = [&](const Lot *lot) { return lot->cost(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setCost(v.toDouble()); },
+          .doubleFilterFn = [&](const Lot *lot) { return lot->cost(); },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               return doubleCompare(l1->cost(), l2->cost());
           },
@@ -1626,6 +2444,7 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Price"),
           .dataFn = [&](const Lot *lot) { return lot->price(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setPrice(v.toDouble()); },
+          .doubleFilterFn = [&](const Lot *lot) { return lot->price(); },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               return doubleCompare(l1->price(), l2->price());
           },
@@ -1635,6 +2454,7 @@ void DocumentModel::initializeColumns()
           .editable = false,
           .title = QT_TR_NOOP("Total"),
           .displayFn = [&](const Lot *lot) { return lot->total(); },
+          .doubleFilterFn = [&](const Lot *lot) { return lot->total(); },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               return doubleCompare(l1->total(), l2->total());
           },
@@ -1645,6 +2465,7 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Sale"),
           .dataFn = [&](const Lot *lot) { return lot->sale(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setSale(v.toInt()); },
+          .intFilterFn = [&](const Lot *lot) { return qint64(lot->sale()); },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               return l1->sale() - l2->sale();
           },
@@ -1720,6 +2541,7 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Tier Q1"),
           .dataFn = [&](const Lot *lot) { return lot->tierQuantity(0); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setTierQuantity(0, v.toInt()); },
+          .intFilterFn = [&](const Lot *lot) { return qint64(lot->tierQuantity(0)); },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               return l1->tierQuantity(0) - l2->tierQuantity(0);
           },
@@ -1729,6 +2551,7 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Tier P1"),
           .dataFn = [&](const Lot *lot) { return lot->tierPrice(0); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setTierPrice(0, v.toDouble()); },
+          .doubleFilterFn = [&](const Lot *lot) { return lot->tierPrice(0); },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               return doubleCompare(l1->tierPrice(0), l2->tierPrice(0));
           },
@@ -1739,6 +2562,7 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Tier Q2"),
           .dataFn = [&](const Lot *lot) { return lot->tierQuantity(1); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setTierQuantity(1, v.toInt()); },
+          .intFilterFn = [&](const Lot *lot) { return qint64(lot->tierQuantity(1)); },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               return l1->tierQuantity(1) - l2->tierQuantity(1);
           },
@@ -1748,6 +2572,7 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Tier P2"),
           .dataFn = [&](const Lot *lot) { return lot->tierPrice(1); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setTierPrice(1, v.toDouble()); },
+          .doubleFilterFn = [&](const Lot *lot) { return lot->tierPrice(1); },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               return doubleCompare(l1->tierPrice(1), l2->tierPrice(1));
           },
@@ -1758,6 +2583,7 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Tier Q3"),
           .dataFn = [&](const Lot *lot) { return lot->tierQuantity(2); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setTierQuantity(2, v.toInt()); },
+          .intFilterFn = [&](const Lot *lot) { return qint64(lot->tierQuantity(2)); },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               return l1->tierQuantity(2) - l2->tierQuantity(2);
           },
@@ -1767,6 +2593,7 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Tier P3"),
           .dataFn = [&](const Lot *lot) { return lot->tierPrice(2); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setTierPrice(2, v.toDouble()); },
+          .doubleFilterFn = [&](const Lot *lot) { return lot->tierPrice(2); },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               return doubleCompare(l1->tierPrice(2), l2->tierPrice(2));
           },
@@ -1776,6 +2603,7 @@ void DocumentModel::initializeColumns()
           .editable = false,
           .title = QT_TR_NOOP("Lot Id"),
           .displayFn = [&](const Lot *lot) { return lot->lotId(); },
+          .intFilterFn = [&](const Lot *lot) { return qint64(lot->lotId()); },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               return uintCompare(l1->lotId(), l2->lotId());
           },
@@ -1825,6 +2653,7 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Weight"),
           .dataFn = [&](const Lot *lot) { return lot->totalWeight(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setTotalWeight(v.toDouble()); },
+          .doubleFilterFn = [&](const Lot *lot) { return lot->totalWeight(); },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               return doubleCompare(l1->totalWeight(), l2->totalWeight());
           },
@@ -1835,6 +2664,7 @@ void DocumentModel::initializeColumns()
           .editable = false,
           .title = QT_TR_NOOP("Year"),
           .displayFn = [&](const Lot *lot) { return lot->itemYearReleased(); },
+          .intFilterFn = [&](const Lot *lot) { return qint64(lot->itemYearReleased()); },
           .compareFn = [&](const Lot *l1, const Lot *l2) {
               return l1->itemYearReleased() - l2->itemYearReleased();
           },
@@ -1969,33 +2799,7 @@ void DocumentModel::sortDirect(const QVector<QPair<int, Qt::SortOrder>> &columns
         unsortedLots = m_sortedLots;
         sorted = m_isSorted;
         m_isSorted = true;
-        m_sortedLots = m_lots;
-
-        if ((columns.size() != 1) || (columns.at(0).first != -1)) {
-            // make the sort deterministic
-            auto columnsPlusIndex = columns;
-            columnsPlusIndex.append(qMakePair(0, columns.isEmpty() ? Qt::AscendingOrder
-                                                                   : columns.constFirst().second));
-
-            std::sort(
-#ifdef AM_SORT_PARALLEL
-                        // c++17 parallel + vectorized, but not supported everywhere yet
-                        std::execution::par_unseq,
-#endif
-                        m_sortedLots.begin(), m_sortedLots.end(), [this, columnsPlusIndex](const auto *lot1, const auto *lot2) {
-                int r = 0;
-                for (const auto &sc : columnsPlusIndex) {
-                    auto cmp = m_columns.value(sc.first).compareFn;
-                    r = cmp ? cmp(lot1, lot2) : 0;
-                    if (r) {
-                        if (sc.second == Qt::DescendingOrder)
-                            r = -r;
-                        break;
-                    }
-                }
-                return r < 0;
-            });
-        }
+        m_sortedLots = sortLots(columns);
     }
 
     // we were filtered before, but we don't want to refilter: the solution is to
@@ -2003,12 +2807,19 @@ void DocumentModel::sortDirect(const QVector<QPair<int, Qt::SortOrder>> &columns
     if (!m_filteredLots.isEmpty()
             && (m_filteredLots.size() != m_sortedLots.size())
             && (m_filteredLots != m_sortedLots)) {
-        m_filteredLots = QtConcurrent::blockingFiltered(m_sortedLots, [this](auto *lot) {
-            return m_filteredLots.contains(lot);
-        });
+        const QSet<Lot *> visible(m_filteredLots.cbegin(), m_filteredLots.cend());
+        LotList filteredLots;
+        filteredLots.reserve(m_filteredLots.size());
+        for (auto *lot : qAsConst(m_sortedLots)) {
+            if (visible.contains(lot))
+                filteredLots.append(lot);
+        }
+        m_filteredLots = filteredLots;
     } else {
         m_filteredLots = m_sortedLots;
     }
+    updateLotPositions(m_sortedLots, &LotPositions::sorted);
+    updateLotRows();
 
     QModelIndexList after;
     foreach (const QModelIndex &idx, before)
@@ -2023,6 +2834,84 @@ void DocumentModel::sortDirect(const QVector<QPair<int, Qt::SortOrder>> &columns
         emit isSortedChanged(isSorted());
 }
 
+LotList DocumentModel::sortLots(const QVector<QPair<int, Qt::SortOrder>> &sortColumns) const
+{
+    if ((sortColumns.size() == 1) && (sortColumns.at(0).first == -1))
+        return m_lots;
+
+    // make the sort deterministic
+    auto columns = sortColumns;
+    columns.append(qMakePair(0, sortColumns.isEmpty() ? Qt::AscendingOrder
+                                                      : sortColumns.constFirst().second));
+
+    // Calling the columns' compareFns for every single comparison of a multi-column sort is
+    // expensive: instead we compute a dense rank per lot and column once (the columns in
+    // parallel) and then sort the lot indexes by comparing these plain integer tuples.
+
+    const int n = int(m_lots.size());
+    const int k = int(columns.size());
+
+    std::vector<int> keys(size_t(n) * size_t(k), 0); // row-major: keys[lot * k + column]
+
+    QVector<int> keyColumns(k);
+    std::iota(keyColumns.begin(), keyColumns.end(), 0);
+
+    QtConcurrent::blockingMap(keyColumns, [&](int c) {
+        const int field = columns.at(c).first;
+
+        if (field == Index) {
+            // the rank is the position in m_lots: no need to look it up via indexOf()
+            for (int i = 0; i < n; ++i)
+                keys[size_t(i) * size_t(k) + size_t(c)] = i;
+            return;
+        }
+        const auto cmp = m_columns.value(field).compareFn;
+        if (!cmp || (n < 2))
+            return;
+
+        std::vector<int> order(size_t(n));
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](int i1, int i2) {
+            return cmp(m_lots.at(i1), m_lots.at(i2)) < 0;
+        });
+
+        int rank = 0;
+        keys[size_t(order[0]) * size_t(k) + size_t(c)] = rank;
+        for (int i = 1; i < n; ++i) {
+            if (cmp(m_lots.at(order[size_t(i) - 1]), m_lots.at(order[size_t(i)])) != 0)
+                ++rank;
+            keys[size_t(order[size_t(i)]) * size_t(k) + size_t(c)] = rank;
+        }
+    });
+
+    std::vector<bool> descending(size_t(k));
+    for (int c = 0; c < k; ++c)
+        descending[size_t(c)] = (columns.at(c).second == Qt::DescendingOrder);
+
+    std::vector<int> order(size_t(n));
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(
+#ifdef AM_SORT_PARALLEL
+                // c++17 parallel + vectorized, but not supported everywhere yet
+                std::execution::par_unseq,
+#endif
+                order.begin(), order.end(), [&](int i1, int i2) {
+        const int *k1 = keys.data() + size_t(i1) * size_t(k);
+        const int *k2 = keys.data() + size_t(i2) * size_t(k);
+        for (int c = 0; c < k; ++c) {
+            if (k1[c] != k2[c])
+                return descending[size_t(c)] ? (k1[c] > k2[c]) : (k1[c] < k2[c]);
+        }
+        return false;
+    });
+
+    LotList sortedLots;
+    sortedLots.reserve(n);
+    for (int i : order)
+        sortedLots.append(m_lots.at(i));
+    return sortedLots;
+}
+
 void DocumentModel::filterDirect(const QVector<Filter> &filter, bool &filtered,
                             LotList &unfilteredLots)
 {
@@ -2033,6 +2922,7 @@ void DocumentModel::filterDirect(const QVector<Filter> &filter, bool &filtered,
     QModelIndexList before = persistentIndexList();
 
     m_filter = filter;
+    compileFilter();
 
     if (!unfilteredLots.isEmpty()) {
         m_isFiltered = filtered;
@@ -2046,11 +2936,13 @@ void DocumentModel::filterDirect(const QVector<Filter> &filter, bool &filtered,
         m_filteredLots = m_sortedLots;
 
         if (!filter.isEmpty()) {
+            // the Index column looks up positions: that is read-only, so it is safe in parallel
             m_filteredLots = QtConcurrent::blockingFiltered(m_sortedLots, [this](auto *lot) {
                 return filterAcceptsLot(lot);
             });
         }
     }
+    updateLotRows();
 
     QModelIndexList after;
     foreach (const QModelIndex &idx, before)
@@ -2079,13 +2971,16 @@ QByteArray DocumentModel::saveSortFilterState() const
     for (const auto &f : m_filter)
         ds << qint8(f.field()) << qint8(f.comparison()) << qint8(f.combination()) << f.expression();
 
+    // side table indexed by the position in m_lots: the visible flags
+    std::vector<bool> visible(size_t(m_lots.size()), false);
+    for (const auto *lot : m_filteredLots)
+        visible[size_t(lotIndex(lot))] = true;
+
     ds << qint32(m_sortedLots.size());
     for (int i = 0; i < m_sortedLots.size(); ++i) {
-        auto *lot = m_sortedLots.at(i);
-        qint32 row = m_lots.indexOf(lot);
-        bool visible = m_filteredLots.contains(lot);
+        qint32 row = lotIndex(m_sortedLots.at(i));
 
-        ds << (visible ? row : (-row - 1)); // can't have -0
+        ds << (visible[size_t(row)] ? row : (-row - 1)); // can't have -0
     }
 
     return ba;
@@ -2215,17 +3110,14 @@ void DocumentModel::reFilter()
 }
 
 
-bool DocumentModel::filterAcceptsLot(const Lot *lot) const
+void DocumentModel::compileFilter()
 {
-    if (!lot)
-        return false;
-    else if (m_filter.isEmpty())
-        return true;
+    m_compiledFilter.clear();
+    m_compiledFilter.reserve(m_filter.size());
 
-    bool result = false;
-    Filter::Combination nextcomb = Filter::Or;
+    for (const Filter &f : qAsConst(m_filter)) {
+        CompiledFilter cf { f.combination() };
 
-    for (const Filter &f : m_filter) {
         int firstcol = f.field();
         int lastcol = firstcol;
         if (firstcol < 0) {
@@ -2233,17 +3125,61 @@ bool DocumentModel::filterAcceptsLot(const Lot *lot) const
             lastcol = columnCount() - 1;
         }
 
-        bool localresult = false;
-        for (int col = firstcol; col <= lastcol && !localresult; ++col) {
-            QVariant v = dataForFilterRole(lot, static_cast<Field>(col));
-            localresult = f.matches(v);
+        for (int col = firstcol; col <= lastcol && !cf.alwaysMatches; ++col) {
+            const auto it = m_columns.constFind(col);
+            if ((it == m_columns.cend()) || !it->filterable) {
+                // the filter role is always empty here, so the outcome is fixed
+                if (f.matches(QString { }))
+                    cf.alwaysMatches = true;
+            } else if (it->intFilterFn) {
+                cf.matchers.emplace_back([f, fn = it->intFilterFn](const Lot *lot) {
+                    return f.matches(fn(lot));
+                });
+            } else if (it->doubleFilterFn) {
+                cf.matchers.emplace_back([f, fn = it->doubleFilterFn](const Lot *lot) {
+                    return f.matches(fn(lot));
+                });
+            } else if (it->filterFn) {
+                cf.matchers.emplace_back([f, fn = it->filterFn](const Lot *lot) {
+                    return f.matches(fn(lot));
+                });
+            } else {
+                // same fallback logic as dataForFilterRole()
+                cf.matchers.emplace_back([f, dataFn = it->dataFn, displayFn = it->displayFn](const Lot *lot) {
+                    QVariant v;
+                    if (dataFn)
+                        v = dataFn(lot);
+                    if ((v.isNull() || (v.userType() >= QMetaType::User)) && displayFn)
+                        v = displayFn(lot);
+                    return f.matches(v);
+                });
+            }
         }
-        if (nextcomb == Filter::And)
-            result = result && localresult;
-        else
-            result = result || localresult;
+        if (cf.alwaysMatches)
+            cf.matchers.clear();
+        m_compiledFilter.append(cf);
+    }
+}
+
+bool DocumentModel::filterAcceptsLot(const Lot *lot) const
+{
+    if (!lot)
+        return false;
+    else if (m_compiledFilter.isEmpty())
+        return true;
+
+    bool result = false;
+    Filter::Combination nextcomb = Filter::Or;
 
-        nextcomb = f.combination();
+    for (const CompiledFilter &cf : m_compiledFilter) {
+        // the filters are combined strictly left to right, so we can short-circuit: an And
+        // can't make a false result true and an Or can't make a true result false
+        if ((nextcomb == Filter::And) ? result : !result) {
+            result = cf.alwaysMatches
+                    || std::any_of(cf.matchers.cbegin(), cf.matchers.cend(),
+                                   [lot](const auto &matcher) { return matcher(lot); });
+        }
+        nextcomb = cf.combination;
     }
     return result;
 }
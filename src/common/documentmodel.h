@@ -33,6 +33,7 @@ class UndoStack;
 QT_FORWARD_DECLARE_CLASS(QUndoCommand)
 class AddRemoveCmd;
 class ChangeCmd;
+class ColumnChangeCmd;
 
 using BrickLink::Lot;
 using BrickLink::LotList;
@@ -125,25 +126,34 @@ public:
         double value() const         { return m_val; }
         double minValue() const      { return m_minval; }
         double cost() const          { return m_cost; }
-        double weight() const        { return m_weight; }
-        int errors() const           { return m_errors; }
+        double weight() const;
+        int errors() const           { return m_ignorePriceAndQuantityErrors ? m_partOrColorErrors : m_errors; }
         int differences() const      { return m_differences; }
         int incomplete() const       { return m_incomplete; }
         QString currencyCode() const { return m_ccode; }
 
     private:
+        Statistics() = default;
         Statistics(const DocumentModel *model, const LotList &list, bool ignoreExcluded,
                    bool ignorePriceAndQuantityErrors = false);
 
-        int m_lots;
-        int m_items;
-        double m_val;
-        double m_minval;
-        double m_cost;
-        double m_weight;
-        int m_errors;
-        int m_differences;
-        int m_incomplete;
+        // sign is +1 to add the lot and -1 to remove it again
+        void addLot(const Lot *lot, int sign);
+        void addLotFlags(QPair<quint64, quint64> flags, int sign);
+        Statistics &operator+=(const Statistics &other);
+
+        int m_lots = 0;
+        int m_items = 0;
+        double m_val = 0;
+        double m_minval = 0;
+        double m_cost = 0;
+        double m_weight = 0;
+        int m_weightMissing = 0;
+        int m_errors = 0;
+        int m_partOrColorErrors = 0;
+        int m_differences = 0;
+        int m_incomplete = 0;
+        bool m_ignorePriceAndQuantityErrors = false;
         QString m_ccode;
 
         friend class DocumentModel;
@@ -232,6 +242,16 @@ public:
 
     QPair<quint64, quint64> lotFlags(const Lot *lot) const;
 
+    // fast path for the delegates: everything needed to render a row, without any QVariants
+    struct RowRenderData {
+        const Lot *lot = nullptr;
+        quint64 errorFlags = 0;
+        quint64 differenceFlags = 0;
+        quint64 version = 0; // changes whenever the displayed data of the lot might change
+    };
+    RowRenderData rowRenderData(int row) const;
+    Qt::Alignment columnAlignment(int column) const;
+
     bool legacyCurrencyCode() const;
     QString currencyCode() const;
     void setCurrencyCode(const QString &code, qreal crate = qreal(1));
@@ -246,11 +266,29 @@ public:
     void beginMacro(const QString &label = QString());
     void endMacro(const QString &label = QString());
 
-    QUndoStack *undoStack() const;
+    UndoStack *undoStack() const;
 
     void applyTo(const LotList &lots, std::function<bool(const Lot &, Lot &)> callback,
                  const QString &actionText = { });
 
+    // Bulk edits of numeric fields: the values of \a fields are gathered into one contiguous
+    // column per field (in the order of \a lots), the callback modifies these columns in place
+    // and only the lots with actually changed values end up in the undo stack.
+    using FieldColumns = QVector<std::vector<double>>;
+    static bool isNumericField(Field field);
+    void applyToColumns(const LotList &lots, const QVector<Field> &fields,
+                        const std::function<void(FieldColumns &)> &callback,
+                        const QString &actionText = { });
+
+    // a single changed field of a lot, as recorded by ChangeCmd: the value is swapped with the
+    // lot's current one on every undo/redo
+    struct FieldChange {
+        int slot;
+        Field field;
+        double number; // numeric, enum and bool fields
+        QString text;  // text fields
+    };
+
     const Lot *differenceBaseLot(const Lot *lot) const;
 
     QByteArray saveSortFilterState() const;
@@ -283,16 +321,44 @@ private:
     void insertLotsDirect(const LotList &lots, QVector<int> &positions, QVector<int> &sortedPositions, QVector<int> &filteredPositions);
     void removeLotsDirect(const LotList &lots, QVector<int> &positions, QVector<int> &sortedPositions, QVector<int> &filteredPositions);
     void changeLotsDirect(std::vector<std::pair<Lot *, Lot> > &changes);
-    void changeCurrencyDirect(const QString &ccode, qreal crate, double *&prices);
+    void changeLotFieldsDirect(std::vector<FieldChange> &changes);
+    void changeLotColumnsDirect(const LotList &lots, const QVector<Field> &fields,
+                                std::vector<double> &values);
+    void changedLotsDirect(const LotList &lots, const std::function<void(int, Lot *)> &change);
+    void changeCurrencyDirect(const QString &ccode, qreal crate, LotList &lots,
+                              std::vector<double> &prices);
     void resetDifferenceModeDirect(QHash<const Lot *, Lot>
                                    &differenceBase);
     void filterDirect(const QVector<Filter> &filterList, bool &filtered,
                       LotList &unfiltered);
     void sortDirect(const QVector<QPair<int, Qt::SortOrder>> &columns, bool &sorted, LotList &unsorted);
+    LotList sortLots(const QVector<QPair<int, Qt::SortOrder>> &columns) const;
+    void compileFilter();
+
+    static constexpr int LiveSortFilterBatchLimit = 32;
+    bool isLiveSortFilter() const;
+    bool lotLessThan(const Lot *l1, const Lot *l2) const;
+    int sortedPosition(const LotList &list, int from, const Lot *lot) const;
+    void moveLotToSortFilterPosition(Lot *lot, bool emitRowSignals);
+    void updateSortFilterOrder(const LotList &changedLots);
+    struct LotPositions {
+        int index = -1;  // in m_lots
+        int sorted = -1; // in m_sortedLots
+        int row = -1;    // in m_filteredLots, -1 if filtered out
+    };
+    int lotIndex(const Lot *lot) const;
+    int lotSortedIndex(const Lot *lot) const;
+    int lotRow(const Lot *lot) const;
+    void updateLotPositions(const LotList &list, int LotPositions::*position, int from = 0, int to = -1);
+    void updateLotRows();
 
     void emitDataChanged(const QModelIndex &tl = { }, const QModelIndex &br = { });
     void emitStatisticsChanged();
     void updateLotFlags(const Lot *lot);
+    int lotSlot(const Lot *lot) const;
+    void assignLotSlot(Lot *lot);
+    void addToStatistics(const Lot *lot, int sign);
+    void recalculateStatistics();
     void setLotFlags(const Lot *lot, quint64 errors, quint64 updated);
 
     void updateModified();
@@ -303,6 +369,7 @@ private:
 
     friend class AddRemoveCmd;
     friend class ChangeCmd;
+    friend class ColumnChangeCmd;
     friend class CurrencyCmd;
     friend class SortCmd;
     friend class FilterCmd;
@@ -320,7 +387,10 @@ private:
         std::function<QVariant(const Lot *)> dataFn = { };
         std::function<void(Lot *, const QVariant &v)> setDataFn = { };
         std::function<QVariant(const Lot *)> displayFn = { };
-        std::function<QVariant(const Lot *)> filterFn = { };
+        std::function<QString(const Lot *)> filterFn = { };
+        // typed accessors for the compiled filter: no QVariant round-trip
+        std::function<qint64(const Lot *)> intFilterFn = { };
+        std::function<double(const Lot *)> doubleFilterFn = { };
         std::function<int(const Lot *, const Lot *)> compareFn;
     };
     QHash<int, Column> m_columns;
@@ -331,13 +401,35 @@ private:
 
     QHash<const Lot *, Lot> m_differenceBase;
     QVector<int>     m_fakeIndexes; // for the consolidate dialogs
-    QHash<const Lot *, QPair<quint64, quint64>> m_lotFlags;
+
+    // per-lot flags as dense side tables, indexed by Lot::modelSlot()
+    std::vector<Lot *> m_slotLots;
+    std::vector<quint64> m_lotErrorFlags;
+    std::vector<quint64> m_lotDifferenceFlags;
+    std::vector<quint64> m_lotVersions;
+    // kept up to date on every insert, remove, move, sort and filter, so the lookups never
+    // have to modify anything (they are also used from QtConcurrent in filterDirect())
+    std::vector<LotPositions> m_lotPositions;
+    quint64 m_renderGeneration = 0; // invalidates all lot versions at once
+    quint64 m_lastVersion = 0;
+
+    // running totals over m_lots, split by the Exclude status
+    Statistics m_includedStatistics;
+    Statistics m_excludedStatistics;
 
 
     QVector<QPair<int, Qt::SortOrder>> m_sortColumns = { { -1, Qt::AscendingOrder } };
     QScopedPointer<Filter::Parser> m_filterParser;
     QVector<Filter> m_filter;
 
+    // m_filter resolved into per-column predicates, see compileFilter()
+    struct CompiledFilter {
+        Filter::Combination combination = Filter::And; // how the next filter is combined
+        bool alwaysMatches = false;
+        std::vector<std::function<bool(const Lot *)>> matchers;
+    };
+    QVector<CompiledFilter> m_compiledFilter;
+
     bool m_isSorted = false;   // freshly sorted, no changes
     bool m_isFiltered = false; // freshly filtered, no changes
 
@@ -16,10 +16,11 @@
 #include <QUndoCommand>
 #include <QPointer>
 
+#include "utility/undo.h"
 #include "documentmodel.h"
 
 
-class AddRemoveCmd : public QUndoCommand
+class AddRemoveCmd : public UndoCommand
 {
 public:
     enum Type { Add, Remove };
@@ -29,6 +30,7 @@ public:
                  const LotList &lots);
     ~AddRemoveCmd() override;
     int id() const override;
+    qint64 memoryUsage() const override;
 
     void redo() override;
     void undo() override;
@@ -44,35 +46,58 @@ private:
     Type               m_type;
 };
 
-class ChangeCmd : public QUndoCommand
+class ChangeCmd : public UndoCommand
 {
 public:
     ChangeCmd(DocumentModel *model, const std::vector<std::pair<Lot *, Lot>> &changes,
               DocumentModel::Field hint = DocumentModel::FieldCount);
     int id() const override;
     bool mergeWith(const QUndoCommand *other) override;
+    qint64 memoryUsage() const override;
 
     void redo() override;
     void undo() override;
 
 private:
     void updateText();
+    bool hasFieldChanges(int slot) const;
+    bool hasLotChange(const Lot *lot) const;
 
     DocumentModel *m_model;
     uint m_loopCount;
     DocumentModel::Field m_hint;
-    std::vector<std::pair<Lot *, Lot>> m_changes;
+    // only lots with changes that can't be expressed as field changes are copied completely
+    std::vector<DocumentModel::FieldChange> m_fieldChanges; // sorted by slot and field
+    std::vector<std::pair<Lot *, Lot>> m_lotChanges;        // sorted by lot
 
     static QTimer *s_eventLoopCounter;
 };
 
-class CurrencyCmd : public QUndoCommand
+class ColumnChangeCmd : public UndoCommand
+{
+public:
+    ColumnChangeCmd(DocumentModel *model, const LotList &lots,
+                    const QVector<DocumentModel::Field> &fields, std::vector<double> &&values);
+    int id() const override;
+    qint64 memoryUsage() const override;
+
+    void redo() override;
+    void undo() override;
+
+private:
+    DocumentModel *m_model;
+    LotList m_lots;
+    QVector<DocumentModel::Field> m_fields;
+    std::vector<double> m_values; // m_lots.count() * m_fields.count(), one column per field
+};
+
+class CurrencyCmd : public UndoCommand
 {
 public:
     CurrencyCmd(DocumentModel *model, const QString &ccode, qreal crate);
-    ~CurrencyCmd() override;
 
     int id() const override;
+    qint64 memoryUsage() const override;
 
     void redo() override;
     void undo() override;
@@ -81,14 +106,16 @@ private:
     DocumentModel * m_model;
     QString    m_ccode;
     qreal      m_crate;
-    double *   m_prices; // m_items.count() * 5 (price, origPrice, tierPrice * 3)
+    LotList    m_lots;
+    std::vector<double> m_prices; // m_lots.count() * 5, one column per field (cost, price, tierPrice * 3)
 };
 
-class ResetDifferenceModeCmd : public QUndoCommand
+class ResetDifferenceModeCmd : public UndoCommand
 {
 public:
     ResetDifferenceModeCmd(DocumentModel *model, const LotList &lots);
     int id() const override;
+    qint64 memoryUsage() const override;
 
     void redo() override;
     void undo() override;
@@ -99,12 +126,13 @@ private:
 };
 
 
-class SortCmd : public QUndoCommand
+class SortCmd : public UndoCommand
 {
 public:
     SortCmd(DocumentModel *model, const QVector<QPair<int, Qt::SortOrder>> &columns);
     int id() const override;
     bool mergeWith(const QUndoCommand *other) override;
+    qint64 memoryUsage() const override;
 
     void redo() override;
     void undo() override;
@@ -118,12 +146,13 @@ private:
     QVector<Lot *> m_unsorted;
 };
 
-class FilterCmd : public QUndoCommand
+class FilterCmd : public UndoCommand
 {
 public:
     FilterCmd(DocumentModel *model, const QVector<Filter> &filterList);
     int id() const override;
     bool mergeWith(const QUndoCommand *other) override;
+    qint64 memoryUsage() const override;
 
     void redo() override;
     void undo() override;
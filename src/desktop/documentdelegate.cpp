@@ -88,11 +88,15 @@ bool LanguageChangeHelper::eventFilter(QObject *o, QEvent *e)
 DocumentDelegate::DocumentDelegate(QTableView *table)
     : QItemDelegate(table)
     , m_table(table)
+    , m_displayCache(10000)
 {
     m_table->viewport()->setAttribute(Qt::WA_Hover);
 
     new LanguageChangeHelper(this, table);
 
+    connect(Config::inst(), &Config::measurementSystemChanged,
+            this, [this]() { m_displayCache.clear(); });
+
     connect(BrickLink::core(), &BrickLink::Core::itemImageScaleFactorChanged,
             this, [this]() {
         m_table->resizeRowsToContents();
@@ -157,20 +161,31 @@ inline qHashResult qHash(const DocumentDelegate::TextLayoutCacheKey &key, qHashR
     return qHash(key.text) ^ sizeHash ^ key.fontSize ^ seed;
 }
 
+inline qHashResult qHash(const DocumentDelegate::DisplayCacheKey &key, qHashResult seed)
+{
+    return qHash(key.lot, seed) ^ qHash(key.column, seed);
+}
+
 void DocumentDelegate::paint(QPainter *p, const QStyleOptionViewItem &option, const QModelIndex &idx) const
 {
     if (!idx.isValid())
         return;
 
-    const auto *lot = idx.data(DocumentModel::LotPointerRole).value<const Lot *>();
-    const auto *base = idx.data(DocumentModel::BaseLotPointerRole).value<const Lot *>();
-    const auto errorFlags = idx.data(DocumentModel::ErrorFlagsRole).value<quint64>();
-    const auto differenceFlags = idx.data(DocumentModel::DifferenceFlagsRole).value<quint64>();
+    // one typed call instead of a QVariant round-trip per role
+    const auto *model = qobject_cast<const DocumentModel *>(idx.model());
+    if (!model)
+        return;
+    const auto row = model->rowRenderData(idx.row());
+    const auto *lot = row.lot;
+    const auto errorFlags = row.errorFlags;
+    const auto differenceFlags = row.differenceFlags;
+    if (!lot)
+        return;
 
     p->save();
     auto restorePainter = qScopeGuard([p] { p->restore(); });
 
-    Qt::Alignment align = (Qt::Alignment(idx.data(Qt::TextAlignmentRole).toInt()) & ~Qt::AlignVertical_Mask) | Qt::AlignVCenter;
+    Qt::Alignment align = (model->columnAlignment(idx.column()) & ~Qt::AlignVertical_Mask) | Qt::AlignVCenter;
 
     if ((idx.column() == DocumentModel::Index) && (p->device()->devType() != QInternal::Printer)) {
         QStyle *style = option.widget ? option.widget->style() : QApplication::style();
@@ -252,12 +267,28 @@ void DocumentDelegate::paint(QPainter *p, const QStyleOptionViewItem &option, co
     }
 
     QImage image;
-    QVariant display = idx.data(Qt::DisplayRole);
-    QString str = displayData(idx, display, false);
+    QVariant display;
+    QString str;
+
+    if ((idx.column() == DocumentModel::Picture) || (idx.column() == DocumentModel::Index)) {
+        // not covered by the lot's version: pictures are loaded asynchronously and the index
+        // depends on the lot's position
+        display = idx.data(Qt::DisplayRole);
+        str = displayData(idx, display, false);
+    } else if (auto *cached = m_displayCache.object({ lot, idx.column() });
+               cached && (cached->version == row.version)) {
+        str = cached->text;
+    } else {
+        display = idx.data(Qt::DisplayRole);
+        str = displayData(idx, display, false);
+        m_displayCache.insert({ lot, idx.column() }, new DisplayCacheEntry { row.version, str });
+    }
     int checkmark = 0;
     bool selectionFrame = false;
     QColor selectionFrameFill = Qt::white;
 
+    const Lot *base = nullptr;
+
     if (!selected) {
         switch (idx.column()) {
         case DocumentModel::ItemType:
@@ -277,6 +308,7 @@ void DocumentDelegate::paint(QPainter *p, const QStyleOptionViewItem &option, co
             break;
 
         case DocumentModel::QuantityDiff:
+            base = model->differenceBaseLot(lot);
             if (base && (base->quantity() < lot->quantity()))
                 bg = QColor::fromRgbF(0, 1, 0, 0.3f);
             else if (base && (base->quantity() > lot->quantity()))
@@ -289,6 +321,7 @@ void DocumentDelegate::paint(QPainter *p, const QStyleOptionViewItem &option, co
             break;
 
         case DocumentModel::PriceDiff: {
+            base = model->differenceBaseLot(lot);
             if (base && (base->price() < lot->price()))
                 bg = QColor::fromRgbF(0, 1, 0, 0.3f);
             else if (base && (base->price() > lot->price()))
@@ -1146,6 +1179,8 @@ QString DocumentDelegate::displayData(const QModelIndex &idx, const QVariant &di
 
 void DocumentDelegate::languageChange()
 {
+    m_displayCache.clear();
+
     // these get recreated on the next use with the correct title
     delete m_select_color.data();
     delete m_select_item.data();
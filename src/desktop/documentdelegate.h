@@ -94,4 +94,21 @@ protected:
     };
     friend qHashResult qHash(const DocumentDelegate::TextLayoutCacheKey &key, qHashResult seed);
     static QCache<TextLayoutCacheKey, QTextLayout> s_textLayoutCache;
+
+    // the formatted display strings, valid as long as the version reported by the model matches
+    struct DisplayCacheKey {
+        const Lot *lot;
+        int column;
+
+        bool operator==(const DisplayCacheKey &other) const
+        {
+            return (lot == other.lot) && (column == other.column);
+        }
+    };
+    struct DisplayCacheEntry {
+        quint64 version;
+        QString text;
+    };
+    friend qHashResult qHash(const DocumentDelegate::DisplayCacheKey &key, qHashResult seed);
+    mutable QCache<DisplayCacheKey, DisplayCacheEntry> m_displayCache;
 };
@@ -198,6 +198,8 @@ MainWindow::MainWindow(QWidget *parent)
 
     connect(BrickLink::core(), &BrickLink::Core::transferProgress,
             this, &MainWindow::transferProgressUpdate);
+    connect(BrickLink::core(), &BrickLink::Core::transferStatisticsChanged,
+            this, &MainWindow::transferStatisticsUpdate);
 
     connectView(nullptr);
 
@@ -373,11 +375,21 @@ void MainWindow::languageChange()
         if (name == "dock_errorlog"_l1)
             dock->setWindowTitle(tr("Error Log"));
     }
-    if (m_progress) {
-        m_progress->setToolTipTemplates(tr("Offline"),
-                                        tr("No outstanding jobs"),
-                                        tr("Downloading...<br><b>%p%</b> finished<br>(%v of %m)"));
-    }
+    updateProgressToolTip();
+}
+
+void MainWindow::updateProgressToolTip()
+{
+    if (!m_progress)
+        return;
+
+    QString normal = tr("Downloading...<br><b>%p%</b> finished<br>(%v of %m)");
+    if (m_transferThrottled)
+        normal = normal % u"<br><br>" % tr("BrickLink is limiting the download rate.");
+    if (m_transferRetried)
+        normal = normal % u"<br>" % tr("%n request(s) had to be retried.", nullptr, m_transferRetried);
+
+    m_progress->setToolTipTemplates(tr("Offline"), tr("No outstanding jobs"), normal);
 }
 
 MainWindow::~MainWindow()
@@ -1207,6 +1219,18 @@ void MainWindow::transferProgressUpdate(int p, int t)
     }
 }
 
+void MainWindow::transferStatisticsUpdate(int queued, int inFlight, int retried, int throttled)
+{
+    Q_UNUSED(queued)
+    Q_UNUSED(inFlight)
+
+    if ((retried != m_transferRetried) || (throttled != m_transferThrottled)) {
+        m_transferRetried = retried;
+        m_transferThrottled = throttled;
+        updateProgressToolTip();
+    }
+}
+
 void MainWindow::showSettings(const QString &page)
 {
     SettingsDialog d(page, this);
@@ -83,6 +83,7 @@ protected slots:
 private slots:
     void connectView(View *w);
     void transferProgressUpdate(int p, int t);
+    void transferStatisticsUpdate(int queued, int inFlight, int retried, int throttled);
 
     void showSettings(const QString &page = { });
 
@@ -114,6 +115,7 @@ private:
     void setActiveViewPane(ViewPane *newActive);
     ViewPane *createViewPane(Document *activeDocument);
     void deleteViewPane(ViewPane *viewPane);
+    void updateProgressToolTip();
 
     Workspace *m_workspace;
     QList<QAction *> m_extensionContextActions;
@@ -121,6 +123,8 @@ private:
     DeveloperConsole *m_devConsole;
     ProgressCircle *m_progress;
     QWidgetAction *m_progressAction;
+    int m_transferRetried = 0;
+    int m_transferThrottled = 0;
     QToolBar *m_toolbar;
     QMenu *m_extrasMenu;
     LoadColumnLayoutMenuAdapter *m_loadColumnLayoutMenu;
@@ -1036,6 +1036,8 @@ void SettingsDialog::load()
     w_openbrowser->setChecked(Config::inst()->openBrowserOnExport());
     w_restore_session->setChecked(Config::inst()->restoreLastSession());
     w_modifications->setChecked(Config::inst()->visualChangesMarkModified());
+    w_live_sortfilter->setChecked(Config::inst()->liveSortFilter());
+    w_undo_memory->setValue(Config::inst()->undoMemoryLimit());
 
     m_preferedCurrency = Config::inst()->defaultCurrencyCode();
     currenciesUpdated();
@@ -1097,6 +1099,8 @@ void SettingsDialog::save()
     Config::inst()->setOpenBrowserOnExport(w_openbrowser->isChecked());
     Config::inst()->setRestoreLastSession(w_restore_session->isChecked());
     Config::inst()->setVisualChangesMarkModified(w_modifications->isChecked());
+    Config::inst()->setLiveSortFilter(w_live_sortfilter->isChecked());
+    Config::inst()->setUndoMemoryLimit(w_undo_memory->value());
 
     QDir dd(w_docdir->itemData(0).toString());
 
@@ -242,9 +242,10 @@ void TaskInfoWidget::delayedSelectionUpdate()
         m_pic->setItemAndColor(m_selection.front()->item(), m_selection.front()->color());
         setCurrentWidget(m_pic);
     } else {
-        auto stat = m_document->model()->statistics(m_selection.isEmpty() ? m_document->model()->lots()
-                                                                        : m_selection,
-                                                  false /* ignoreExcluded */);
+        // the document's statistics are precalculated, but only if we pass in lots() directly
+        auto model = m_document->model();
+        auto stat = m_selection.isEmpty() ? model->statistics(model->lots(), false /* ignoreExcluded */)
+                                          : model->statistics(m_selection, false /* ignoreExcluded */);
         QLocale loc;
         QString ccode = m_document->model()->currencyCode();
         QString wgtstr;
@@ -829,8 +829,8 @@ QCoro::Task<> View::partOutItems()
         foreach(Lot *lot, selectedLots()) {
             if (inplace) {
                 if (lot->item()->hasInventory() && lot->quantity()) {
-                    const auto &parts = lot->item()->consistsOf();
-                    if (!parts.isEmpty()) {
+                    const auto parts = lot->item()->consistsOf();
+                    if (!parts.empty()) {
                         int multiply = lot->quantity();
 
                         LotList newLots;
@@ -56,6 +56,10 @@ public:
 
     const char *what() const noexcept override;
 
+    // needed to transport the exception out of QtConcurrent
+    void raise() const override { throw *this; }
+    Exception *clone() const override { return new Exception(*this); }
+
 protected:
     static QString fileMessage(QFileDevice *f)
     {
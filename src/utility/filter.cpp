@@ -49,6 +49,8 @@ void Filter::setExpression(const QString &expr)
     m_asDouble = loc.toDouble(expr, &isDouble);
     m_isDouble = isDouble;
 
+    m_asMatcher = QStringMatcher(expr, Qt::CaseInsensitive);
+
     if (expr.contains('?'_l1) || expr.contains('*'_l1) || expr.contains('['_l1)) {
         m_isRegExp = true;
         m_asRegExp.setPattern(QRegularExpression::wildcardToRegularExpression(expr));
@@ -85,83 +87,117 @@ void Filter::setCombination(Combination cmb)
 
 bool Filter::matches(const QVariant &v) const
 {
-    bool isInt = false;
-    qint64 i1 = 0, i2 = 0;
-    QString s1, s2;
-    
     switch (v.userType()) {
     case QMetaType::Int:
     case QMetaType::UInt:
     case QMetaType::LongLong:
-    case QMetaType::ULongLong: {
-        if (!m_isInt)
-            return false; // data is int, but expression is not
-        i1 = m_asInt;
-        i2 = v.toInt();
-        isInt = true;
-        break;
-    }   
-    case QMetaType::Double: {
-        if (!m_isDouble)
-            return false;
-        i1 = qRound64(m_asDouble * 1000.);
-        i2 = qRound64(v.toDouble() * 1000.);
-        isInt = true;
-        break;
-    }
-    case QMetaType::QDateTime: {
-        if (!m_asDateTime.isValid())
-            return false;
-        i1 = m_asDateTime.toSecsSinceEpoch();
-        i2 = v.toDateTime().toSecsSinceEpoch();
-        isInt = true;
-        break;
-    }
+    case QMetaType::ULongLong:
+        return matches(v.toLongLong());
+    case QMetaType::Double:
+        return matches(v.toDouble());
+    case QMetaType::QDateTime:
+        return matches(v.toDateTime());
     default:
-        s1 = m_expression;
-        s2 = v.toString();
-        break;
+        return matches(v.toString());
     }
+}
+
+bool Filter::matches(qint64 i) const
+{
+    if (!m_isInt)
+        return false; // data is int, but expression is not
+
+    return compareNumbers(m_asInt, i, [i]() { return QString::number(i); });
+}
 
+bool Filter::matches(double d) const
+{
+    if (!m_isDouble)
+        return false;
+
+    return compareNumbers(qRound64(m_asDouble * 1000.), qRound64(d * 1000.),
+                          [d]() { return QVariant(d).toString(); });
+}
+
+bool Filter::matches(const QDateTime &dt) const
+{
+    if (!m_asDateTime.isValid())
+        return false;
+
+    return compareNumbers(m_asDateTime.toSecsSinceEpoch(), dt.toSecsSinceEpoch(),
+                          [&dt]() { return QVariant(dt).toString(); });
+}
+
+bool Filter::matches(const QString &str) const
+{
     switch (comparison()) {
     case Is:
-        return isInt ? i2 == i1 : s2.compare(s1, Qt::CaseInsensitive) == 0;
+        return str.compare(m_expression, Qt::CaseInsensitive) == 0;
     case IsNot:
-        return isInt ? i2 != i1 : s2.compare(s1, Qt::CaseInsensitive) != 0;
+        return str.compare(m_expression, Qt::CaseInsensitive) != 0;
     case Less:
-        return isInt ? i2 < i1 : false;
     case LessEqual:
-        return isInt ? i2 <= i1 : false;
     case Greater:
-        return isInt ? i2 > i1 : false;
     case GreaterEqual:
-        return isInt ? i2 >= i1 : false;
+        return false;
     case StartsWith:
-        return isInt ? false : s2.startsWith(s1, Qt::CaseInsensitive);
+        return str.startsWith(m_expression, Qt::CaseInsensitive);
     case DoesNotStartWith:
-        return isInt ? false : !s2.startsWith(s1, Qt::CaseInsensitive);
+        return !str.startsWith(m_expression, Qt::CaseInsensitive);
     case EndsWith:
-        return isInt ? false : s2.endsWith(s1, Qt::CaseInsensitive);
+        return str.endsWith(m_expression, Qt::CaseInsensitive);
     case DoesNotEndWith:
-        return isInt ? false : !s2.endsWith(s1, Qt::CaseInsensitive);
+        return !str.endsWith(m_expression, Qt::CaseInsensitive);
     case Matches:
-    case DoesNotMatch: {
-        if (m_isRegExp) {
-            // We are using QRegularExpressions in multiple threads here, although the class is not
-            // marked thread-safe. We are relying on the const match() function to be thread-safe,
-            // which it currently is up to Qt 6.2.
-
-            bool res = m_asRegExp.match(v.toString()).hasMatch();
-            return (comparison() == Matches) ? res : !res;
-        } else {
-            bool res = v.toString().contains(m_expression, Qt::CaseInsensitive);
-            return (comparison() == Matches) ? res : !res;
-        }
+        return matchesPattern(str);
+    case DoesNotMatch:
+        return !matchesPattern(str);
     }
+    return false;
+}
+
+template <typename T> bool Filter::compareNumbers(qint64 i1, qint64 i2, T toString) const
+{
+    switch (comparison()) {
+    case Is:
+        return i2 == i1;
+    case IsNot:
+        return i2 != i1;
+    case Less:
+        return i2 < i1;
+    case LessEqual:
+        return i2 <= i1;
+    case Greater:
+        return i2 > i1;
+    case GreaterEqual:
+        return i2 >= i1;
+    case StartsWith:
+    case DoesNotStartWith:
+    case EndsWith:
+    case DoesNotEndWith:
+        return false;
+    case Matches:
+        return matchesPattern(toString());
+    case DoesNotMatch:
+        return !matchesPattern(toString());
     }
     return false;
 }
 
+bool Filter::matchesPattern(const QString &str) const
+{
+    if (m_isRegExp) {
+        // We are using QRegularExpressions in multiple threads here, although the class is not
+        // marked thread-safe. We are relying on the const match() function to be thread-safe,
+        // which it currently is up to Qt 6.2.
+
+        return m_asRegExp.match(str).hasMatch();
+    } else {
+        // the matcher's case folded pattern is precomputed in setExpression()
+        return m_asMatcher.indexIn(str) >= 0;
+    }
+}
+
 QString Filter::Parser::toString(const QVector<Filter> &filter, bool preferSymbolic) const
 {
     QString result;
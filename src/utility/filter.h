@@ -19,6 +19,7 @@
 #include <QPair>
 #include <QDateTime>
 #include <QRegularExpression>
+#include <QStringMatcher>
 #include <QCoreApplication>
 #include <QDebug>
 
@@ -73,7 +74,11 @@ public:
     void setCombination(Combination cmb);
 
     bool matches(const QVariant &v) const;
-    
+    bool matches(qint64 i) const;
+    bool matches(double d) const;
+    bool matches(const QDateTime &dt) const;
+    bool matches(const QString &str) const;
+
 
     class Parser {
     public:
@@ -113,6 +118,9 @@ public:
     };
     
 private:
+    template <typename T> bool compareNumbers(qint64 i1, qint64 i2, T toString) const;
+    bool matchesPattern(const QString &str) const;
+
     QString     m_expression;
     int         m_field = -1;
     Comparison  m_comparison = Matches;
@@ -124,6 +132,7 @@ private:
     double      m_asDouble = 0;
     QDateTime   m_asDateTime;
     QRegularExpression m_asRegExp;
+    QStringMatcher m_asMatcher;
 };
 
 QDebug &operator<<(QDebug &dbg, const Filter &filter);
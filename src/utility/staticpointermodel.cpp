@@ -172,6 +172,21 @@ void StaticPointerModel::sort(int column, Qt::SortOrder order)
     emit layoutAboutToBeChanged({ }, VerticalSortHint);
     QModelIndexList before = persistentIndexList();
 
+    sortInternal(column, order);
+
+    if (filterDelayTimer && filterDelayTimer->isActive())
+        filterDelayTimer->stop();
+    invalidateFilterInternal();
+
+    QModelIndexList after;
+    foreach (const QModelIndex &idx, before)
+        after.append(index(pointer(idx), idx.column()));
+    changePersistentIndexList(before, after);
+    emit layoutChanged({ }, VerticalSortHint);
+}
+
+void StaticPointerModel::sortInternal(int column, Qt::SortOrder order)
+{
     if (column >= 0 && column < columnCount()) {
         qParallelSort(sorted.begin(), sorted.end(), [column, order, this](int r1, int r2) {
             const void *pointer1 = pointerAt(order == Qt::AscendingOrder ? r1 : r2);
@@ -184,19 +199,28 @@ void StaticPointerModel::sort(int column, Qt::SortOrder order)
         //std::sort(std::execution::par_unseq, sorted.begin(), sorted.end(), sorter);
 
     } else { // restore the source model order
-        for (int i = 0; i < n; ++i)
-            sorted[i] = i;
+        std::iota(sorted.begin(), sorted.end(), 0);
     }
+}
+
+void StaticPointerModel::beginResetPointers()
+{
+    beginResetModel();
 
     if (filterDelayTimer && filterDelayTimer->isActive())
         filterDelayTimer->stop();
+    sorted.clear();
+    filtered.clear();
+}
+
+void StaticPointerModel::endResetPointers()
+{
+    init();
+    if (pointerCount() >= 2)
+        sortInternal(lastSortColumn, lastSortOrder);
     invalidateFilterInternal();
 
-    QModelIndexList after;
-    foreach (const QModelIndex &idx, before)
-        after.append(index(pointer(idx), idx.column()));
-    changePersistentIndexList(before, after);
-    emit layoutChanged({ }, VerticalSortHint);
+    endResetModel();
 }
 
 int StaticPointerModel::sortColumn() const
@@ -54,10 +54,15 @@ protected:
     QModelIndex index(const void *pointer, int column = 0) const;
     const void *pointer(const QModelIndex &index) const;
 
+    // call these around a change of the underlying pointers (e.g. a database update)
+    void beginResetPointers();
+    void endResetPointers();
+
 private:
     void init() const;
     void invalidateFilterDelayed();
     void invalidateFilterInternal();
+    void sortInternal(int column, Qt::SortOrder order);
 
     mutable QVector<int> sorted; // this needs to initialized in the first init() call
     QVector<int> filtered;
@@ -11,6 +11,9 @@
 **
 ** See http://fsf.org/licensing/licenses/gpl.html for GPL licensing information.
 */
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 #include <QThread>
 #include <QFile>
@@ -20,6 +23,10 @@
 #include <QNetworkReply>
 #include <QCoreApplication>
 #include <QUrlQuery>
+#include <QRandomGenerator>
+#if QT_VERSION >= QT_VERSION_CHECK(6, 3, 0)
+#  include <QHttp1Configuration>
+#endif
 
 #include "common/config.h"
 #include "utility.h"
@@ -81,6 +88,8 @@ void TransferJob::resetForReuse()
     m_respcode = 0;
     m_status = Inactive;
     m_was_not_modified = false;
+    m_backoff_count = 0;
+    m_not_before = 0;
     m_effective_url.clear();
     m_redirect_url.clear();
     m_error_string.clear();
@@ -165,6 +174,8 @@ Transfer::Transfer(QObject *parent)
             this, &Transfer::progress, Qt::QueuedConnection);
     connect(m_retriever, &TransferRetriever::overallProgress,
             this, &Transfer::overallProgress, Qt::QueuedConnection);
+    connect(m_retriever, &TransferRetriever::statisticsChanged,
+            this, &Transfer::statisticsChanged, Qt::QueuedConnection);
 }
 
 Transfer::~Transfer()
@@ -203,6 +214,20 @@ void Transfer::abortAllJobs()
     QMetaObject::invokeMethod(m_retriever, &TransferRetriever::abortAllJobs, Qt::BlockingQueuedConnection);
 }
 
+void Transfer::setMaxConnectionsPerHost(int n)
+{
+    QMetaObject::invokeMethod(m_retriever, [this, n]() {
+        m_retriever->setMaxConnectionsPerHost(n);
+    }, Qt::QueuedConnection);
+}
+
+void Transfer::setPolicy(TransferJob::JobClass jobClass, const TransferPolicy &policy)
+{
+    QMetaObject::invokeMethod(m_retriever, [this, jobClass, policy]() {
+        m_retriever->setPolicy(jobClass, policy);
+    }, Qt::QueuedConnection);
+}
+
 QString Transfer::userAgent() const
 {
     return m_user_agent;
@@ -224,35 +249,124 @@ QString Transfer::defaultUserAgent()
 TransferRetriever::TransferRetriever(Transfer *transfer)
     : QObject()
     , m_transfer(transfer)
-    , m_maxConnections(4) // mirror the internal QNAM setting
-{ }
+{
+    // BrickLink starts to answer with 429s and 503s when it gets hammered with too many requests:
+    // the price guide and store pages are a lot more sensitive than the picture CDN
+    m_policies[TransferJob::Picture]    = { 10, 20, 3, 1000,  30000 };
+    m_policies[TransferJob::PriceGuide] = {  4,  8, 5, 2000, 120000 };
+    m_policies[TransferJob::Order]      = {  2,  4, 5, 2000, 120000 };
+    m_policies[TransferJob::Inventory]  = {  1,  2, 5, 2000, 120000 };
+
+    m_clock.start();
+}
 
 TransferRetriever::~TransferRetriever()
 {
     abortAllJobs();
 }
 
+bool TransferRetriever::isMergeable(const TransferJob *j)
+{
+    return (j->m_http_method == TransferJob::HttpGet) && j->m_data && !j->m_only_if_newer.isValid();
+}
+
+void TransferRetriever::setMaxConnectionsPerHost(int n)
+{
+    m_maxConnectionsPerHost = qMax(1, n);
+    schedule();
+}
+
+void TransferRetriever::setPolicy(TransferJob::JobClass jobClass, const TransferPolicy &policy)
+{
+    if (jobClass >= TransferJob::JobClassCount)
+        return;
+    auto &p = m_policies[jobClass];
+    p = policy;
+    p.requestsPerSecond = qMax(0., p.requestsPerSecond);
+    p.burst = qMax(1, p.burst);
+    p.maxRetries = qBound(0, p.maxRetries, 15);
+    p.backoffMs = qMax(1, p.backoffMs);
+    p.maxBackoffMs = qMax(p.backoffMs, p.maxBackoffMs);
+
+    // the adjusted rates and saved up bursts were relative to the old policy
+    for (auto &host : m_hosts)
+        host.buckets[jobClass] = { };
+    schedule();
+}
+
 void TransferRetriever::addJob(TransferJob *job, bool highPriority)
 {
     if (job->isAborted()) {
         emit finished(job);
         emit m_transfer->overallProgress(++m_progressDone, ++m_progressTotal);
     } else {
+        emit m_transfer->overallProgress(m_progressDone, ++m_progressTotal);
+
+        if (isMergeable(job)) {
+            if (auto *leader = m_mergeableJobs.value(job->url())) {
+                m_mergedJobs.insert(leader, job);
+
+                if (highPriority && !leader->isActive()) {
+                    auto &jobs = m_hosts[leader->url().host()].jobs[leader->m_job_class];
+                    if (jobs.removeOne(leader))
+                        jobs.prepend(leader);
+                }
+                return;
+            }
+            m_mergeableJobs.insert(job->url(), job);
+        }
+
+        auto &jobs = m_hosts[job->url().host()].jobs[job->m_job_class];
         if (highPriority)
-            m_jobs.prepend(job);
+            jobs.prepend(job);
         else
-            m_jobs.append(job);
+            jobs.append(job);
 
-        emit m_transfer->overallProgress(m_progressDone, ++m_progressTotal);
         schedule();
     }
 }
 
 void TransferRetriever::abortJob(TransferJob *j)
 {
+    // a duplicate just stops waiting for the result of the original request
+    for (auto it = m_mergedJobs.begin(); it != m_mergedJobs.end(); ++it) {
+        if (it.value() == j) {
+            m_mergedJobs.erase(it);
+            j->setStatus(TransferJob::Aborted);
+            emit finished(j);
+
+            m_progressDone++;
+            emit overallProgress(m_progressDone, m_progressTotal);
+            if (m_progressDone == m_progressTotal)
+                m_progressDone = m_progressTotal = 0;
+            return;
+        }
+    }
+
+    auto &host = m_hosts[j->url().host()];
+    auto &jobs = host.jobs[j->m_job_class];
+    const int queuePos = int(jobs.indexOf(j));
+
+    // the duplicates of an aborted request are taken over by the first one of them
+    if (m_mergeableJobs.value(j->url()) == j) {
+        m_mergeableJobs.remove(j->url());
+        auto merged = m_mergedJobs.values(j);
+        m_mergedJobs.remove(j);
+
+        if (!merged.isEmpty()) {
+            auto *leader = merged.takeLast(); // QMultiHash::values() returns the newest first
+            m_mergeableJobs.insert(leader->url(), leader);
+            for (auto *dup : qAsConst(merged))
+                m_mergedJobs.insert(leader, dup);
+
+            auto &leaderJobs = host.jobs[leader->m_job_class];
+            leaderJobs.insert(qBound(0, queuePos, int(leaderJobs.size())), leader);
+        }
+    }
+
     j->abortInternal();
 
-    if (m_jobs.removeOne(j)) {
+    if (jobs.removeOne(j)) {
         emit finished(j);
 
         m_progressDone++;
@@ -260,24 +374,40 @@ void TransferRetriever::abortJob(TransferJob *j)
         if (m_progressDone == m_progressTotal)
             m_progressDone = m_progressTotal = 0;
     }
+    schedule();
 }
 
 void TransferRetriever::abortAllJobs()
 {
-    for (auto &j : qAsConst(m_jobs)) {
-        j->abortInternal();
+    int abortedCount = 0;
+
+    for (auto &host : m_hosts) {
+        for (auto &jobs : host.jobs) {
+            for (auto &j : qAsConst(jobs)) {
+                j->abortInternal();
+                emit finished(j);
+            }
+            abortedCount += jobs.size();
+            jobs.clear();
+        }
+    }
+    for (auto *j : qAsConst(m_mergedJobs)) {
+        j->setStatus(TransferJob::Aborted);
         emit finished(j);
     }
+    abortedCount += m_mergedJobs.size();
+    m_mergedJobs.clear();
+    m_mergeableJobs.clear();
 
-    m_progressDone += m_jobs.size();
+    m_progressDone += abortedCount;
     emit overallProgress(m_progressDone, m_progressTotal);
     if (m_progressDone == m_progressTotal)
         m_progressDone = m_progressTotal = 0;
 
-    m_jobs.clear();
-
     for (auto &j : qAsConst(m_currentJobs))
         j->abortInternal();
+
+    updateStatistics();
 }
 
 void TransferRetriever::schedule()
@@ -287,61 +417,247 @@ void TransferRetriever::schedule()
         m_nam->setRedirectPolicy(QNetworkRequest::NoLessSafeRedirectPolicy);
         connect(m_nam, &QNetworkAccessManager::finished,
                 this, &TransferRetriever::downloadFinished);
-    }
 
-    while ((m_currentJobs.size() <= m_maxConnections) && !m_jobs.isEmpty()) {
-        auto j = m_jobs.takeFirst();
+        m_wakeUpTimer = new QTimer(this);
+        m_wakeUpTimer->setSingleShot(true);
+        connect(m_wakeUpTimer, &QTimer::timeout,
+                this, &TransferRetriever::schedule);
+    }
 
-        bool isget = (j->m_http_method == TransferJob::HttpGet);
-        QUrl url = j->url();
-        j->m_effective_url = url;
+    const qint64 now = m_clock.elapsed();
+    qint64 wakeUp = -1;
+    auto wakeUpIn = [&wakeUp](qint64 ms) {
+        wakeUp = (wakeUp < 0) ? ms : qMin(wakeUp, ms);
+    };
 
-        QNetworkRequest req(url);
-#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
-        req.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
-#endif
-        req.setAttribute(QNetworkRequest::HttpPipeliningAllowedAttribute, true);
-        req.setHeader(QNetworkRequest::UserAgentHeader, m_transfer->userAgent());
-        if (j->m_no_redirects) {
-            req.setAttribute(QNetworkRequest::RedirectPolicyAttribute,
-                             QNetworkRequest::ManualRedirectPolicy);
+    for (auto &host : m_hosts) {
+        if (std::all_of(std::cbegin(host.jobs), std::cend(host.jobs),
+                        [](const auto &jobs) { return jobs.isEmpty(); })) {
+            continue;
         }
-
-        auto ssl = req.sslConfiguration();
-        ssl.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
-        if (!m_sslSession.isEmpty())
-            ssl.setSessionTicket(m_sslSession);
-        req.setSslConfiguration(ssl);
-
-        j->setStatus(TransferJob::Active);
-        if (isget) {
-            if (j->m_only_if_newer.isValid())
-                req.setHeader(QNetworkRequest::IfModifiedSinceHeader, j->m_only_if_newer);
-            j->m_reply = m_nam->get(req);
+        if (host.pausedUntil > now) {
+            wakeUpIn(host.pausedUntil - now);
+            continue;
         }
-        else {
-            req.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded"_l1);
-            QByteArray postdata = url.query(QUrl::FullyEncoded).toLatin1();
-            url.setQuery(QUrlQuery());
-            req.setUrl(url);
-            j->m_reply = m_nam->post(req, postdata);
+        const int maxActive = m_maxConnectionsPerHost * (host.http2 ? Http2StreamsPerConnection : 1);
+
+        // Round-robin over the job classes, so a busy class can't starve the others of
+        // connections. A class is skipped completely as soon as it has to wait, so a throttled
+        // class neither blocks the others nor gets its (possibly long) queue scanned.
+        uint waiting = 0;
+        bool started = true;
+        while (started && (host.activeCount < maxActive)) {
+            started = false;
+
+            for (uint jc = 0; (jc < TransferJob::JobClassCount) && (host.activeCount < maxActive); ++jc) {
+                auto &jobs = host.jobs[jc];
+                if ((waiting & (1U << jc)) || jobs.isEmpty())
+                    continue;
+
+                // the retries are at the front of the queue: skip the ones still backing off
+                int i = 0;
+                for ( ; i < jobs.size(); ++i) {
+                    const qint64 wait = jobs.at(i)->m_not_before - now;
+                    if (wait <= 0)
+                        break;
+                    wakeUpIn(wait);
+                }
+                qint64 wait = (i < jobs.size()) ? takeToken(host, jc, now) : 0;
+                if ((i == jobs.size()) || (wait > 0)) {
+                    if (wait > 0)
+                        wakeUpIn(wait);
+                    waiting |= (1U << jc);
+                    continue;
+                }
+                auto *j = jobs.takeAt(i);
+                ++host.activeCount;
+                startJob(j);
+                started = true;
+            }
         }
+    }
 
-        qCInfo(LogTransfer) << (isget ? ">> GET" : ">> POST") << req.url();
-        if (LogTransfer().isDebugEnabled()) {
-            const auto headers = j->m_reply->request().rawHeaderList();
-            for (const auto &header : headers)
-                qCDebug(LogTransfer()) << header << ":" << j->m_reply->request().rawHeader(header);
-        }
+    if ((wakeUp >= 0) && (!m_wakeUpTimer->isActive() || (m_wakeUpTimer->remainingTime() > wakeUp)))
+        m_wakeUpTimer->start(int(qMin<qint64>(wakeUp, std::numeric_limits<int>::max())));
 
-        j->m_reply->setProperty("bsJob", QVariant::fromValue(j));
+    updateStatistics();
+}
 
-        connect(j->m_reply, &QNetworkReply::downloadProgress, this, [this, j](qint64 recv, qint64 total) {
-            emit progress(j, int(recv), int(total));
-        });
+qint64 TransferRetriever::takeToken(Host &host, uint jobClass, qint64 now)
+{
+    const auto &policy = m_policies[jobClass];
+    if (policy.requestsPerSecond <= 0)
+        return 0;
+
+    auto &bucket = host.buckets[jobClass];
+    const double rate = (bucket.rate > 0) ? bucket.rate : policy.requestsPerSecond;
+    if (bucket.tokens < 0) {
+        bucket.tokens = policy.burst;
+    } else {
+        bucket.tokens = qMin(double(policy.burst),
+                             bucket.tokens + double(now - bucket.lastRefill) * rate / 1000);
+    }
+    bucket.lastRefill = now;
+
+    if (bucket.tokens >= 1) {
+        bucket.tokens -= 1;
+        return 0;
+    }
+    return qMax<qint64>(1, qint64(std::ceil((1 - bucket.tokens) * 1000 / rate)));
+}
+
+void TransferRetriever::adjustRate(Host &host, uint jobClass, bool throttled)
+{
+    const auto &policy = m_policies[jobClass];
+    if (policy.requestsPerSecond <= 0)
+        return;
+
+    auto &bucket = host.buckets[jobClass];
+    const double rate = (bucket.rate > 0) ? bucket.rate : policy.requestsPerSecond;
+
+    if (throttled) {
+        bucket.rate = qMax(policy.requestsPerSecond * MinimumRateFactor, rate * RateDecreaseFactor);
+        // no bursts until the server has recovered
+        bucket.tokens = 0;
+        bucket.lastRefill = m_clock.elapsed();
+
+        qCInfo(LogTransfer) << "Lowered the request rate for job class" << jobClass << "to"
+                            << bucket.rate << "per second";
+    } else if (rate < policy.requestsPerSecond) {
+        bucket.rate = qMin(policy.requestsPerSecond, rate + policy.requestsPerSecond * RateIncreaseFactor);
+    }
+}
+
+qint64 TransferRetriever::backoffDelay(const TransferJob *j, QNetworkReply *reply) const
+{
+    const auto &policy = m_policies[j->m_job_class];
+
+    // exponential, with the upper half jittered to keep the retries from coming in bursts
+    qint64 delay = qMin<qint64>(policy.maxBackoffMs, qint64(policy.backoffMs) << qMin(uint(j->m_backoff_count), 16U));
+    delay = delay / 2 + QRandomGenerator::global()->bounded(int(delay / 2) + 1);
+
+    // only the delta-seconds form of Retry-After is used by BrickLink
+    bool ok = false;
+    const qint64 retryAfter = reply->rawHeader("Retry-After").trimmed().toLongLong(&ok);
+    if (ok && (retryAfter > 0))
+        delay = qMax(delay, qMin<qint64>(retryAfter * 1000, policy.maxBackoffMs));
+    return delay;
+}
+
+void TransferRetriever::retryLater(TransferJob *j, Host &host, qint64 delay, bool pauseHost)
+{
+    j->m_reply->deleteLater();
+    j->m_reply = nullptr;
+    j->setStatus(TransferJob::Inactive);
+    j->m_backoff_count = qMin(uint(j->m_backoff_count) + 1, 15U);
+    j->m_not_before = m_clock.elapsed() + delay;
+    if (pauseHost)
+        host.pausedUntil = qMax(host.pausedUntil, j->m_not_before);
+
+    m_currentJobs.removeAll(j);
+    --host.activeCount;
+    host.jobs[j->m_job_class].prepend(j);
+    ++m_retriedCount;
+
+    QMetaObject::invokeMethod(this, &TransferRetriever::schedule, Qt::QueuedConnection);
+}
+
+void TransferRetriever::updateStatistics()
+{
+    int queued = int(m_mergedJobs.size());
+    for (const auto &host : qAsConst(m_hosts)) {
+        for (const auto &jobs : host.jobs)
+            queued += int(jobs.size());
+    }
+    if (!queued && m_currentJobs.isEmpty())
+        m_retriedCount = m_throttledCount = 0;
+
+    const int stats[4] = { queued, int(m_currentJobs.size()), m_retriedCount, m_throttledCount };
+    if (std::equal(std::begin(stats), std::end(stats), std::begin(m_lastStatistics)))
+        return;
+    std::copy(std::begin(stats), std::end(stats), std::begin(m_lastStatistics));
+    emit statisticsChanged(queued, stats[1], m_retriedCount, m_throttledCount);
+}
+
+void TransferRetriever::startJob(TransferJob *j)
+{
+    bool isget = (j->m_http_method == TransferJob::HttpGet);
+    QUrl url = j->url();
+    j->m_effective_url = url;
+
+    QNetworkRequest req(url);
+    req.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 3, 0)
+    QHttp1Configuration http1;
+    http1.setNumberOfConnectionsPerHost(qsizetype(m_maxConnectionsPerHost));
+    req.setHttp1Configuration(http1);
+#endif
+    req.setAttribute(QNetworkRequest::HttpPipeliningAllowedAttribute, true);
+    req.setHeader(QNetworkRequest::UserAgentHeader, m_transfer->userAgent());
+    if (j->m_no_redirects) {
+        req.setAttribute(QNetworkRequest::RedirectPolicyAttribute,
+                         QNetworkRequest::ManualRedirectPolicy);
+    }
 
-        m_currentJobs.append(j);
-        emit started(j);
+    auto ssl = req.sslConfiguration();
+    ssl.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    if (!m_sslSession.isEmpty())
+        ssl.setSessionTicket(m_sslSession);
+    req.setSslConfiguration(ssl);
+
+    j->setStatus(TransferJob::Active);
+    if (isget) {
+        if (j->m_only_if_newer.isValid())
+            req.setHeader(QNetworkRequest::IfModifiedSinceHeader, j->m_only_if_newer);
+        j->m_reply = m_nam->get(req);
+    }
+    else {
+        req.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded"_l1);
+        QByteArray postdata = url.query(QUrl::FullyEncoded).toLatin1();
+        url.setQuery(QUrlQuery());
+        req.setUrl(url);
+        j->m_reply = m_nam->post(req, postdata);
+    }
+
+    qCInfo(LogTransfer) << (isget ? ">> GET" : ">> POST") << req.url();
+    if (LogTransfer().isDebugEnabled()) {
+        const auto headers = j->m_reply->request().rawHeaderList();
+        for (const auto &header : headers)
+            qCDebug(LogTransfer()) << header << ":" << j->m_reply->request().rawHeader(header);
+    }
+
+    j->m_reply->setProperty("bsJob", QVariant::fromValue(j));
+
+    connect(j->m_reply, &QNetworkReply::downloadProgress, this, [this, j](qint64 recv, qint64 total) {
+        emit progress(j, int(recv), int(total));
+    });
+
+    m_currentJobs.append(j);
+    emit started(j);
+}
+
+void TransferRetriever::finishMergedJobs(TransferJob *j)
+{
+    if (m_mergeableJobs.value(j->url()) != j)
+        return;
+    m_mergeableJobs.remove(j->url());
+
+    const auto merged = m_mergedJobs.values(j);
+    m_mergedJobs.remove(j);
+
+    for (auto *dup : merged) {
+        dup->m_respcode = j->m_respcode;
+        dup->m_effective_url = j->m_effective_url;
+        dup->m_redirect_url = j->m_redirect_url;
+        dup->m_error_string = j->m_error_string;
+        dup->m_last_modified = j->m_last_modified;
+        dup->m_was_not_modified = j->m_was_not_modified;
+        if (dup->m_data && j->m_data)
+            *dup->m_data = *j->m_data;
+        dup->setStatus(TransferJob::Status(j->m_status));
+
+        emit overallProgress(++m_progressDone, m_progressTotal);
+        emit finished(dup);
     }
 }
 
@@ -360,15 +676,30 @@ void TransferRetriever::downloadFinished(QNetworkReply *reply)
             qCDebug(LogTransfer()) << header << ":" << j->m_reply->rawHeader(header);
     }
 
+    auto &host = m_hosts[j->url().host()];
+
     if (error != QNetworkReply::NoError) {
         m_sslSession.clear();
 
-        if ((j->m_respcode == 404) && j->m_retries_left) {
+        const bool throttled = (j->m_respcode == 429) || (j->m_respcode == 503);
+        const bool serverError = (j->m_respcode >= 500) && (j->m_respcode < 600);
+
+        if (throttled) {
+            ++m_throttledCount;
+            adjustRate(host, j->m_job_class, true);
+        }
+        if ((throttled || serverError)
+                && (j->m_backoff_count < uint(m_policies[j->m_job_class].maxRetries))) {
+            const qint64 delay = backoffDelay(j, reply);
+            qCWarning(LogTransfer) << "Got a" << j->m_respcode << "on" << j->m_url << "... retrying in"
+                                   << delay << "ms";
+            retryLater(j, host, delay, throttled);
+            return;
+        } else if ((j->m_respcode == 404) && j->m_retries_left) {
             --j->m_retries_left;
-            j->m_reply->deleteLater();
-            j->m_reply = m_nam->get(j->m_reply->request());
-            j->m_reply->setProperty("bsJob", QVariant::fromValue(j));
+            const qint64 delay = backoffDelay(j, reply);
             qWarning() << "Got a 404 on" << j->m_url << " ... retrying (still" << j->m_retries_left << "retries left)";
+            retryLater(j, host, delay, false);
             return;
         } else if ((j->m_respcode == 302) && (error == QNetworkReply::HostNotFoundError)) {
             // this only happens on Windows, starting in April 2021: BL sends a relative redirect,
@@ -387,6 +718,8 @@ void TransferRetriever::downloadFinished(QNetworkReply *reply)
         j->setStatus(TransferJob::Failed);
     } else {
         m_sslSession = reply->sslConfiguration().sessionTicket();
+        host.http2 = reply->attribute(QNetworkRequest::Http2WasUsedAttribute).toBool();
+        adjustRate(host, j->m_job_class, false);
 
         switch (j->m_respcode) {
         case 304:
@@ -424,6 +757,9 @@ void TransferRetriever::downloadFinished(QNetworkReply *reply)
     }
     j->m_reply->deleteLater();
     j->m_reply = nullptr;
+    --host.activeCount;
+
+    finishMergedJobs(j);
 
     emit overallProgress(++m_progressDone, m_progressTotal);
     if (m_progressDone == m_progressTotal)
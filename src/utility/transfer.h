@@ -18,10 +18,13 @@
 #include <QThread>
 #include <QNetworkAccessManager>
 #include <QLoggingCategory>
+#include <QHash>
+#include <QElapsedTimer>
 
 Q_DECLARE_LOGGING_CATEGORY(LogTransfer)
 
 QT_FORWARD_DECLARE_CLASS(QIODevice)
+QT_FORWARD_DECLARE_CLASS(QTimer)
 class Transfer;
 class TransferRetriever;
 
@@ -30,6 +33,16 @@ class TransferJob
 public:
     ~TransferJob();
 
+    enum JobClass : uint {
+        Default = 0,
+        Picture,
+        PriceGuide,
+        Order,
+        Inventory,
+
+        JobClassCount
+    };
+
     static TransferJob *get(const QUrl &url, QIODevice *file = nullptr, uint retries = 0);
     static TransferJob *getIfNewer(const QUrl &url, const QDateTime &dt, QIODevice *file = nullptr);
     static TransferJob *post(const QUrl &url, QIODevice *file = nullptr, bool noRedirects = false);
@@ -51,6 +64,8 @@ public:
     bool isAborted() const           { return m_status == Aborted; }
 
     void setNoRedirects(bool noRedirects) { m_no_redirects = noRedirects; }
+    JobClass jobClass() const        { return JobClass(m_job_class); }
+    void setJobClass(JobClass jc)    { m_job_class = jc; }
     void setUserData(const QByteArray &tag, const QVariant &v) { m_userTag = tag; m_userData = v; }
     QVariant userData(const QByteArray &tag) const             { return m_userTag == tag ? m_userData : QVariant(); }
     QByteArray userTag() const                                 { return m_userTag; }
@@ -93,6 +108,7 @@ private:
     QDateTime    m_only_if_newer;
     QDateTime    m_last_modified;
     QNetworkReply *m_reply = nullptr;
+    qint64       m_not_before = 0; // waiting for a retry until this point on the retriever's clock
 
     QByteArray   m_userTag;
     QVariant     m_userData;
@@ -106,6 +122,8 @@ private:
     uint         m_retries_left     : 4;
     int          m_was_not_modified : 1 = false;
     int          m_no_redirects     : 1;
+    uint         m_job_class        : 3 = Default;
+    uint         m_backoff_count    : 4 = 0;
 
     friend class Transfer;
     friend class TransferRetriever;
@@ -114,6 +132,16 @@ private:
 Q_DECLARE_METATYPE(TransferJob *)
 
 
+struct TransferPolicy
+{
+    double requestsPerSecond = 0; // per host, 0 means unlimited (this is the upper limit, see adjustRate())
+    int burst = 1;                // requests that can be sent back-to-back after being idle
+    int maxRetries = 3;           // on 429 and 5xx responses
+    int backoffMs = 1000;         // the first retry delay, doubled on every further retry
+    int maxBackoffMs = 60000;
+};
+
+
 class TransferRetriever : public QObject
 {
     Q_OBJECT
@@ -125,21 +153,63 @@ public:
     void abortJob(TransferJob *job);
     void abortAllJobs();
     void schedule();
+    void setMaxConnectionsPerHost(int n);
+    void setPolicy(TransferJob::JobClass jobClass, const TransferPolicy &policy);
 
 signals:
     void overallProgress(int done, int total);
     void started(TransferJob *job);
     void progress(TransferJob *job, int done, int total);
     void finished(TransferJob *job);
+    void statisticsChanged(int queued, int inFlight, int retried, int throttled);
 
 private:
+    void startJob(TransferJob *j);
     void downloadFinished(QNetworkReply *reply);
+    static bool isMergeable(const TransferJob *j);
+    void finishMergedJobs(TransferJob *j);
+
+    struct TokenBucket {
+        double tokens = -1;           // < 0: not used yet, i.e. full
+        qint64 lastRefill = 0;
+        double rate = -1;             // < 0: not adjusted yet, i.e. the policy's rate
+    };
+
+    struct Host {
+        // waiting, one queue per job class: the retries and high priority ones first
+        QVector<TransferJob *> jobs[TransferJob::JobClassCount];
+        int activeCount = 0;
+        bool http2 = false;           // requests are multiplexed over the HTTP/2 connection
+        qint64 pausedUntil = 0;       // the server asked us to back off
+        TokenBucket buckets[TransferJob::JobClassCount];
+    };
+
+    qint64 takeToken(Host &host, uint jobClass, qint64 now);
+    void adjustRate(Host &host, uint jobClass, bool throttled);
+    qint64 backoffDelay(const TransferJob *j, QNetworkReply *reply) const;
+    void retryLater(TransferJob *j, Host &host, qint64 delay, bool pauseHost);
+    void updateStatistics();
+    static constexpr int Http2StreamsPerConnection = 4;
+    // AIMD: the rate drops to half on every 429/503 and recovers by 5% of the policy's rate
+    // on every successful reply, but it never goes below 1/16 of the policy's rate
+    static constexpr double RateDecreaseFactor = 0.5;
+    static constexpr double RateIncreaseFactor = 0.05;
+    static constexpr double MinimumRateFactor = 1. / 16;
 
     Transfer *m_transfer;
     QNetworkAccessManager *m_nam = nullptr;
-    QVector<TransferJob *> m_jobs;
+    QHash<QString, Host>   m_hosts;
     QVector<TransferJob *> m_currentJobs;
-    int                    m_maxConnections;
+    // identical GET requests are only sent once: the duplicates wait for the result of the first
+    QHash<QUrl, TransferJob *> m_mergeableJobs;
+    QMultiHash<TransferJob *, TransferJob *> m_mergedJobs;
+    int                    m_maxConnectionsPerHost = 6; // the default in QNAM for HTTP/1
+    TransferPolicy         m_policies[TransferJob::JobClassCount];
+    QElapsedTimer          m_clock;
+    QTimer *               m_wakeUpTimer = nullptr;
+    int                    m_retriedCount = 0;
+    int                    m_throttledCount = 0;
+    int                    m_lastStatistics[4] = { 0, 0, 0, 0 };
     int                    m_progressDone = 0;
     int                    m_progressTotal = 0;
     QByteArray             m_sslSession;
@@ -158,6 +228,10 @@ public:
     void abortJob(TransferJob *job);
     void abortAllJobs();
 
+    void setMaxConnectionsPerHost(int n);
+    // replaces the built-in policy for all hosts, e.g. to be gentler on a slow connection
+    void setPolicy(TransferJob::JobClass jobClass, const TransferPolicy &policy);
+
     QString userAgent() const;
 
     static void setDefaultUserAgent(const QString &ua);
@@ -168,6 +242,8 @@ signals:
     void started(TransferJob *);
     void progress(TransferJob *, int done, int total);
     void finished(TransferJob *);
+    // retried and throttled are counted since the last time the queue was empty
+    void statisticsChanged(int queued, int inFlight, int retried, int throttled);
 
 protected:
 
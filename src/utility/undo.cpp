@@ -14,6 +14,11 @@
 
 #include <QtGlobal>
 #include <QDebug>
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+#  include <QtGui/private/qundostack_p.h>
+#else
+#  include <QtWidgets/private/qundostack_p.h>
+#endif
 #if defined(QT_WIDGETS_LIB)
 #  include <QApplication>
 #  include <QToolBar>
@@ -68,9 +73,117 @@ private:
 #endif // defined(QT_WIDGETS_LIB)
 
 
+UndoCommand::~UndoCommand()
+{
+    if (m_stack)
+        m_stack->m_memoryUsage -= m_accountedMemory;
+}
+
+qint64 UndoCommand::memoryUsage() const
+{
+    return qint64(sizeof(*this));
+}
+
+
 UndoStack::UndoStack(QObject *parent)
     : QUndoStack(parent)
-{ }
+{
+    connect(this, &QUndoStack::indexChanged, this, [this](int index) {
+        // Every new command (or finished macro) ends up on top and a merge also only changes
+        // the top command, so this is the only one that has to be (re-)accounted for. Deleted
+        // commands subtract themselves in ~UndoCommand.
+        if (index > 0)
+            accountMemory(command(index - 1));
+
+        // don't interfere with QUndoStack's signal emission: check once the push has finished
+        if ((m_memoryLimit > 0) && !m_memoryCheckPending) {
+            m_memoryCheckPending = true;
+            QMetaObject::invokeMethod(this, &UndoStack::checkMemoryLimit, Qt::QueuedConnection);
+        }
+    });
+}
+
+UndoStack::~UndoStack()
+{
+    // ~QUndoStack deletes the commands after this part of the object is already gone
+    for (int i = 0; i < count(); ++i)
+        detachCommand(command(i));
+}
+
+void UndoStack::accountMemory(const QUndoCommand *cmd)
+{
+    if (auto *uc = const_cast<UndoCommand *>(dynamic_cast<const UndoCommand *>(cmd))) {
+        const qint64 size = uc->memoryUsage();
+        m_memoryUsage += size - ((uc->m_stack == this) ? uc->m_accountedMemory : 0);
+        uc->m_stack = this;
+        uc->m_accountedMemory = size;
+    }
+    for (int i = 0; i < cmd->childCount(); ++i)
+        accountMemory(cmd->child(i));
+}
+
+qint64 UndoStack::accountedMemory(const QUndoCommand *cmd)
+{
+    auto *uc = dynamic_cast<const UndoCommand *>(cmd);
+    qint64 size = uc ? uc->m_accountedMemory : 0;
+    for (int i = 0; i < cmd->childCount(); ++i)
+        size += accountedMemory(cmd->child(i));
+    return size;
+}
+
+void UndoStack::detachCommand(const QUndoCommand *cmd)
+{
+    if (auto *uc = const_cast<UndoCommand *>(dynamic_cast<const UndoCommand *>(cmd)))
+        uc->m_stack = nullptr;
+    for (int i = 0; i < cmd->childCount(); ++i)
+        detachCommand(cmd->child(i));
+}
+
+qint64 UndoStack::memoryLimit() const
+{
+    return m_memoryLimit;
+}
+
+void UndoStack::setMemoryLimit(qint64 bytes)
+{
+    m_memoryLimit = qMax(qint64(0), bytes);
+    checkMemoryLimit();
+}
+
+qint64 UndoStack::memoryUsage() const
+{
+    return m_memoryUsage;
+}
+
+void UndoStack::checkMemoryLimit()
+{
+    m_memoryCheckPending = false;
+    if ((m_memoryLimit <= 0) || (m_memoryUsage <= m_memoryLimit))
+        return;
+
+    // QUndoStack can only drop its oldest commands via an undo limit, which cannot be changed
+    // on a non-empty stack: do what QUndoStackPrivate::checkUndoLimit() does instead
+    auto *d = static_cast<QUndoStackPrivate *>(d_ptr.data());
+    if (!d->macro_stack.isEmpty())
+        return; // endMacro() will trigger another check
+
+    // always keep the newest undo step, plus everything that can still be redone
+    int dropCount = 0;
+    qint64 usage = m_memoryUsage;
+    while ((usage > m_memoryLimit) && (dropCount < (d->index - 1)))
+        usage -= accountedMemory(d->command_list.at(dropCount++));
+    if (!dropCount)
+        return;
+
+    for (int i = 0; i < dropCount; ++i)
+        delete d->command_list.takeFirst();
+    d->index -= dropCount;
+    if (d->clean_index >= 0)
+        d->clean_index = (d->clean_index < dropCount) ? -1 : (d->clean_index - dropCount);
+
+    emit oldestCommandsDropped(dropCount);
+    emit indexChanged(d->index);
+}
 
 void UndoStack::redoMultiple(int count)
 {
@@ -18,6 +18,25 @@
 
 QT_FORWARD_DECLARE_CLASS(QAction)
 
+class UndoStack;
+
+
+// commands can report their approximate memory usage, so the UndoStack can enforce a limit
+class UndoCommand : public QUndoCommand
+{
+public:
+    using QUndoCommand::QUndoCommand;
+    ~UndoCommand() override;
+
+    virtual qint64 memoryUsage() const;
+
+private:
+    UndoStack *m_stack = nullptr; // the stack that added m_accountedMemory to its total
+    qint64 m_accountedMemory = 0;
+
+    friend class UndoStack;
+};
+
 
 class UndoStack : public QUndoStack
 {
@@ -25,13 +44,33 @@ class UndoStack : public QUndoStack
 
 public:
     UndoStack(QObject *parent = nullptr);
+    ~UndoStack() override;
 
     // workaround as long as I haven't added that to Qt
     void endMacro(const QString &str);
 
+    qint64 memoryLimit() const;
+    void setMemoryLimit(qint64 bytes);
+    qint64 memoryUsage() const;
+
 public slots:
     void redoMultiple(int count);
     void undoMultiple(int count);
+
+signals:
+    void oldestCommandsDropped(int count);
+
+private:
+    void accountMemory(const QUndoCommand *cmd);
+    static qint64 accountedMemory(const QUndoCommand *cmd);
+    static void detachCommand(const QUndoCommand *cmd);
+    void checkMemoryLimit();
+
+    qint64 m_memoryLimit = 0;
+    qint64 m_memoryUsage = 0; // running total, kept up to date by the commands themselves
+    bool m_memoryCheckPending = false;
+
+    friend class UndoCommand;
 };
 
 
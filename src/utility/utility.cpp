@@ -25,13 +25,29 @@
 #include "utility.h"
 
 
-static int naturalCompareNumbers(const QChar *&n1, const QChar *&n2)
+// the string views may point into a string pool, so the end pointers are not null-terminated
+
+static inline int naturalDigitValue(QChar c)  { return c.digitValue(); }
+static inline int naturalDigitValue(char c)   { return ((c >= '0') && (c <= '9')) ? (c - '0') : -1; }
+static inline bool naturalIsDigit(QChar c)    { return c.isDigit(); }
+static inline bool naturalIsDigit(char c)     { return (c >= '0') && (c <= '9'); }
+static inline bool naturalIsSpace(QChar c)    { return c.isSpace(); }
+static inline bool naturalIsSpace(char c)     { return QChar::fromLatin1(c).isSpace(); }
+static inline int naturalUnicode(QChar c)     { return c.unicode(); }
+static inline int naturalUnicode(char c)      { return uchar(c); }
+
+template <typename C>
+static int naturalCompareNumbers(const C *&n1, const C *n1e, const C *&n2, const C *n2e)
 {
     int result = 0;
 
     while (true) {
-        const auto d1 = (n1++)->digitValue();
-        const auto d2 = (n2++)->digitValue();
+        const auto d1 = (n1 < n1e) ? naturalDigitValue(*n1) : -1;
+        const auto d2 = (n2 < n2e) ? naturalDigitValue(*n2) : -1;
+        if (n1 < n1e)
+            ++n1;
+        if (n2 < n2e)
+            ++n2;
 
         if (d1 == -1 && d2 == -1)
             return result;
@@ -44,10 +60,12 @@ static int naturalCompareNumbers(const QChar *&n1, const QChar *&n2)
     }
 }
 
-int Utility::naturalCompare(const QString &name1, const QString &name2)
+template <typename C, typename LocaleCompare>
+static int naturalCompareImpl(const C *n1, const C *n1e, const C *n2, const C *n2e,
+                              LocaleCompare localeCompare)
 {
-    bool empty1 = name1.isEmpty();
-    bool empty2 = name2.isEmpty();
+    bool empty1 = (n1 == n1e);
+    bool empty2 = (n2 == n2e);
 
     if (empty1 && empty2)
         return 0;
@@ -57,25 +75,21 @@ int Utility::naturalCompare(const QString &name1, const QString &name2)
         return 1;
 
     bool special = false;
-    const QChar *n1 = name1.constData();
-    const QChar *n1e = n1 + name1.size();
-    const QChar *n2 = name2.constData();
-    const QChar *n2e = n2 + name2.size();
 
     while (true) {
         // 1) skip white space
-        while ((n1 < n1e) && n1->isSpace()) {
+        while ((n1 < n1e) && naturalIsSpace(*n1)) {
             n1++;
             special = true;
         }
-        while ((n2 < n2e) && n2->isSpace()) {
+        while ((n2 < n2e) && naturalIsSpace(*n2)) {
             n2++;
             special = true;
         }
 
         // 2) check for numbers
-        if ((n1 < n1e) && n1->isDigit() && (n2 < n2e) && n2->isDigit()) {
-            int d = naturalCompareNumbers(n1, n2);
+        if ((n1 < n1e) && naturalIsDigit(*n1) && (n2 < n2e) && naturalIsDigit(*n2)) {
+            int d = naturalCompareNumbers(n1, n1e, n2, n2e);
             if (d)
                 return d;
             special = true;
@@ -84,7 +98,7 @@ int Utility::naturalCompare(const QString &name1, const QString &name2)
 
         // 4) naturally the same -> let the unicode order decide
         if ((n1 >= n1e) && (n2 >= n2e))
-            return special ? name1.localeAwareCompare(name2) : 0;
+            return special ? localeCompare() : 0;
 
         // 5) found a difference
         if (n1 >= n1e)
@@ -92,12 +106,32 @@ int Utility::naturalCompare(const QString &name1, const QString &name2)
         else if (n2 >= n2e)
             return 1;
         else if (*n1 != *n2)
-            return n1->unicode() - n2->unicode();
+            return naturalUnicode(*n1) - naturalUnicode(*n2);
 
         n1++; n2++;
     }
 }
 
+int Utility::naturalCompare(QStringView name1, QStringView name2)
+{
+    const QChar *n1 = name1.constData();
+    const QChar *n2 = name2.constData();
+
+    return naturalCompareImpl(n1, n1 + name1.size(), n2, n2 + name2.size(), [=]() {
+        return (name1 == name2) ? 0 : name1.toString().localeAwareCompare(name2.toString());
+    });
+}
+
+int Utility::naturalCompare(QLatin1String name1, QLatin1String name2)
+{
+    const char *n1 = name1.data();
+    const char *n2 = name2.data();
+
+    return naturalCompareImpl(n1, n1 + name1.size(), n2, n2 + name2.size(), [=]() {
+        return (name1 == name2) ? 0 : QString(name1).localeAwareCompare(QString(name2));
+    });
+}
+
 QColor Utility::gradientColor(const QColor &c1, const QColor &c2, qreal f)
 {
 #if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
@@ -55,7 +55,12 @@ inline bool fuzzyCompare(double d1, double d2)
 
 namespace Utility {
 
-int naturalCompare(const QString &s1, const QString &s2);
+int naturalCompare(QStringView s1, QStringView s2);
+int naturalCompare(QLatin1String s1, QLatin1String s2);
+inline int naturalCompare(const QString &s1, const QString &s2)
+{
+    return naturalCompare(QStringView(s1), QStringView(s2));
+}
 
 QColor gradientColor(const QColor &c1, const QColor &c2, qreal f = 0.5);
 QColor textColor(const QColor &backgroundColor);
@@ -0,0 +1,562 @@
+/* Copyright (C) 2004-2022 Robert Griebl. All rights reserved.
+**
+** This file is part of BrickStore.
+**
+** This file may be distributed and/or modified under the terms of the GNU
+** General Public License version 2 as published by the Free Software Foundation
+** and appearing in the file LICENSE.GPL included in the packaging of this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+** See http://fsf.org/licensing/licenses/gpl.html for GPL licensing information.
+*/
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <span>
+#include <utility>
+
+#include <QtCore/QDirIterator>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QPointer>
+#include <QtCore/QRandomGenerator>
+#include <QtCore/QStringBuilder>
+#include <QtCore/QTextStream>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+#include <QtNetwork/QNetworkProxy>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+#include <QtTest/QtTest>
+
+#include "utility/utility.h"
+#include "utility/transfer.h"
+#include "bricklink/priceguide.h"
+#include "bricklink/database.h"
+
+
+// A minimal HTTP/1.1 server on localhost: it answers every GET with the request's path as the
+// body. The replies can be held back, so the requests in flight can be counted, or delayed to
+// simulate the round trip time to a real server.
+class MockServer : public QTcpServer
+{
+    Q_OBJECT
+public:
+    MockServer()
+    {
+        connect(this, &QTcpServer::newConnection, this, [this]() {
+            while (auto *socket = nextPendingConnection()) {
+                connect(socket, &QTcpSocket::readyRead,
+                        this, [this, socket]() { readRequests(socket); });
+                connect(socket, &QTcpSocket::disconnected,
+                        this, [this, socket]() { m_buffers.remove(socket); socket->deleteLater(); });
+            }
+        });
+        listen(QHostAddress::LocalHost);
+    }
+
+    QUrl url(const QString &path) const
+    {
+        return QUrl(u"http://127.0.0.1:" % QString::number(serverPort()) % u'/' % path);
+    }
+
+    void setHoldReplies(bool hold)
+    {
+        m_hold = hold;
+        if (!m_hold)
+            replyToAll();
+    }
+
+    void setReplyDelay(int msec)     { m_replyDelay = msec; }
+
+    int pendingCount() const         { return int(m_pending.size()); }
+    int maxPendingCount() const      { return m_maxPending; }
+    int requestCount(const QString &path) const { return m_requests.value('/' + path.toLatin1()); }
+    int totalRequestCount() const    { return m_totalRequests; }
+
+private:
+    void readRequests(QTcpSocket *socket)
+    {
+        auto &buffer = m_buffers[socket];
+        buffer.append(socket->readAll());
+
+        qsizetype headerEnd;
+        while ((headerEnd = buffer.indexOf("\r\n\r\n")) >= 0) {
+            const QByteArray requestLine = buffer.left(buffer.indexOf("\r\n"));
+            buffer.remove(0, headerEnd + 4); // GET requests don't have a body
+
+            const QByteArray path = requestLine.split(' ').value(1);
+            ++m_requests[path];
+            ++m_totalRequests;
+            m_pending.append({ socket, path });
+            m_maxPending = qMax(m_maxPending, int(m_pending.size()));
+        }
+        if (m_hold)
+            return;
+        if (m_replyDelay > 0)
+            QTimer::singleShot(m_replyDelay, this, [this]() { if (!m_hold) replyToAll(); });
+        else
+            replyToAll();
+    }
+
+    void replyToAll()
+    {
+        const auto pending = std::exchange(m_pending, { });
+        for (const auto &[socket, path] : pending) {
+            if (!socket)
+                continue;
+            socket->write("HTTP/1.1 200 OK\r\n"
+                          "Content-Type: text/plain\r\n"
+                          "Content-Length: " + QByteArray::number(path.size()) + "\r\n"
+                          "\r\n" + path);
+        }
+    }
+
+    bool m_hold = false;
+    int m_replyDelay = 0;
+    QHash<QTcpSocket *, QByteArray> m_buffers;
+    QVector<std::pair<QPointer<QTcpSocket>, QByteArray>> m_pending;
+    QHash<QByteArray, int> m_requests;
+    int m_totalRequests = 0;
+    int m_maxPending = 0;
+};
+
+
+class tst_BrickStore : public QObject
+{
+    Q_OBJECT
+
+private:
+    struct Result {
+        QString name;
+        bool completed = false;
+        QByteArray data;
+    };
+
+    static TransferJob *get(MockServer &server, const QString &path, const QString &name)
+    {
+        auto job = TransferJob::get(server.url(path));
+        job->setUserData("name", name);
+        return job;
+    }
+
+    static void collectResults(Transfer &transfer, QVector<Result> &results)
+    {
+        // the job is deleted right after this signal was emitted
+        connect(&transfer, &Transfer::finished, &transfer, [&results](TransferJob *job) {
+            results.append({ job->userData("name").toString(), job->isCompleted(),
+                             job->data() ? *job->data() : QByteArray { } });
+        });
+    }
+
+    using PriceGuideData = BrickLink::PriceGuide::Data;
+
+    // the QTextStream based parser that was replaced by PriceGuide::parse()
+    static bool parsePriceGuideWithTextStream(const QByteArray &ba, PriceGuideData &result)
+    {
+        using namespace BrickLink;
+
+        result = { };
+
+        QTextStream ts(ba);
+        QString line;
+
+        while (!(line = ts.readLine()).isNull()) {
+            if (line.isEmpty() || (line[0] == '#'_l1) || (line[0] == '\r'_l1))         // skip comments fast
+                continue;
+
+            QStringList sl = line.split('\t'_l1, Qt::KeepEmptyParts);
+
+            if ((sl.count() != 8) || (sl[0].length() != 1) || (sl[1].length() != 1)) {             // sanity check
+                continue;
+            }
+
+            int ti = -1;
+            int ci = -1;
+            bool oldformat = false;
+
+            switch (sl[0][0].toLatin1()) {
+            case 'P': oldformat = true;
+                      Q_FALLTHROUGH();
+            case 'O': ti = int(Time::PastSix);
+                      break;
+            case 'C': oldformat = true;
+                      Q_FALLTHROUGH();
+            case 'I': ti = int(Time::Current);
+                      break;
+            }
+
+            switch (sl[1][0].toLatin1()) {
+            case 'N': ci = int(Condition::New);  break;
+            case 'U': ci = int(Condition::Used); break;
+            }
+
+            if ((ti != -1) && (ci != -1)) {
+                result.lots[ti][ci]                         = sl[oldformat ? 3 : 2].toInt();
+                result.quantities[ti][ci]                   = sl[oldformat ? 2 : 3].toInt();
+                result.prices[ti][ci][int(Price::Lowest)]   = sl[4].toDouble();
+                result.prices[ti][ci][int(Price::Average)]  = sl[5].toDouble();
+                result.prices[ti][ci][int(Price::WAverage)] = sl[6].toDouble();
+                result.prices[ti][ci][int(Price::Highest)]  = sl[7].toDouble();
+            }
+        }
+        return true;
+    }
+
+    static bool isSamePriceGuideData(const PriceGuideData &a, const PriceGuideData &b)
+    {
+        using namespace BrickLink;
+
+        for (int ti = 0; ti < int(Time::Count); ++ti) {
+            for (int ci = 0; ci < int(Condition::Count); ++ci) {
+                if ((a.quantities[ti][ci] != b.quantities[ti][ci]) || (a.lots[ti][ci] != b.lots[ti][ci])
+                        || !std::equal(std::cbegin(a.prices[ti][ci]), std::cend(a.prices[ti][ci]),
+                                       std::cbegin(b.prices[ti][ci]))) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // All the priceguide.txt files in $BRICKSTORE_PRICEGUIDE_CORPUS (the cache directory of a
+    // BrickStore version that still saved the price guides as text files). Without it, a
+    // deterministic set of price guides in the same format is generated.
+    static QVector<QByteArray> priceGuideCorpus()
+    {
+        QVector<QByteArray> corpus;
+
+        const QString dir = qEnvironmentVariable("BRICKSTORE_PRICEGUIDE_CORPUS");
+        if (!dir.isEmpty()) {
+            QDirIterator it(dir, { "priceguide.txt"_l1 }, QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                QFile f(it.next());
+                if (f.open(QIODevice::ReadOnly))
+                    corpus.append(f.readAll());
+            }
+        }
+        if (!corpus.isEmpty())
+            return corpus;
+
+        QRandomGenerator rnd(42);
+        auto price = [&rnd]() { return QByteArray::number(rnd.bounded(100000) / 1000., 'f', 3); };
+
+        for (int i = 0; i < 5000; ++i) {
+            // a few of them in the old P/C format and with DOS line endings
+            const bool oldFormat = (i % 50 == 0);
+            const QByteArray eol = (i % 20 == 0) ? "\r\n" : "\n";
+
+            QByteArray ba = "# Price Guide for part #" + QByteArray::number(3000 + i) + " (Brick), color #"
+                    + QByteArray::number(i % 100) + " (Color)" + eol
+                    + "# last update: Sat Oct 17 12:00:00 2026" + eol + '#' + eol;
+            for (char t : { oldFormat ? 'P' : 'O', oldFormat ? 'C' : 'I' }) {
+                for (char c : { 'N', 'U' }) {
+                    ba = ba + t + '\t' + c + '\t' + QByteArray::number(rnd.bounded(500)) + '\t'
+                            + QByteArray::number(rnd.bounded(10000)) + '\t' + price() + '\t' + price()
+                            + '\t' + price() + '\t' + price() + eol;
+                }
+            }
+            corpus.append(ba);
+        }
+        return corpus;
+    }
+
+    // the binary search over the sorted items that was replaced by Database::findItem()
+    static const BrickLink::Item *findItemWithLowerBound(std::span<const BrickLink::Item> items,
+                                                         std::span<const char> ids,
+                                                         char tid, const QByteArray &id)
+    {
+        auto lessThan = [ids](const BrickLink::Item &item, const std::pair<char, QByteArray> &needle) {
+            int d = (item.m_itemTypeId - needle.first);
+            if (d == 0) {
+                d = memcmp(ids.data() + item.m_idOffset, needle.second.constData(),
+                           size_t(qMin(int(item.m_idSize), int(needle.second.size()))));
+                if (d == 0)
+                    d = int(item.m_idSize) - int(needle.second.size());
+            }
+            return d < 0;
+        };
+
+        auto it = std::lower_bound(items.begin(), items.end(), std::make_pair(tid, id), lessThan);
+        if ((it != items.end()) && (it->m_itemTypeId == tid) && (it->m_idSize == id.size())
+                && (memcmp(ids.data() + it->m_idOffset, id.constData(), size_t(id.size())) == 0)) {
+            return &(*it);
+        }
+        return nullptr;
+    }
+
+    // Fills db with 150000 items, sorted by (type, id) like in a real database, and returns the
+    // (type, id) of every item plus 10% misses in random order.
+    static std::vector<std::pair<char, QByteArray>> fillItemDatabase(BrickLink::Database &db)
+    {
+        static const char itemTypeIds[] = "BCGIMOPS";
+        const int count = 150000;
+
+        std::vector<std::pair<char, QByteArray>> keys;
+        keys.reserve(count);
+        for (int i = 0; i < count; ++i) {
+            QByteArray id = QByteArray::number(qint64(i) * 7919 % 1000003);
+            if (i % 3 == 0)
+                id = id + "pr" + QByteArray::number(i % 1000).rightJustified(4, '0');
+            keys.emplace_back(itemTypeIds[i % 8], id);
+        }
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<BrickLink::Item> items(keys.size());
+        std::vector<char> ids;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            items[i].m_itemTypeId = keys[i].first;
+            items[i].m_idOffset = quint32(ids.size());
+            items[i].m_idSize = quint16(keys[i].second.size());
+            ids.insert(ids.end(), keys[i].second.cbegin(), keys[i].second.cend());
+        }
+        db.m_items = BrickLink::DatabaseArray<BrickLink::Item>(std::move(items));
+        db.m_itemIds = BrickLink::DatabaseArray<char>(std::move(ids));
+        db.m_itemIndex = BrickLink::Database::buildItemIndex(db.m_items.span(), db.m_itemIds.span());
+
+        for (int i = 0; i < count / 10; ++i)
+            keys.emplace_back(itemTypeIds[i % 8], QByteArray::number(i) + 'x');
+
+        QRandomGenerator rnd(42);
+        std::shuffle(keys.begin(), keys.end(), rnd);
+        return keys;
+    }
+
+private slots:
+    void initTestCase()
+    {
+        QNetworkProxy::setApplicationProxy(QNetworkProxy::NoProxy);
+    }
+
+    void transferPerHostLimit()
+    {
+        MockServer server;
+        QVERIFY(server.isListening());
+        Transfer transfer;
+        QVector<Result> results;
+        collectResults(transfer, results);
+
+        transfer.setMaxConnectionsPerHost(2);
+        server.setHoldReplies(true);
+        for (int i = 0; i < 6; ++i) {
+            const QString path = u"job" % QString::number(i);
+            transfer.retrieve(get(server, path, path));
+        }
+
+        QTRY_COMPARE(server.pendingCount(), 2);
+        QTest::qWait(200);
+        QCOMPARE(server.totalRequestCount(), 2);
+
+        server.setHoldReplies(false);
+        QTRY_COMPARE(results.size(), 6);
+        QCOMPARE(server.totalRequestCount(), 6);
+        QCOMPARE(server.maxPendingCount(), 2);
+        for (const auto &result : qAsConst(results)) {
+            QVERIFY(result.completed);
+            QCOMPARE(result.data, '/' + result.name.toLatin1());
+        }
+    }
+
+    void transferMergeDuplicates()
+    {
+        MockServer server;
+        QVERIFY(server.isListening());
+        Transfer transfer;
+        QVector<Result> results;
+        collectResults(transfer, results);
+
+        server.setHoldReplies(true);
+        transfer.retrieve(get(server, "dup"_l1, "first"_l1));
+        transfer.retrieve(get(server, "other"_l1, "other"_l1));
+        transfer.retrieve(get(server, "dup"_l1, "second"_l1));
+        transfer.retrieve(get(server, "dup"_l1, "third"_l1), true);
+
+        QTRY_COMPARE(server.pendingCount(), 2);
+        QTest::qWait(200);
+        QCOMPARE(server.totalRequestCount(), 2);
+
+        server.setHoldReplies(false);
+        QTRY_COMPARE(results.size(), 4);
+        QCOMPARE(server.requestCount("dup"_l1), 1);
+        QCOMPARE(server.requestCount("other"_l1), 1);
+        for (const auto &result : qAsConst(results)) {
+            QVERIFY(result.completed);
+            QCOMPARE(result.data, result.name == u"other" ? QByteArray("/other") : QByteArray("/dup"));
+        }
+    }
+
+    void transferAbortMergedOriginal_data()
+    {
+        QTest::addColumn<bool>("originalActive");
+        QTest::addColumn<int>("expectedRequests");
+
+        // a queued original is replaced in the queue: the URL is only requested once
+        QTest::newRow("queued") << false << 1;
+        // an active original is cancelled: its duplicates have to request the URL again
+        QTest::newRow("active") << true << 2;
+    }
+
+    void transferAbortMergedOriginal()
+    {
+        QFETCH(bool, originalActive);
+        QFETCH(int, expectedRequests);
+
+        MockServer server;
+        QVERIFY(server.isListening());
+        Transfer transfer;
+        QVector<Result> results;
+        collectResults(transfer, results);
+
+        transfer.setMaxConnectionsPerHost(1);
+        server.setHoldReplies(true);
+        if (!originalActive)
+            transfer.retrieve(get(server, "blocker"_l1, "blocker"_l1));
+
+        auto original = get(server, "dup"_l1, "original"_l1);
+        transfer.retrieve(original);
+        transfer.retrieve(get(server, "dup"_l1, "second"_l1));
+        transfer.retrieve(get(server, "dup"_l1, "third"_l1));
+        QTRY_COMPARE(server.pendingCount(), 1);
+
+        original->abort();
+        QTRY_COMPARE(results.size(), 1);
+        QCOMPARE(results.constFirst().name, "original"_l1);
+        QVERIFY(!results.constFirst().completed);
+
+        server.setHoldReplies(false);
+        QTRY_COMPARE(results.size(), originalActive ? 3 : 4);
+        QCOMPARE(server.requestCount("dup"_l1), expectedRequests);
+        for (const auto &result : qAsConst(results)) {
+            if (result.name == u"second" || result.name == u"third") {
+                QVERIFY(result.completed);
+                QCOMPARE(result.data, QByteArray("/dup"));
+            }
+        }
+    }
+
+    void transferThroughput_data()
+    {
+        QTest::addColumn<int>("connectionsPerHost");
+
+        QTest::newRow("1 per host") << 1;
+        QTest::newRow("6 per host") << 6;
+    }
+
+    void transferThroughput()
+    {
+        // Every reply takes at least 10ms, like a round trip to BrickLink: with a single
+        // connection the downloads are strictly sequential.
+        QFETCH(int, connectionsPerHost);
+        static constexpr int UrlCount = 60;
+
+        MockServer server;
+        QVERIFY(server.isListening());
+        server.setReplyDelay(10);
+        Transfer transfer;
+        QVector<Result> results;
+        collectResults(transfer, results);
+        transfer.setMaxConnectionsPerHost(connectionsPerHost);
+
+        int run = 0;
+        QBENCHMARK {
+            results.clear();
+            const QString prefix = u"run" % QString::number(run++) % u"-job";
+            for (int i = 0; i < UrlCount; ++i) {
+                const QString path = prefix % QString::number(i);
+                transfer.retrieve(get(server, path, path));
+            }
+            QTRY_COMPARE_WITH_TIMEOUT(results.size(), UrlCount, 30000);
+        }
+        QVERIFY(server.maxPendingCount() <= connectionsPerHost);
+        for (const auto &result : qAsConst(results))
+            QVERIFY(result.completed);
+    }
+
+    void priceGuideParse_data()
+    {
+        QTest::addColumn<bool>("textStream");
+
+        QTest::newRow("QTextStream") << true;
+        QTest::newRow("direct") << false;
+    }
+
+    void priceGuideParse()
+    {
+        QFETCH(bool, textStream);
+
+        const auto corpus = priceGuideCorpus();
+        QVERIFY(!corpus.isEmpty());
+
+        for (const auto &ba : corpus) {
+            PriceGuideData expected;
+            PriceGuideData actual;
+            QVERIFY(parsePriceGuideWithTextStream(ba, expected));
+            QVERIFY(BrickLink::PriceGuide::parse(ba, actual));
+            if (!isSamePriceGuideData(expected, actual))
+                QFAIL(qPrintable(QString(u"Different results for:\n" % QString::fromUtf8(ba))));
+        }
+
+        PriceGuideData data;
+        QBENCHMARK {
+            for (const auto &ba : corpus) {
+                if (textStream)
+                    parsePriceGuideWithTextStream(ba, data);
+                else
+                    BrickLink::PriceGuide::parse(ba, data);
+            }
+        }
+    }
+
+    void itemIndexBuild()
+    {
+        BrickLink::Database db;
+        fillItemDatabase(db);
+
+        QBENCHMARK {
+            BrickLink::Database::buildItemIndex(db.m_items.span(), db.m_itemIds.span());
+        }
+    }
+
+    void itemLookup_data()
+    {
+        QTest::addColumn<bool>("hashed");
+
+        QTest::newRow("lower_bound") << false;
+        QTest::newRow("findItem") << true;
+    }
+
+    void itemLookup()
+    {
+        QFETCH(bool, hashed);
+
+        BrickLink::Database db;
+        const auto keys = fillItemDatabase(db);
+        const auto items = db.m_items.span();
+        const auto ids = db.m_itemIds.span();
+
+        for (const auto &[tid, id] : keys) {
+            if (db.findItem(tid, id.constData(), id.size()) != findItemWithLowerBound(items, ids, tid, id)) {
+                QFAIL(qPrintable(QString(u"Different results for: " % QLatin1Char(tid) % u' '
+                                         % QLatin1String(id))));
+            }
+        }
+
+        int found = 0;
+        QBENCHMARK {
+            found = 0;
+            for (const auto &[tid, id] : keys) {
+                if (hashed ? db.findItem(tid, id.constData(), id.size())
+                           : findItemWithLowerBound(items, ids, tid, id)) {
+                    ++found;
+                }
+            }
+        }
+        QCOMPARE(found, int(items.size()));
+    }
+};
+
+QTEST_GUILESS_MAIN(tst_BrickStore)
+
+#include "tst_brickstore.moc"